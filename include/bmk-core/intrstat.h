@@ -0,0 +1,52 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BMK_CORE_INTRSTAT_H_
+#define _BMK_CORE_INTRSTAT_H_
+
+#include <bmk-core/types.h>
+
+/*
+ * Per-interrupt-source statistics: number of interrupts taken, and a
+ * log2 histogram of the latency from interrupt entry to the handler
+ * being run.  Bucket n counts latencies in [2^n, 2^(n+1)) ns.
+ */
+#define BMK_INTRSTAT_BUCKETS 32
+
+struct bmk_intrstat {
+	unsigned long is_count;
+	unsigned long is_nlat;
+	bmk_time_t is_totlat;
+	bmk_time_t is_maxlat;
+	unsigned long is_hist[BMK_INTRSTAT_BUCKETS];
+};
+
+void	bmk_intrstat_latency(struct bmk_intrstat *, bmk_time_t);
+void	bmk_intrstat_print(const char *, struct bmk_intrstat *);
+
+/* implemented by the platform, prints all sources with activity */
+void	bmk_platform_intrstat_dump(void);
+
+#endif /* _BMK_CORE_INTRSTAT_H_ */
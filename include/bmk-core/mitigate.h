@@ -0,0 +1,78 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BMK_CORE_MITIGATE_H_
+#define _BMK_CORE_MITIGATE_H_
+
+#include <bmk-core/types.h>
+
+/*
+ * Default: switch to polling at >= 16 events within 1ms,
+ * back to interrupts after 200us without work.  A poller
+ * which sleeps between rounds polls every 50us.
+ *
+ * These are estimates, not measurements; netbench in tests/basic
+ * (packets per second and latency) is what to tune them with.
+ * The reasoning:
+ *   - 16/ms is 16k interrupts per second.  Under virtualization an
+ *     interrupt costs a few exits plus a thread wakeup, a few us in
+ *     total, so at that rate several percent of the CPU goes to
+ *     interrupt overhead alone.  Bulk traffic is far above the rate,
+ *     interactive traffic far below it.
+ *   - 200us is long enough to bridge the gaps in a busy stream
+ *     (a 1500 byte frame takes 12us at 1Gbit/s), and short enough
+ *     that the polling after a burst costs little.
+ *   - 50us between rounds is a few frames at 1Gbit/s, much less than
+ *     a receive ring holds, and bounds the latency polling adds.
+ */
+#define BMK_MITIGATE_ENTER	16
+#define BMK_MITIGATE_WINDOW	(1000*1000ULL)
+#define BMK_MITIGATE_IDLE	(200*1000ULL)
+#define BMK_MITIGATE_POLLINT	(50*1000ULL)
+
+struct bmk_mitigate {
+	/* tunables, mit_enter == 0 disables mitigation */
+	unsigned int mit_enter;
+	bmk_time_t mit_window;
+	bmk_time_t mit_idle;
+	bmk_time_t mit_pollint;
+
+	/* state */
+	int mit_polling;
+	unsigned int mit_events;
+	bmk_time_t mit_winstart;
+	bmk_time_t mit_lastwork;
+
+	/* statistics */
+	unsigned long mit_nintr;
+	unsigned long mit_npoll;
+	unsigned long mit_nswitch;
+};
+
+void	bmk_mitigate_init(struct bmk_mitigate *);
+int	bmk_mitigate_intr(struct bmk_mitigate *);
+int	bmk_mitigate_poll(struct bmk_mitigate *, int);
+
+#endif /* _BMK_CORE_MITIGATE_H_ */
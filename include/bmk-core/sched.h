@@ -45,6 +45,7 @@ void	bmk_sched_startmain(void (*)(void *), void *) __attribute__((noreturn));
 void	bmk_sched_yield(void);
 
 void	bmk_sched_dumpqueue(void);
+void	bmk_sched_tracenames(void);
 
 struct bmk_thread *bmk_sched_create(const char *, void *, int,
 				    void (*)(void *), void *,
@@ -63,6 +64,9 @@ int	bmk_sched_block(void);
 
 void	bmk_sched_wake(struct bmk_thread *);
 
+#define BMK_SCHED_PRIO_DEFAULT 0
+void	bmk_sched_setprio(struct bmk_thread *, int);
+
 
 void	bmk_sched_suspend(struct bmk_thread *);
 void	bmk_sched_unsuspend(struct bmk_thread *);
@@ -0,0 +1,90 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _BMK_CORE_TRACE_H_
+#define _BMK_CORE_TRACE_H_
+
+#include <bmk-core/types.h>
+
+/*
+ * Binary event trace.  Tracepoints write fixed-size timestamped
+ * records into a ring, which can be extracted from a memory dump or
+ * written to a block device, and converted to Chrome trace format
+ * with app-tools/rumptrace.  The layout is therefore an ABI: bump
+ * BMK_TRACE_VERSION when changing it.
+ *
+ * There is one ring per CPU, i.e. one ring.
+ */
+
+#define BMK_TRACE_VERSION	1
+#define BMK_TRACE_NRECS		8192	/* power of 2 */
+
+#define BMK_TRACE_THREAD	1	/* thread created, a0+a1: name	*/
+#define BMK_TRACE_SWITCH	2	/* a1: next thread		*/
+#define BMK_TRACE_BLOCK		3	/* a1: wakeup time		*/
+#define BMK_TRACE_WAKE		4	/* a1: woken thread		*/
+#define BMK_TRACE_INTR		5	/* interrupt taken, a0: intr	*/
+#define BMK_TRACE_INTRRUN	6	/* handlers started, a0: intr	*/
+#define BMK_TRACE_RUMPSCHED	7	/* got a rump kernel CPU	*/
+#define BMK_TRACE_RUMPUNSCHED	8	/* released rump kernel CPU	*/
+#define BMK_TRACE_BIOSUBMIT	9	/* a0: 1 if read, a1: cookie	*/
+#define BMK_TRACE_BIODONE	10	/* a0: error, a1: cookie	*/
+
+struct bmk_trace_rec {
+	uint64_t tr_time;
+	uint64_t tr_thread;
+	uint32_t tr_event;
+	uint32_t tr_arg0;
+	uint64_t tr_arg1;
+};
+
+struct bmk_trace_ring {
+	char tr_magic[8];		/* "BMKTRACE" */
+	uint32_t tr_version;
+	uint32_t tr_cpu;
+	uint32_t tr_recsize;
+	uint32_t tr_nrecs;
+	uint64_t tr_head;		/* total records written */
+	uint64_t tr_spare[4];
+
+	struct bmk_trace_rec tr_recs[BMK_TRACE_NRECS];
+};
+
+extern int bmk_trace_enabled;
+
+void	bmk_trace_enable(int);
+void	bmk_trace_record(void *, uint32_t, uint32_t, uint64_t);
+void	bmk_trace_threadname(void *, const char *);
+struct bmk_trace_ring *bmk_trace_getring(void);
+
+static inline void
+bmk_trace(uint32_t event, uint32_t arg0, uint64_t arg1)
+{
+
+	if (__builtin_expect(bmk_trace_enabled, 0))
+		bmk_trace_record((void *)0, event, arg0, arg1);
+}
+
+#endif /* _BMK_CORE_TRACE_H_ */
@@ -30,6 +30,8 @@ int rumprun_platform_rumpuser_init(void);
 #define LIBRUMPUSER
 #include <rump/rumpuser.h>
 
+#include <bmk-core/trace.h>
+
 extern struct rumpuser_hyperup rumpuser__hyp;
 
 static inline void
@@ -37,6 +39,7 @@ rumpkern_unsched(int *nlocks, void *interlock)
 {
 
 	rumpuser__hyp.hyp_backend_unschedule(0, nlocks, interlock);
+	bmk_trace(BMK_TRACE_RUMPUNSCHED, 0, 0);
 }
 
 static inline void
@@ -44,4 +47,5 @@ rumpkern_sched(int nlocks, void *interlock)
 {
 
 	rumpuser__hyp.hyp_backend_schedule(nlocks, interlock);
+	bmk_trace(BMK_TRACE_RUMPSCHED, 0, 0);
 }
@@ -0,0 +1,80 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Raw frame rings, in the style of netmap.  An application opens
+ * the rings of interface unit n ("xenif<n>", "vionet<n>") and gets
+ * an RX and a TX ring per device queue.  The slots point directly
+ * at the buffers the device uses, so frames are neither copied nor
+ * passed through the TCP/IP stack.  While the rings are open, the
+ * stack neither receives from nor sends on the interface.
+ *
+ * Ring indices are free-running, slot i is nr_slot[i & (nr_num-1)].
+ * The slots from nr_head up to nr_tail belong to the application:
+ * on the RX ring they hold received frames, on the TX ring they are
+ * free to be filled.  The application advances nr_head past the
+ * slots it is done with and calls the sync routine, which hands
+ * them to the device and moves nr_tail with what the device has
+ * done since.  A frame larger than nr_bufsize spans several slots,
+ * all but the last with NETRING_F_MORE.
+ *
+ * A TX slot may be pointed at any buffer, e.g. at an RX slot the
+ * application has not yet released, to forward without copying.
+ * The slot gets its own buffer back once the frame has been sent.
+ *
+ * The rings are not locked: use each from one thread at a time.
+ */
+
+#ifndef _RUMPRUN_NETRING_H_
+#define _RUMPRUN_NETRING_H_
+
+struct rumprun_netring_slot {
+	void *ns_buf;
+	unsigned int ns_len;
+	unsigned int ns_flags;
+};
+#define NETRING_F_MORE		0x01	/* frame continues in next slot */
+#define NETRING_F_CSUMOK	0x02	/* RX: checksums validated */
+
+struct rumprun_netring {
+	unsigned int nr_num;		/* slots, a power of two */
+	unsigned int nr_bufsize;	/* size of a slot's own buffer */
+	unsigned int nr_head;		/* application */
+	unsigned int nr_tail;		/* driver */
+	struct rumprun_netring_slot *nr_slot;
+};
+
+struct rumprun_netif;
+
+int	rumprun_netring_open(int, struct rumprun_netif **);
+void	rumprun_netring_close(struct rumprun_netif *);
+int	rumprun_netring_nrings(struct rumprun_netif *);
+struct rumprun_netring *rumprun_netring_rx(struct rumprun_netif *, int);
+struct rumprun_netring *rumprun_netring_tx(struct rumprun_netif *, int);
+int	rumprun_netring_rxsync(struct rumprun_netif *, int);
+int	rumprun_netring_txsync(struct rumprun_netif *, int);
+void	rumprun_netring_wait(struct rumprun_netif *, int);
+
+#endif /* _RUMPRUN_NETRING_H_ */
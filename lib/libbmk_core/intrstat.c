@@ -0,0 +1,78 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Interrupt statistics.  The platform bumps is_count when it takes
+ * an interrupt, and reports the entry-to-handler latency when the
+ * handler gets to run.  Several interrupts may be coalesced into one
+ * handler run, so is_nlat <= is_count.
+ */
+
+#include <bmk-core/intrstat.h>
+#include <bmk-core/printf.h>
+
+void
+bmk_intrstat_latency(struct bmk_intrstat *is, bmk_time_t lat)
+{
+	int b;
+
+	is->is_nlat++;
+	is->is_totlat += lat;
+	if (lat > is->is_maxlat)
+		is->is_maxlat = lat;
+
+	if (lat == 0)
+		b = 0;
+	else
+		b = 63 - __builtin_clzll(lat);
+	if (b >= BMK_INTRSTAT_BUCKETS)
+		b = BMK_INTRSTAT_BUCKETS-1;
+	is->is_hist[b]++;
+}
+
+void
+bmk_intrstat_print(const char *name, struct bmk_intrstat *is)
+{
+	int b, first, last;
+
+	bmk_printf("%s: %lu interrupts, %lu handler runs", name,
+	    is->is_count, is->is_nlat);
+	if (is->is_nlat == 0) {
+		bmk_printf("\n");
+		return;
+	}
+	bmk_printf(", latency avg %llu max %llu ns\n",
+	    (unsigned long long)(is->is_totlat / is->is_nlat),
+	    (unsigned long long)is->is_maxlat);
+
+	for (first = 0; is->is_hist[first] == 0; first++)
+		continue;
+	for (last = BMK_INTRSTAT_BUCKETS-1; is->is_hist[last] == 0; last--)
+		continue;
+	for (b = first; b <= last; b++) {
+		bmk_printf("\t%10llu ns: %lu\n",
+		    1ULL << b, is->is_hist[b]);
+	}
+}
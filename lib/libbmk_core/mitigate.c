@@ -0,0 +1,103 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Adaptive interrupt mitigation.  The driver tells us about every
+ * interrupt and about every poll round.  When the interrupt rate goes
+ * above a threshold, we tell the driver to mask its interrupt source
+ * and start polling.  When polling has found no work for a while,
+ * we tell the driver to go back to interrupts.
+ *
+ * This keeps latency low at low rates, while at high rates avoiding
+ * paying for an interrupt plus a thread wakeup for every event.
+ */
+
+#include <bmk-core/mitigate.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/string.h>
+
+void
+bmk_mitigate_init(struct bmk_mitigate *mit)
+{
+
+	bmk_memset(mit, 0, sizeof(*mit));
+	mit->mit_enter = BMK_MITIGATE_ENTER;
+	mit->mit_window = BMK_MITIGATE_WINDOW;
+	mit->mit_idle = BMK_MITIGATE_IDLE;
+	mit->mit_pollint = BMK_MITIGATE_POLLINT;
+}
+
+/*
+ * Account an interrupt.  Returns nonzero if the caller should mask
+ * the interrupt and switch to polling.
+ */
+int
+bmk_mitigate_intr(struct bmk_mitigate *mit)
+{
+	bmk_time_t now;
+
+	mit->mit_nintr++;
+	if (mit->mit_polling || mit->mit_enter == 0)
+		return 0;
+
+	now = bmk_platform_cpu_clock_monotonic();
+	if (now - mit->mit_winstart > mit->mit_window) {
+		mit->mit_winstart = now;
+		mit->mit_events = 0;
+	}
+	if (++mit->mit_events < mit->mit_enter)
+		return 0;
+
+	mit->mit_polling = 1;
+	mit->mit_lastwork = now;
+	mit->mit_nswitch++;
+	return 1;
+}
+
+/*
+ * Account a poll round which did or did not find work.  Returns
+ * nonzero if the caller should keep on polling, or zero if it
+ * should unmask the interrupt (and poll once more to close the race
+ * with an event arriving just before unmasking).
+ */
+int
+bmk_mitigate_poll(struct bmk_mitigate *mit, int didwork)
+{
+	bmk_time_t now;
+
+	mit->mit_npoll++;
+	now = bmk_platform_cpu_clock_monotonic();
+	if (didwork) {
+		mit->mit_lastwork = now;
+		return 1;
+	}
+	if (now - mit->mit_lastwork < mit->mit_idle)
+		return 1;
+
+	mit->mit_polling = 0;
+	mit->mit_winstart = now;
+	mit->mit_events = 0;
+	return 0;
+}
@@ -38,6 +38,7 @@
 #include <bmk-core/queue.h>
 #include <bmk-core/string.h>
 #include <bmk-core/sched.h>
+#include <bmk-core/trace.h>
 
 void *bmk_mainstackbase;
 unsigned long bmk_mainstacksize;
@@ -91,6 +92,7 @@ struct bmk_thread {
 
 	int bt_flags;
 	int bt_errno;
+	int bt_prio;
 
 	void *bt_stackbase;
 
@@ -128,6 +130,25 @@ static struct threadqueue timeq = TAILQ_HEAD_INITIALIZER(timeq);
 
 static void (*scheduler_hook)(void *, void *);
 
+/*
+ * Insert thread into the runq.  The runq is sorted by priority,
+ * and FIFO within a priority.  Most threads have the default priority,
+ * so start looking from the tail.  Called with interrupts disabled.
+ */
+static void
+runq_insert(struct bmk_thread *thread)
+{
+	struct bmk_thread *iter;
+
+	TAILQ_FOREACH_REVERSE(iter, &runq, threadqueue, bt_schedq) {
+		if (iter->bt_prio >= thread->bt_prio) {
+			TAILQ_INSERT_AFTER(&runq, iter, thread, bt_schedq);
+			return;
+		}
+	}
+	TAILQ_INSERT_HEAD(&runq, thread, bt_schedq);
+}
+
 static void
 print_threadinfo(struct bmk_thread *thread)
 {
@@ -185,7 +206,7 @@ set_runnable(struct bmk_thread *thread)
 	flags = bmk_platform_splhigh();
 	TAILQ_REMOVE(tq, thread, bt_schedq);
 	setflags(thread, THR_RUNQ, THR_QMASK);
-	TAILQ_INSERT_TAIL(&runq, thread, bt_schedq);
+	runq_insert(thread);
 	bmk_platform_splx(flags);
 }
 
@@ -286,6 +307,17 @@ bmk_sched_dumpqueue(void)
 	bmk_printf("END blockq dump\n");
 }
 
+/* record the names of all threads, when tracing is turned on */
+void
+bmk_sched_tracenames(void)
+{
+	struct bmk_thread *thr;
+
+	TAILQ_FOREACH(thr, &threadq, bt_threadq) {
+		bmk_trace_threadname(thr, thr->bt_name);
+	}
+}
+
 static void
 sched_switch(struct bmk_thread *prev, struct bmk_thread *next)
 {
@@ -365,6 +397,7 @@ schedule(void)
 	 *  + interrupt handler woke us up before anything else was scheduled
 	 */
 	if (prev != next) {
+		bmk_trace(BMK_TRACE_SWITCH, 0, (uintptr_t)next);
 		sched_switch(prev, next);
 	}
 
@@ -470,10 +503,12 @@ bmk_sched_create_withtls(const char *name, void *cookie, int joinable,
 	initcurrent(tlsarea, thread);
 
 	TAILQ_INSERT_TAIL(&threadq, thread, bt_threadq);
+	if (bmk_trace_enabled)
+		bmk_trace_threadname(thread, thread->bt_name);
 
 	/* set runnable manually, we don't satisfy invariants yet */
 	flags = bmk_platform_splhigh();
-	TAILQ_INSERT_TAIL(&runq, thread, bt_schedq);
+	runq_insert(thread);
 	thread->bt_flags |= THR_RUNQ;
 	bmk_platform_splx(flags);
 
@@ -629,6 +664,7 @@ bmk_sched_block(void)
 	bmk_assert((thread->bt_flags & THR_TIMEDOUT) == 0);
 	bmk_assert(thread->bt_flags & THR_BLOCKPREP);
 
+	bmk_trace(BMK_TRACE_BLOCK, 0, thread->bt_wakeup_time);
 	schedule();
 
 	tflags = thread->bt_flags;
@@ -641,10 +677,30 @@ void
 bmk_sched_wake(struct bmk_thread *thread)
 {
 
+	bmk_trace(BMK_TRACE_WAKE, 0, (uintptr_t)thread);
 	thread->bt_wakeup_time = BMK_SCHED_BLOCK_INFTIME;
 	set_runnable(thread);
 }
 
+/*
+ * Set the scheduling priority of a thread.  Runnable threads with a
+ * higher priority are run first.  There is no preemption, so priority
+ * only determines the order in which runnable threads get the CPU.
+ */
+void
+bmk_sched_setprio(struct bmk_thread *thread, int prio)
+{
+	int flags;
+
+	flags = bmk_platform_splhigh();
+	thread->bt_prio = prio;
+	if (thread->bt_flags & THR_RUNQ) {
+		TAILQ_REMOVE(&runq, thread, bt_schedq);
+		runq_insert(thread);
+	}
+	bmk_platform_splx(flags);
+}
+
 /*
  * Calculate offset of bmk_current early, so that we can use it
  * in thread creation.  Attempt to not depend on allocating the
@@ -749,7 +805,7 @@ bmk_sched_yield(void)
 	/* make schedulable and re-insert into runqueue */
 	flags = bmk_platform_splhigh();
 	setflags(thread, THR_RUNQ, THR_RUNNING);
-	TAILQ_INSERT_TAIL(&runq, thread, bt_schedq);
+	runq_insert(thread);
 	bmk_platform_splx(flags);
 
 	schedule();
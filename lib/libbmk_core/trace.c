@@ -0,0 +1,108 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Event trace ring, see bmk-core/trace.h.  Recording a tracepoint
+ * costs a clock read and a 32 byte store, so tracing can be left on
+ * in production and the ring examined after the fact.
+ */
+
+#include <bmk-core/null.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/sched.h>
+#include <bmk-core/string.h>
+#include <bmk-core/trace.h>
+
+int bmk_trace_enabled;
+
+/* not initialized statically, to keep it out of .data */
+static struct bmk_trace_ring trace_ring;
+
+void
+bmk_trace_record(void *thread, uint32_t event, uint32_t arg0, uint64_t arg1)
+{
+	struct bmk_trace_rec *tr;
+	unsigned long flags;
+
+	if (thread == NULL)
+		thread = bmk_current;
+
+	flags = bmk_platform_splhigh();
+	tr = &trace_ring.tr_recs[trace_ring.tr_head++ & (BMK_TRACE_NRECS-1)];
+	tr->tr_time = bmk_platform_cpu_clock_monotonic();
+	tr->tr_thread = (uintptr_t)thread;
+	tr->tr_event = event;
+	tr->tr_arg0 = arg0;
+	tr->tr_arg1 = arg1;
+	bmk_platform_splx(flags);
+}
+
+/* the name goes into the argument fields, truncated to 12 chars */
+void
+bmk_trace_threadname(void *thread, const char *name)
+{
+	char buf[sizeof(uint32_t) + sizeof(uint64_t)];
+	uint32_t arg0;
+	uint64_t arg1;
+
+	bmk_memset(buf, 0, sizeof(buf));
+	bmk_strncpy(buf, name, sizeof(buf));
+	bmk_memcpy(&arg0, buf, sizeof(arg0));
+	bmk_memcpy(&arg1, buf + sizeof(arg0), sizeof(arg1));
+	bmk_trace_record(thread, BMK_TRACE_THREAD, arg0, arg1);
+}
+
+void
+bmk_trace_enable(int enable)
+{
+
+	if (enable && trace_ring.tr_version == 0) {
+		/*
+		 * Assemble the magic at runtime, so that the tools
+		 * searching memory dumps for it don't find the string
+		 * constant instead.
+		 */
+		bmk_memcpy(trace_ring.tr_magic, "BMK", 3);
+		bmk_memcpy(trace_ring.tr_magic + 3, "TRACE", 5);
+		trace_ring.tr_version = BMK_TRACE_VERSION;
+		trace_ring.tr_cpu = 0;
+		trace_ring.tr_recsize = sizeof(struct bmk_trace_rec);
+		trace_ring.tr_nrecs = BMK_TRACE_NRECS;
+	}
+
+	if (enable && !bmk_trace_enabled) {
+		bmk_trace_enabled = 1;
+		bmk_sched_tracenames();
+	} else if (!enable) {
+		bmk_trace_enabled = 0;
+	}
+}
+
+struct bmk_trace_ring *
+bmk_trace_getring(void)
+{
+
+	return trace_ring.tr_version ? &trace_ring : NULL;
+}
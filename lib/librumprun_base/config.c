@@ -32,6 +32,7 @@
 #include <sys/param.h>
 #include <sys/disklabel.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 
 #include <ufs/ufs/ufsmount.h>
@@ -39,6 +40,8 @@
 
 #include <dev/vndvar.h>
 
+#include <net/if.h>
+
 #include <assert.h>
 #include <err.h>
 #include <errno.h>
@@ -56,6 +59,8 @@
 
 #include <bmk-core/jsmn.h>
 
+#include "rumprun-private.h"
+
 /* helper macros */
 #define T_SIZE(t) ((t)->end - (t)->start)
 #define T_STR(t,d) ((t)->start + d)
@@ -270,6 +275,23 @@ handle_hostname(jsmntok_t *t, int left, char *data)
 	return 1;
 }
 
+/*
+ * "trace": "/dev/ld1d"
+ *
+ * Enable event tracing and dump the trace to the given device or
+ * file at shutdown.
+ */
+static int
+handle_trace(jsmntok_t *t, int left, char *data)
+{
+
+	T_CHECKTYPE(t, data, JSMN_STRING, __func__);
+
+	rumprun_trace_config(token2cstr(t, data));
+
+	return 1;
+}
+
 static void
 config_ipv4(const char *ifname, const char *method,
 	const char *addr, const char *mask, const char *gw)
@@ -332,11 +354,29 @@ config_ipv6(const char *ifname, const char *method,
 	}
 }
 
+static void
+config_mtu(const char *ifname, const char *mtu)
+{
+	struct ifreq ifr;
+	int s;
+
+	if ((s = socket(PF_INET, SOCK_DGRAM, 0)) == -1)
+		err(1, "mtu socket");
+
+	memset(&ifr, 0, sizeof(ifr));
+	strlcpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name));
+	ifr.ifr_mtu = atoi(mtu);
+	if (ioctl(s, SIOCSIFMTU, &ifr) == -1)
+		err(1, "setting mtu %s for %s failed", mtu, ifname);
+
+	close(s);
+}
+
 static int
 handle_net(jsmntok_t *t, int left, char *data)
 {
 	const char *ifname, *cloner, *type, *method;
-	const char *addr, *mask, *gw;
+	const char *addr, *mask, *gw, *mtu;
 	jsmntok_t *key, *value;
 	int i, objsize;
 	int rv;
@@ -356,7 +396,7 @@ handle_net(jsmntok_t *t, int left, char *data)
 	}
 
 	ifname = cloner = type = method = NULL;
-	addr = mask = gw = NULL;
+	addr = mask = gw = mtu = NULL;
 
 	for (i = 0; i < objsize; i++, t+=2) {
 		const char *valuestr;
@@ -390,6 +430,8 @@ handle_net(jsmntok_t *t, int left, char *data)
 			mask = valuestr;
 		} else if (T_STREQ(key, data, "gw")) {
 			gw = valuestr;
+		} else if (T_STREQ(key, data, "mtu")) {
+			mtu = valuestr;
 		} else {
 			errx(1, "unexpected key \"%.*s\" in \"%s\"",
 			    T_PRINTFSTAR(key, data), __func__);
@@ -407,6 +449,10 @@ handle_net(jsmntok_t *t, int left, char *data)
 		}
 	}
 
+	/* before the address, so that e.g. dhcp uses the right size */
+	if (mtu)
+		config_mtu(ifname, mtu);
+
 	if (strcmp(type, "inet") == 0) {
 		config_ipv4(ifname, method, addr, mask, gw);
 	} else if (strcmp(type, "inet6") == 0) {
@@ -660,6 +706,7 @@ struct {
 	{ "hostname", handle_hostname },
 	{ "blk", handle_blk },
 	{ "net", handle_net },
+	{ "trace", handle_trace },
 };
 
 /* don't believe we can have a >64k config */
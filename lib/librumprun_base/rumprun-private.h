@@ -31,4 +31,7 @@ void _netbsd_userlevel_fini(void);
 
 void rumprun_lwp_init(void);
 
+void rumprun_trace_config(const char *);
+void rumprun_trace_dump(void);
+
 #endif /* _RUMPRUN_BASE_RUMPRUN_PRIVATE_H_ */
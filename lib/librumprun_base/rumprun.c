@@ -365,6 +365,7 @@ void __attribute__((noreturn))
 rumprun_reboot(void)
 {
 
+	rumprun_trace_dump();
 	_netbsd_userlevel_fini();
 	rump_sys_reboot(0, 0);
 
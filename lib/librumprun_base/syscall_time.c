@@ -0,0 +1,99 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Fast paths for reading the time.  The rump kernel timecounter is
+ * bmk_platform_cpu_clock_monotonic() anyway, so for the common clocks
+ * we can compute the result right here in the application instead of
+ * entering the rump kernel (the rumprun equivalent of a vDSO).
+ *
+ * The wall time is computed from the platform epoch offset, which is
+ * also where the rump kernel initializes its wall time from at boot.
+ * Therefore, the time set via settimeofday()/clock_settime() is not
+ * reflected here.
+ */
+
+#include <sys/cdefs.h>
+
+#include <sys/time.h>
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <bmk-core/platform.h>
+
+#define NSEC_PER_SEC (1000*1000*1000LL)
+
+/* the libc-level syscall, as provided by the rump kernel */
+int	_sys___clock_gettime50(clockid_t, struct timespec *);
+
+int __clock_gettime50(clockid_t, struct timespec *);
+int
+__clock_gettime50(clockid_t clock_id, struct timespec *ts)
+{
+	bmk_time_t now;
+
+	switch (clock_id) {
+	case CLOCK_REALTIME:
+		now = bmk_platform_cpu_clock_monotonic()
+		    + bmk_platform_cpu_clock_epochoffset();
+		break;
+	case CLOCK_MONOTONIC:
+		now = bmk_platform_cpu_clock_monotonic();
+		break;
+	default:
+		return _sys___clock_gettime50(clock_id, ts);
+	}
+
+	if (ts == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	ts->tv_sec = now / NSEC_PER_SEC;
+	ts->tv_nsec = now % NSEC_PER_SEC;
+
+	return 0;
+}
+
+int __gettimeofday50(struct timeval *, void *);
+int
+__gettimeofday50(struct timeval *tv, void *tzp)
+{
+	bmk_time_t now;
+
+	if (tv) {
+		now = bmk_platform_cpu_clock_monotonic()
+		    + bmk_platform_cpu_clock_epochoffset();
+		tv->tv_sec = now / NSEC_PER_SEC;
+		tv->tv_usec = (now % NSEC_PER_SEC) / 1000;
+	}
+
+	/* like the kernel, we always use UTC */
+	if (tzp)
+		memset(tzp, 0, sizeof(struct timezone));
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Event trace support: turn tracing on from the config, and write
+ * the trace ring to a block device or file when the guest shuts
+ * down.  Use app-tools/rumptrace to convert it.
+ */
+
+#include <sys/param.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <bmk-core/trace.h>
+
+#include "rumprun-private.h"
+
+static char *tracedump;
+
+void
+rumprun_trace_config(const char *path)
+{
+
+	if ((tracedump = strdup(path)) == NULL)
+		err(1, "trace path");
+	bmk_trace_enable(1);
+}
+
+void
+rumprun_trace_dump(void)
+{
+	struct bmk_trace_ring *ring;
+	size_t len;
+	char *buf;
+	int fd;
+
+	if (tracedump == NULL || (ring = bmk_trace_getring()) == NULL)
+		return;
+	bmk_trace_enable(0);
+
+	/* whole sectors, so that raw devices work too */
+	len = roundup(sizeof(*ring), DEV_BSIZE);
+	if ((buf = calloc(1, len)) == NULL) {
+		warn("trace dump");
+		return;
+	}
+	memcpy(buf, ring, sizeof(*ring));
+
+	if ((fd = open(tracedump, O_WRONLY | O_CREAT, 0644)) == -1) {
+		warn("open trace dump %s", tracedump);
+	} else {
+		if (write(fd, buf, len) != (ssize_t)len)
+			warn("write trace dump %s", tracedump);
+		else
+			printf("rumprun: wrote trace to %s\n", tracedump);
+		close(fd);
+	}
+	free(buf);
+}
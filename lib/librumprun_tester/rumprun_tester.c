@@ -52,6 +52,18 @@ static const char *trydisk[] = {
 };
 static int logfd;
 static int logrv = 1;
+static int consfd = STDOUT_FILENO;
+
+/*
+ * stdout goes to the result disk when run via the test framework.
+ * Tests which produce bulk output write it here instead.
+ */
+int
+rumprun_test_consfd(void)
+{
+
+	return consfd;
+}
 
 static void
 logexit(void)
@@ -92,6 +104,8 @@ main(int argc, char *argv[])
 		err(1, "rumprun_test: initial write failed\n");
 	}
 
+	if ((consfd = dup(STDOUT_FILENO)) == -1)
+		err(1, "rumprun_test: dup stdout");
 	if (dup2(logfd, STDOUT_FILENO) == -1)
 		err(1, "rumprun_test: dup2 to stdout");
 	if (dup2(logfd, STDERR_FILENO) == -1)
@@ -30,6 +30,7 @@
 
 __BEGIN_DECLS
 int rumprun_test(int, char **);
+int rumprun_test_consfd(void);
 __END_DECLS
 
 #endif /* _BMK_BASE_RUMPRUN_TEST_H_ */
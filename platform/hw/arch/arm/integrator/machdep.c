@@ -139,7 +139,12 @@ arm_interrupt(unsigned long *trapregs)
 
 	if (intstat) {
 		outl(INTR_CLEAR, intstat);
-		isr(intstat);
+		while (intstat) {
+			int i = __builtin_ctz(intstat);
+
+			intstat &= ~(1U<<i);
+			isr(i);
+		}
 	}
 
 	spl0();
@@ -189,7 +194,7 @@ bmk_platform_cpu_block(bmk_time_t until)
 }
 
 int
-cpu_intr_init(int intr)
+cpu_intr_init(int intr, int flags)
 {
 
 	intmask |= 1<<intr;
@@ -198,8 +203,21 @@ cpu_intr_init(int intr)
 }
 
 void
-cpu_intr_ack(unsigned mask)
+cpu_intr_ack(int intr)
+{
+
+	outl(INTR_ENABLE, 1<<intr);
+}
+
+/* arm_interrupt() disables each line until it is acked */
+int
+cpu_intr_canmask(int intr)
 {
 
-	outl(INTR_ENABLE, mask);
+	return 1;
+}
+
+void
+cpu_intr_mask(int intr)
+{
 }
@@ -58,3 +58,10 @@ cons_puts(const char *s)
 	while ((c = *s++) != 0)
 		cons_putc(c);
 }
+
+void
+cons_flush(void)
+{
+
+	/* output is synchronous */
+}
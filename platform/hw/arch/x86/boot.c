@@ -27,6 +27,8 @@
 #include <hw/kernel.h>
 #include <hw/multiboot.h>
 
+#include <arch/x86/cons.h>
+
 #include <bmk-core/core.h>
 #include <bmk-core/mainthread.h>
 #include <bmk-core/sched.h>
@@ -42,6 +44,7 @@ x86_boot(struct multiboot_info *mbi)
 	cpu_init();
 	bmk_sched_init();
 	multiboot(mbi);
+	cons_intr_init();
 
 	spl0();
 
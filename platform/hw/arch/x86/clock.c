@@ -61,17 +61,31 @@ static bmk_time_t rtc_epochoffset;
 /* True if using pvclock for timekeeping, false if using TSC-based clock. */
 static int have_pvclock;
 
+/* True if using the LAPIC TSC-deadline timer for wakeups, false if PIT. */
+static int have_tscdeadline;
+
 /*
  * TSC clock specific.
  */
 
-/* Base time values at the last call to tscclock_monotonic(). */
+/* Base time values, monotonic time and TSC, set at initialization. */
 static bmk_time_t time_base;
 static uint64_t tsc_base;
 
 /* Multiplier for converting TSC ticks to nsecs. (0.32) fixed point. */
 static uint32_t tsc_mult;
 
+/* TSC frequency in Hz, obtained from CPUID or by calibration. */
+static uint64_t tsc_freq;
+
+/*
+ * Multiplier for converting nsecs to TSC ticks, split into an integer
+ * part and a (0.32) fixed point fractional part, since TSC frequencies
+ * above 4.29GHz do not fit into (32.32).
+ */
+static uint64_t tsc_ns_int;
+static uint32_t tsc_ns_frac;
+
 /*
  * pvclock specific.
  */
@@ -228,22 +242,81 @@ rtc_gettimeofday(void)
 }
 
 /*
- * Return monotonic time using TSC clock.
+ * Return monotonic time using TSC clock.  The base values are only
+ * read here, so this is safe to call from interrupt context, e.g.
+ * to timestamp interrupts, while a thread is in here too.
  */
 static bmk_time_t
 tscclock_monotonic(void)
 {
-	uint64_t tsc_now, tsc_delta;
+
+	return time_base + mul64_32(rdtsc() - tsc_base, tsc_mult);
+}
+
+/*
+ * Return the TSC frequency in Hz as advertised by the hypervisor or
+ * the processor, or 0 if it is not available and the TSC must be
+ * calibrated.
+ *
+ * Sources: Intel SDM Vol. 2A, CPUID leaves 15H and 16H;
+ * VMware/KVM generic timing leaf 0x40000010;
+ * Hyper-V TLFS, HV_X64_MSR_TSC_FREQUENCY.
+ */
+static uint64_t
+tsc_freq_cpuid(const char **src)
+{
+	uint32_t eax, ebx, ecx, edx, maxleaf;
+	int hv;
+
+	hv = hypervisor_detect();
+	if (hv == HYPERVISOR_KVM || hv == HYPERVISOR_VMWARE) {
+		x86_cpuid(0x40000000, &maxleaf, &ebx, &ecx, &edx);
+		if (maxleaf >= 0x40000010) {
+			/* EAX is the TSC frequency in kHz */
+			x86_cpuid(0x40000010, &eax, &ebx, &ecx, &edx);
+			if (eax != 0) {
+				*src = "hypervisor timing leaf";
+				return (uint64_t)eax * 1000;
+			}
+		}
+	} else if (hv == HYPERVISOR_HYPERV) {
+		x86_cpuid(0x40000000, &maxleaf, &ebx, &ecx, &edx);
+		if (maxleaf >= 0x40000003) {
+			/* AccessFrequencyMsrs privilege */
+			x86_cpuid(0x40000003, &eax, &ebx, &ecx, &edx);
+			if (eax & (1 << 11)) {
+				*src = "Hyper-V frequency MSR";
+				return rdmsr(0x40000022);
+			}
+		}
+	}
+
+	x86_cpuid(0x0, &maxleaf, &ebx, &ecx, &edx);
 
 	/*
-	 * Update time_base (monotonic time) and tsc_base (TSC time).
+	 * Leaf 0x15: TSC/core crystal clock ratio is EBX/EAX, ECX is
+	 * the crystal frequency in Hz.  If the crystal frequency is not
+	 * enumerated, derive it from the processor base frequency in
+	 * leaf 0x16 (EAX, in MHz) the same way Linux does.
 	 */
-	tsc_now = rdtsc();
-	tsc_delta = tsc_now - tsc_base;
-	time_base += mul64_32(tsc_delta, tsc_mult);
-	tsc_base = tsc_now;
+	if (maxleaf >= 0x15) {
+		uint32_t denom, numer, crystal;
+
+		x86_cpuid(0x15, &denom, &numer, &crystal, &edx);
+		if (denom != 0 && numer != 0) {
+			if (crystal == 0 && maxleaf >= 0x16) {
+				x86_cpuid(0x16, &eax, &ebx, &ecx, &edx);
+				crystal = (uint64_t)(eax & 0xffff)
+				    * 1000000 * denom / numer;
+			}
+			if (crystal != 0) {
+				*src = "CPUID leaf 0x15";
+				return (uint64_t)crystal * numer / denom;
+			}
+		}
+	}
 
-	return time_base;
+	return 0;
 }
 
 /*
@@ -252,7 +325,8 @@ tscclock_monotonic(void)
 static int
 tscclock_init(void)
 {
-	uint64_t tsc_freq;
+	const char *src;
+	uint64_t tsc_start, took;
 
 	/* Initialise i8254 timer channel 0 to mode 2 at 100 Hz */
 	outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
@@ -267,16 +341,24 @@ tscclock_init(void)
 	rtc_epochoffset = rtc_gettimeofday();
 
 	/*
-	 * Calculate TSC frequency by calibrating against an 0.1s delay
-	 * using the i8254 timer.
+	 * Get the TSC frequency from CPUID if possible.  Otherwise,
+	 * calculate it by calibrating against an 0.01s delay using the
+	 * i8254 timer.  The i8254 resolution is ~838ns, so the
+	 * resulting estimate is good to ~0.01%.  How long it took is
+	 * printed, since it adds directly to the boot time.
 	 */
-	spl0();
-	tsc_base = rdtsc();
-	i8254_delay(100000);
-	tsc_freq = (rdtsc() - tsc_base) * 10;
-	splhigh();
-	bmk_printf("x86_initclocks(): TSC frequency estimate is %llu Hz\n",
-		(unsigned long long)tsc_freq);
+	tsc_start = tsc_base = rdtsc();
+	if ((tsc_freq = tsc_freq_cpuid(&src)) == 0) {
+		src = "i8254 calibration";
+		spl0();
+		tsc_base = rdtsc();
+		i8254_delay(10000);
+		tsc_freq = (rdtsc() - tsc_base) * 100;
+		splhigh();
+	}
+	took = (rdtsc() - tsc_start) * 1000000 / tsc_freq;
+	bmk_printf("x86_initclocks(): TSC frequency is %llu Hz (%s, %llu us)\n",
+		(unsigned long long)tsc_freq, src, (unsigned long long)took);
 
 	/*
 	 * Calculate TSC scaling multiplier.
@@ -389,6 +471,18 @@ pvclock_init(void)
 	/* Initialise epoch offset using wall clock time */
 	rtc_epochoffset = pvclock_read_wall_clock();
 
+	/*
+	 * Derive the TSC frequency from the scaling parameters, since
+	 * nsecs = ((tsc << tsc_shift) * tsc_to_system_mul) >> 32.
+	 */
+	if (pvclock_ti.tsc_to_system_mul != 0) {
+		tsc_freq = (NSEC_PER_SEC << 32) / pvclock_ti.tsc_to_system_mul;
+		if (pvclock_ti.tsc_shift < 0)
+			tsc_freq <<= -pvclock_ti.tsc_shift;
+		else
+			tsc_freq >>= pvclock_ti.tsc_shift;
+	}
+
 	return 0;
 }
 
@@ -426,6 +520,22 @@ x86_initclocks(void)
 	bmk_printf("x86_initclocks(): Using %s for timekeeping\n",
 		have_pvclock ? "PV clock" : "TSC");
 
+	/*
+	 * Prefer the LAPIC TSC-deadline timer for wakeups, since arming
+	 * it is a single MSR write instead of three i8254 port writes
+	 * (each of which is a VM exit when virtualized), and since it
+	 * does not have a minimum delay.
+	 */
+	if (tsc_freq != 0 && x86_lapic_tscdeadline_init() == 0) {
+		tsc_ns_int = tsc_freq / NSEC_PER_SEC;
+		tsc_ns_frac = ((tsc_freq % NSEC_PER_SEC) << 32) / NSEC_PER_SEC;
+		have_tscdeadline = 1;
+	}
+	bmk_printf("x86_initclocks(): Using %s for wakeups\n",
+		have_tscdeadline ? "LAPIC TSC-deadline timer" : "i8254");
+	if (have_tscdeadline)
+		return;
+
 	/*
 	 * Initialise i8254 timer channel 0 to mode 4 (one shot).
 	 */
@@ -461,6 +571,43 @@ bmk_platform_cpu_clock_epochoffset(void)
 	return rtc_epochoffset;
 }
 
+/*
+ * Arm the i8254 to interrupt the CPU after delta_ns.  Returns non-zero
+ * if the delta is too short to be worth programming the timer for.
+ */
+static int
+i8254_arm(bmk_time_t delta_ns)
+{
+	uint64_t delta_ticks;
+	unsigned int ticks;
+
+	/*
+	 * Compute delta in PIT ticks. Return if it is less than minimum safe
+	 * amount of ticks.
+	 */
+	delta_ticks = mul64_32(delta_ns, pit_mult);
+	if (delta_ticks < PIT_MIN_DELTA)
+		return 1;
+
+	/*
+	 * Program the timer to interrupt the CPU after the delay has expired.
+	 * Maximum timer delay is 65535 ticks.
+	 */
+	if (delta_ticks > 65535)
+		ticks = 65535;
+	else
+		ticks = delta_ticks;
+
+	/*
+	 * Note that according to the Intel 82C54 datasheet, p12 the
+	 * interrupt is actually delivered in N + 1 ticks.
+	 */
+	outb(TIMER_CNTR, (ticks - 1) & 0xff);
+	outb(TIMER_CNTR, (ticks - 1) >> 8);
+
+	return 0;
+}
+
 /*
  * Block the CPU until monotonic time is *no later than* the specified time.
  * Returns early if any interrupts are serviced, or if the requested delay is
@@ -470,8 +617,6 @@ void
 bmk_platform_cpu_block(bmk_time_t until)
 {
 	bmk_time_t now, delta_ns;
-	uint64_t delta_ticks;
-	unsigned int ticks;
 	int s;
 
 	bmk_assert(spldepth > 0);
@@ -483,19 +628,24 @@ bmk_platform_cpu_block(bmk_time_t until)
 	now = bmk_platform_cpu_clock_monotonic();
 	if (until <= now)
 		return;
-
-	/*
-	 * Compute delta in PIT ticks. Return if it is less than minimum safe
-	 * amount of ticks.  Essentially this will cause us to spin until
-	 * the timeout.
-	 */
 	delta_ns = until - now;
-	delta_ticks = mul64_32(delta_ns, pit_mult);
-	if (delta_ticks < PIT_MIN_DELTA) {
+
+	if (have_tscdeadline) {
+		/*
+		 * A deadline which has already passed by the time it is
+		 * written fires immediately, so no minimum delta here.
+		 * A deadline left armed after an early wakeup by some other
+		 * interrupt is harmless: we just go through the scheduler
+		 * once more.
+		 */
+		x86_lapic_tscdeadline(rdtsc() + delta_ns * tsc_ns_int
+		    + mul64_32(delta_ns, tsc_ns_frac));
+	} else if (i8254_arm(delta_ns) != 0) {
 		/*
-		 * Since we are "spinning", quickly enable interrupts in
-		 * the hopes that we might get new work and can do something
-		 * else than spin.
+		 * Too short a delay to program the PIT.  Essentially this
+		 * will cause us to spin until the timeout.  Since we are
+		 * "spinning", quickly enable interrupts in the hopes that
+		 * we might get new work and can do something else than spin.
 		 */
 		__asm__ __volatile__(
 			"sti;\n"
@@ -504,29 +654,13 @@ bmk_platform_cpu_block(bmk_time_t until)
 		return;
 	}
 
-	/*
-	 * Program the timer to interrupt the CPU after the delay has expired.
-	 * Maximum timer delay is 65535 ticks.
-	 */
-	if (delta_ticks > 65535)
-		ticks = 65535;
-	else
-		ticks = delta_ticks;
-
-	/*
-	 * Note that according to the Intel 82C54 datasheet, p12 the
-	 * interrupt is actually delivered in N + 1 ticks.
-	 */
-	outb(TIMER_CNTR, (ticks - 1) & 0xff);
-	outb(TIMER_CNTR, (ticks - 1) >> 8);
-
 	/*
 	 * Wait for any interrupt. If we got an interrupt then
 	 * just return into the scheduler which will check if there is
 	 * work to do and send us back here if not.
 	 *
 	 * TODO: It would be more efficient for longer sleeps to be
-	 * able to distinguish if the interrupt was the PIT interrupt
+	 * able to distinguish if the interrupt was the timer interrupt
 	 * and no other, but this will do for now.
 	 */
 	s = spldepth;
@@ -32,6 +32,7 @@
 #include <bmk-core/printf.h>
 
 static void (*vcons_putc)(int) = vgacons_putc;
+static void (*vcons_flush)(void);
 
 /*
  * Filled in by locore from BIOS data area.
@@ -63,8 +64,32 @@ cons_init(void)
 		cons_puts("Using serial console.");
 		serialcons_init(bios_com1_base, 115200);
 		vcons_putc = serialcons_putc;
+		vcons_flush = serialcons_flush;
 	}
-	bmk_printf_init(vcons_putc, NULL);
+	bmk_printf_init(vcons_putc, vcons_flush);
+}
+
+/*
+ * Called after interrupts are available.
+ */
+void
+cons_intr_init(void)
+{
+
+	if (vcons_putc == serialcons_putc)
+		serialcons_intr_init();
+}
+
+/*
+ * Make sure all output has been written, and write further
+ * output synchronously.
+ */
+void
+cons_flush(void)
+{
+
+	if (vcons_putc == serialcons_putc)
+		serialcons_sync();
 }
 
 void
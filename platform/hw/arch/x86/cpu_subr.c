@@ -26,32 +26,74 @@
 #include <hw/kernel.h>
 #include <arch/x86/var.h>
 
-void x86_isr_9(void);
-void x86_isr_10(void);
-void x86_isr_11(void);
-void x86_isr_14(void);
-void x86_isr_15(void);
+#include <bmk-core/printf.h>
+
+/*
+ * Interrupt numbers are IDT vector - 32.  Numbers below MSI_FIRST are
+ * ISA IRQs (as reported in PCI config space).  They are delivered
+ * either via the PIC or, if we found one, via the IOAPIC.  The rest are
+ * allocated on demand for MSI.
+ */
+#define MSI_FIRST 48
+#define MSI_LAST 63
+
+/* isr stubs, indexed by interrupt number (in locore) */
+extern void *x86_isr_stubs[];
 
 uint8_t pic1mask, pic2mask;
 
+static int use_ioapic;
+static uint8_t intr_level[MSI_FIRST];
+
+/* MSI-X table entry vector control words, for masking at the source */
+static volatile uint32_t *msix_ctl[MSI_LAST+1 - MSI_FIRST];
+static uint32_t msix_masked;
+#define MSIX_CTL_MASK 0x1
+
+static void
+intr_setup(void)
+{
+	static int inited;
+
+	if (inited)
+		return;
+	inited = 1;
+
+	if (x86_ioapic_init() == 0)
+		use_ioapic = 1;
+	bmk_printf("x86 interrupts routed via %s\n",
+	    use_ioapic ? "IOAPIC" : "PIC");
+}
+
 int
-cpu_intr_init(int intr)
+cpu_intr_init(int intr, int flags)
 {
+	int error;
 
-	if (intr > 15)
+	if (intr < 0 || intr > MSI_LAST)
 		return BMK_EGENERIC;
+	intr_setup();
 
-#define FILLGATE(n) case n: x86_fillgate(32+n, x86_isr_##n, 0); break
-	switch (intr) {
-		FILLGATE(9);
-		FILLGATE(10);
-		FILLGATE(11);
-		FILLGATE(14);
-		FILLGATE(15);
-	default:
-		return BMK_EGENERIC;
+	/* MSI doesn't go through the PIC or IOAPIC */
+	if (intr >= MSI_FIRST) {
+		x86_fillgate(32+intr, x86_isr_stubs[intr], 0);
+		return 0;
 	}
-#undef FILLGATE
+
+	if (use_ioapic) {
+		error = x86_ioapic_route(intr, flags & BMK_INTR_ROUTED,
+		    32+intr, &intr_level[intr]);
+		if (error)
+			return error;
+		x86_fillgate(32+intr, x86_isr_stubs[intr], 0);
+		x86_ioapic_unmask(intr);
+		return 0;
+	}
+
+	/* timer and cascade */
+	if (intr > 15 || intr == 0 || intr == 2)
+		return BMK_EGENERIC;
+	x86_fillgate(32+intr, x86_isr_stubs[intr], 0);
 
 	/* unmask interrupt in PIC */
 	if (intr < 8) {
@@ -65,16 +107,122 @@ cpu_intr_init(int intr)
 	return 0;
 }
 
+/*
+ * Called from the isr stubs.  Interrupts coming via the local APIC are
+ * EOI'd immediately so that they don't block other vectors while the
+ * handlers run in thread context.  Level-triggered IOAPIC lines are
+ * masked until serviced, see cpu_intr_ack().  With the PIC, the EOI
+ * is deferred to cpu_intr_ack(), which keeps the line blocked.
+ */
+void
+x86_intr(int intr)
+{
+
+	if (intr >= MSI_FIRST) {
+		x86_lapic_eoi();
+	} else if (use_ioapic) {
+		if (intr_level[intr])
+			x86_ioapic_mask(intr);
+		x86_lapic_eoi();
+	}
+	isr(intr);
+}
+
 void
-cpu_intr_ack(unsigned int intrs)
+cpu_intr_ack(int intr)
 {
+	int n;
+
+	if (intr >= MSI_FIRST) {
+		n = intr - MSI_FIRST;
+		if (msix_masked & (1U<<n)) {
+			msix_masked &= ~(1U<<n);
+			*msix_ctl[n] &= ~MSIX_CTL_MASK;
+		}
+		return;
+	}
+
+	if (use_ioapic) {
+		if (intr_level[intr])
+			x86_ioapic_unmask(intr);
+		return;
+	}
 
 	/*
-	 * ACK interrupts on PIC
+	 * ACK interrupt on PIC (specific EOI)
 	 */
-	__asm__ __volatile(
-	    "movb $0x20, %%al\n"
-	    "outb %%al, $0xa0\n"
-	    "outb %%al, $0x20\n"
-	    ::: "al");
+	if (intr >= 8) {
+		outb(PIC2_CMD, OCW2_SEOI | (intr-8));
+		outb(PIC1_CMD, OCW2_SEOI | 2);
+	} else {
+		outb(PIC1_CMD, OCW2_SEOI | intr);
+	}
+}
+
+/*
+ * Can the interrupt be masked at the source until cpu_intr_ack(),
+ * without blocking any other interrupt?  Level-triggered IOAPIC
+ * lines already are, see x86_intr(), and MSI-X vectors have a mask
+ * bit.  With the PIC, a line without its EOI blocks all lines of
+ * lower priority, and edge-triggered lines and plain MSI cannot be
+ * masked at all.
+ */
+int
+cpu_intr_canmask(int intr)
+{
+
+	if (intr >= MSI_FIRST)
+		return msix_ctl[intr - MSI_FIRST] != NULL;
+	return use_ioapic && intr_level[intr];
+}
+
+/*
+ * Mask an interrupt for which cpu_intr_canmask() is true until
+ * cpu_intr_ack().  A masked MSI-X vector is delivered when unmasked
+ * if the device signalled it meanwhile.
+ */
+void
+cpu_intr_mask(int intr)
+{
+	int n;
+
+	if (intr < MSI_FIRST)
+		return;
+	n = intr - MSI_FIRST;
+	if (msix_ctl[n] && (msix_masked & (1U<<n)) == 0) {
+		msix_masked |= 1U<<n;
+		*msix_ctl[n] |= MSIX_CTL_MASK;
+	}
+}
+
+/*
+ * Tell where the vector control word of an MSI-X interrupt is.
+ */
+void
+x86_msix_setctl(int intr, volatile uint32_t *ctl)
+{
+
+	msix_ctl[intr - MSI_FIRST] = ctl;
+}
+
+/*
+ * Allocate an interrupt for MSI and return the address/data pair
+ * the device should write to trigger it.  MSI interrupt numbers map
+ * to one IDT vector each, so the interrupt is never shared and never
+ * routed.
+ */
+int
+x86_msi_intr(int *intrp, uint64_t *addrp, uint32_t *datap)
+{
+	static int nextintr = MSI_FIRST;
+
+	if (x86_lapic_init() != 0)
+		return BMK_ENXIO;
+	if (nextintr > MSI_LAST)
+		return BMK_EBUSY;
+
+	x86_lapic_msi(32+nextintr, addrp, datap);
+	*intrp = nextintr++;
+
+	return 0;
 }
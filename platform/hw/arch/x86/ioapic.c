@@ -0,0 +1,531 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * IOAPIC routing for ISA IRQs.  We find the IOAPICs and the ISA IRQ
+ * to global system interrupt (GSI) overrides from the ACPI MADT, or
+ * if there is no ACPI, from the MP configuration table.
+ *
+ * We don't interpret AML, so PCI interrupt routing (_PRT) is not
+ * available to us.  Instead, we route the IRQ the BIOS programmed into
+ * the PCI interrupt line register to the IOAPIC input of the same
+ * ISA IRQ.  This works since the chipset PCI IRQ router drives both
+ * the PIC and the IOAPIC input for the IRQ.  Trigger mode and polarity
+ * default to what the bus uses, edge/high for ISA and level/low for
+ * PCI, unless an override says something other than "conforms".
+ *
+ * TODO: route PCI interrupts properly.  With the interrupt line
+ * register, PCI devices still share the few ISA IRQs the BIOS hands
+ * out (e.g. 10 and 11 on QEMU), even where the chipset has dedicated
+ * IOAPIC inputs for them (GSI 16-23 on q35).  Without AML, the MP
+ * table's PCI interrupt entries would give the routing on machines
+ * which have them; otherwise it takes a _PRT parser.  runtests.sh
+ * boots on q35 to check that the current scheme at least works there.
+ *
+ * The IOAPIC MMIO windows are at the top of the 4GB space, which
+ * amd64 maps 1:1.
+ */
+
+#include <hw/types.h>
+#include <hw/kernel.h>
+
+#include <bmk-core/printf.h>
+#include <bmk-core/string.h>
+
+#define IOAPIC_MAX 8
+static struct ioapic {
+	volatile uint32_t *ioa_mmio;
+	unsigned ioa_gsibase;
+	unsigned ioa_npins;
+} ioapics[IOAPIC_MAX];
+static int nioapic;
+
+/* ISA IRQ overrides */
+#define ISA_NIRQ 16
+static struct {
+	int ovr_valid;
+	unsigned ovr_gsi;
+	unsigned ovr_flags;
+} isaovr[ISA_NIRQ];
+
+/* MPS INTI flags, also used by the MADT */
+#define INTI_POLARITY		0x3
+#define INTI_POLARITY_HIGH	0x1
+#define INTI_POLARITY_LOW	0x3
+#define INTI_TRIGGER		0xc
+#define INTI_TRIGGER_EDGE	0x4
+#define INTI_TRIGGER_LEVEL	0xc
+
+/* routed interrupts, indexed by interrupt number */
+#define NINTR 48
+static struct {
+	struct ioapic *ri_ioa;
+	unsigned ri_pin;
+	uint32_t ri_redlo;
+} routes[NINTR];
+
+static uint32_t
+ioapic_read(struct ioapic *ioa, unsigned reg)
+{
+
+	ioa->ioa_mmio[IOAPIC_REGSEL/4] = reg;
+	return ioa->ioa_mmio[IOAPIC_WIN/4];
+}
+
+static void
+ioapic_write(struct ioapic *ioa, unsigned reg, uint32_t value)
+{
+
+	ioa->ioa_mmio[IOAPIC_REGSEL/4] = reg;
+	ioa->ioa_mmio[IOAPIC_WIN/4] = value;
+}
+
+static int
+cksum(const void *p, unsigned long len)
+{
+	const uint8_t *b = p;
+	uint8_t sum = 0;
+
+	while (len--)
+		sum += *b++;
+	return sum;
+}
+
+static void
+addioapic(unsigned long addr, unsigned gsibase)
+{
+	struct ioapic *ioa;
+	unsigned pin;
+
+	if (nioapic == IOAPIC_MAX || addr >= 0x100000000ULL)
+		return;
+
+	ioa = &ioapics[nioapic++];
+	ioa->ioa_mmio = (void *)addr;
+	ioa->ioa_gsibase = gsibase;
+	ioa->ioa_npins
+	    = IOAPIC_VER_MAXREDIR(ioapic_read(ioa, IOAPIC_VER)) + 1;
+
+	/* start out with everything masked */
+	for (pin = 0; pin < ioa->ioa_npins; pin++) {
+		ioapic_write(ioa, IOAPIC_REDLO(pin), IOAPIC_RED_MASKED);
+	}
+
+	bmk_printf("ioapic%d at 0x%lx: GSIs %u-%u\n", nioapic-1,
+	    addr, gsibase, gsibase + ioa->ioa_npins-1);
+}
+
+static void
+addoverride(unsigned irq, unsigned gsi, unsigned flags)
+{
+
+	if (irq >= ISA_NIRQ)
+		return;
+	isaovr[irq].ovr_valid = 1;
+	isaovr[irq].ovr_gsi = gsi;
+	isaovr[irq].ovr_flags = flags;
+}
+
+/*
+ * ACPI
+ */
+
+struct acpi_sdthdr {
+	char sdt_sig[4];
+	uint32_t sdt_len;
+	uint8_t sdt_rev;
+	uint8_t sdt_cksum;
+	char sdt_oem[6];
+	char sdt_oemtable[8];
+	uint32_t sdt_oemrev;
+	uint32_t sdt_creator;
+	uint32_t sdt_creatorrev;
+} __attribute__((__packed__));
+
+struct acpi_rsdp {
+	char rsdp_sig[8];
+	uint8_t rsdp_cksum;
+	char rsdp_oem[6];
+	uint8_t rsdp_rev;
+	uint32_t rsdp_rsdt;
+	/* rev >= 2 */
+	uint32_t rsdp_len;
+	uint64_t rsdp_xsdt;
+	uint8_t rsdp_xcksum;
+	uint8_t rsdp_rsvd[3];
+} __attribute__((__packed__));
+
+#define MADT_IOAPIC	1
+#define MADT_OVERRIDE	2
+
+struct madt_ioapic {
+	uint8_t type, len;
+	uint8_t id, rsvd;
+	uint32_t addr;
+	uint32_t gsibase;
+} __attribute__((__packed__));
+
+struct madt_override {
+	uint8_t type, len;
+	uint8_t bus, irq;
+	uint32_t gsi;
+	uint16_t flags;
+} __attribute__((__packed__));
+
+/* search for a signature on 16 byte boundaries */
+static void *
+scanmem(unsigned long start, unsigned long len, const char *sig, int siglen)
+{
+	unsigned long addr;
+
+	for (addr = start; addr < start + len; addr += 16) {
+		if (bmk_strncmp((void *)addr, sig, siglen) == 0)
+			return (void *)addr;
+	}
+	return NULL;
+}
+
+/* EBDA segment is stored in the BIOS data area */
+static unsigned long
+ebda(void)
+{
+
+	return (unsigned long)*(volatile uint16_t *)0x40e << 4;
+}
+
+static struct acpi_sdthdr *
+acpi_findsdt(const char *sig)
+{
+	struct acpi_rsdp *rsdp;
+	struct acpi_sdthdr *sdt, *ent;
+	unsigned long addr;
+	int i, n, esize;
+
+	if ((rsdp = scanmem(ebda(), 1024, "RSD PTR ", 8)) == NULL
+	    && (rsdp = scanmem(0xe0000, 0x20000, "RSD PTR ", 8)) == NULL)
+		return NULL;
+	if (cksum(rsdp, 20) != 0)
+		return NULL;
+
+	if (rsdp->rsdp_rev >= 2 && rsdp->rsdp_xsdt != 0
+	    && rsdp->rsdp_xsdt < 0x100000000ULL
+	    && cksum(rsdp, rsdp->rsdp_len) == 0) {
+		sdt = (void *)(unsigned long)rsdp->rsdp_xsdt;
+		esize = 8;
+	} else {
+		sdt = (void *)(unsigned long)rsdp->rsdp_rsdt;
+		esize = 4;
+	}
+	if (cksum(sdt, sdt->sdt_len) != 0)
+		return NULL;
+
+	n = (sdt->sdt_len - sizeof(*sdt)) / esize;
+	for (i = 0; i < n; i++) {
+		uint8_t *p = (uint8_t *)(sdt+1) + i*esize;
+
+		if (esize == 8) {
+			uint64_t a64 = *(uint32_t *)p
+			    | (uint64_t)*(uint32_t *)(p+4) << 32;
+			if (a64 >= 0x100000000ULL)
+				continue;
+			addr = a64;
+		} else {
+			addr = *(uint32_t *)p;
+		}
+		ent = (void *)addr;
+		if (bmk_strncmp(ent->sdt_sig, sig, 4) == 0
+		    && cksum(ent, ent->sdt_len) == 0)
+			return ent;
+	}
+
+	return NULL;
+}
+
+static int
+acpi_parsemadt(void)
+{
+	struct acpi_sdthdr *madt;
+	struct madt_ioapic *mio;
+	struct madt_override *mo;
+	uint8_t *p, *end;
+
+	if ((madt = acpi_findsdt("APIC")) == NULL)
+		return 1;
+
+	/* skip local APIC address and flags */
+	p = (uint8_t *)(madt+1) + 8;
+	end = (uint8_t *)madt + madt->sdt_len;
+	for (; p + 2 <= end && p[1] >= 2; p += p[1]) {
+		switch (p[0]) {
+		case MADT_IOAPIC:
+			mio = (void *)p;
+			addioapic(mio->addr, mio->gsibase);
+			break;
+		case MADT_OVERRIDE:
+			mo = (void *)p;
+			if (mo->bus == 0)
+				addoverride(mo->irq, mo->gsi, mo->flags);
+			break;
+		}
+	}
+
+	return nioapic == 0;
+}
+
+/*
+ * MP configuration table, for old machines without ACPI
+ */
+
+struct mp_fps {
+	char fps_sig[4];
+	uint32_t fps_conftbl;
+	uint8_t fps_len;
+	uint8_t fps_rev;
+	uint8_t fps_cksum;
+	uint8_t fps_feature[5];
+} __attribute__((__packed__));
+
+struct mp_conftbl {
+	char ct_sig[4];
+	uint16_t ct_len;
+	uint8_t ct_rev;
+	uint8_t ct_cksum;
+	char ct_oem[8];
+	char ct_product[12];
+	uint32_t ct_oemtbl;
+	uint16_t ct_oemtblsize;
+	uint16_t ct_nentries;
+	uint32_t ct_lapic;
+	uint16_t ct_extlen;
+	uint8_t ct_extcksum;
+	uint8_t ct_rsvd;
+} __attribute__((__packed__));
+
+#define MPE_CPU		0
+#define MPE_BUS		1
+#define MPE_IOAPIC	2
+#define MPE_IOINT	3
+#define MPE_LOCALINT	4
+
+struct mpe_bus {
+	uint8_t type;
+	uint8_t id;
+	char name[6];
+} __attribute__((__packed__));
+
+struct mpe_ioapic {
+	uint8_t type;
+	uint8_t id;
+	uint8_t ver;
+	uint8_t flags;
+	uint32_t addr;
+} __attribute__((__packed__));
+
+struct mpe_ioint {
+	uint8_t type;
+	uint8_t inttype;
+	uint16_t flags;
+	uint8_t srcbus;
+	uint8_t srcirq;
+	uint8_t dstioapic;
+	uint8_t dstpin;
+} __attribute__((__packed__));
+
+#define MPE_IOAPIC_EN	0x1
+#define MPE_IOINT_INT	0
+
+static int
+mp_parse(void)
+{
+	struct mp_fps *fps;
+	struct mp_conftbl *ct;
+	struct mpe_bus *mb;
+	struct mpe_ioapic *mio;
+	struct mpe_ioint *mi;
+	uint8_t ioapicid[IOAPIC_MAX];
+	int isabus = -1;
+	unsigned gsibase = 0;
+	uint8_t *p;
+	int i, j;
+
+	if ((fps = scanmem(ebda(), 1024, "_MP_", 4)) == NULL
+	    && (fps = scanmem(0x9fc00, 1024, "_MP_", 4)) == NULL
+	    && (fps = scanmem(0xf0000, 0x10000, "_MP_", 4)) == NULL)
+		return 1;
+	if (cksum(fps, 16 * fps->fps_len) != 0 || fps->fps_conftbl == 0)
+		return 1;
+
+	ct = (void *)(unsigned long)fps->fps_conftbl;
+	if (bmk_strncmp(ct->ct_sig, "PCMP", 4) != 0
+	    || cksum(ct, ct->ct_len) != 0)
+		return 1;
+
+	/*
+	 * The table doesn't give the GSI bases, so assume that
+	 * the IOAPICs are in order, as ACPI would number them.
+	 */
+	p = (uint8_t *)(ct+1);
+	for (i = 0; i < ct->ct_nentries; i++) {
+		switch (p[0]) {
+		case MPE_CPU:
+			p += 20;
+			break;
+		case MPE_BUS:
+			mb = (void *)p;
+			if (bmk_strncmp(mb->name, "ISA", 3) == 0)
+				isabus = mb->id;
+			p += 8;
+			break;
+		case MPE_IOAPIC:
+			mio = (void *)p;
+			if ((mio->flags & MPE_IOAPIC_EN)
+			    && nioapic < IOAPIC_MAX) {
+				ioapicid[nioapic] = mio->id;
+				addioapic(mio->addr, gsibase);
+				gsibase += ioapics[nioapic-1].ioa_npins;
+			}
+			p += 8;
+			break;
+		default:
+			p += 8;
+			break;
+		}
+	}
+
+	/* second pass, now that we know the buses and IOAPICs */
+	p = (uint8_t *)(ct+1);
+	for (i = 0; i < ct->ct_nentries; i++) {
+		if (p[0] == MPE_CPU) {
+			p += 20;
+			continue;
+		}
+		mi = (void *)p;
+		p += 8;
+		if (mi->type != MPE_IOINT || mi->inttype != MPE_IOINT_INT
+		    || mi->srcbus != isabus)
+			continue;
+		for (j = 0; j < nioapic; j++) {
+			if (ioapicid[j] == mi->dstioapic
+			    || mi->dstioapic == 0xff) {
+				addoverride(mi->srcirq,
+				    ioapics[j].ioa_gsibase + mi->dstpin,
+				    mi->flags);
+				break;
+			}
+		}
+	}
+
+	return nioapic == 0;
+}
+
+/*
+ * Find the IOAPICs.  Returns 0 if the IOAPICs are usable.
+ */
+int
+x86_ioapic_init(void)
+{
+
+	if (x86_lapic_init() != 0)
+		return 1;
+	if (acpi_parsemadt() != 0 && mp_parse() != 0)
+		return 1;
+	return 0;
+}
+
+/*
+ * Route interrupt "intr" to the given vector on this CPU.  "pci" says
+ * that an ISA IRQ number is really a PCI interrupt line.  The entry is
+ * left masked.  Reports via "levelp" if the interrupt is level-triggered.
+ */
+int
+x86_ioapic_route(int intr, int pci, int vector, uint8_t *levelp)
+{
+	struct ioapic *ioa;
+	unsigned gsi, flags;
+	uint32_t redlo;
+	int i;
+
+	if (intr < 0 || intr >= NINTR)
+		return BMK_EINVAL;
+
+	gsi = intr;
+	if (pci || intr >= ISA_NIRQ)
+		flags = INTI_POLARITY_LOW | INTI_TRIGGER_LEVEL;
+	else
+		flags = INTI_POLARITY_HIGH | INTI_TRIGGER_EDGE;
+	if (intr < ISA_NIRQ && isaovr[intr].ovr_valid) {
+		gsi = isaovr[intr].ovr_gsi;
+		if (isaovr[intr].ovr_flags & INTI_POLARITY)
+			flags = (flags & ~INTI_POLARITY)
+			    | (isaovr[intr].ovr_flags & INTI_POLARITY);
+		if (isaovr[intr].ovr_flags & INTI_TRIGGER)
+			flags = (flags & ~INTI_TRIGGER)
+			    | (isaovr[intr].ovr_flags & INTI_TRIGGER);
+	}
+
+	for (i = 0; i < nioapic; i++) {
+		ioa = &ioapics[i];
+		if (gsi >= ioa->ioa_gsibase
+		    && gsi < ioa->ioa_gsibase + ioa->ioa_npins)
+			break;
+	}
+	if (i == nioapic)
+		return BMK_ENXIO;
+
+	redlo = vector | IOAPIC_RED_MASKED;
+	if ((flags & INTI_TRIGGER) == INTI_TRIGGER_LEVEL)
+		redlo |= IOAPIC_RED_LEVEL;
+	if ((flags & INTI_POLARITY) == INTI_POLARITY_LOW)
+		redlo |= IOAPIC_RED_ACTLOW;
+
+	routes[intr].ri_ioa = ioa;
+	routes[intr].ri_pin = gsi - ioa->ioa_gsibase;
+	routes[intr].ri_redlo = redlo;
+
+	ioapic_write(ioa, IOAPIC_REDHI(routes[intr].ri_pin),
+	    x86_lapic_getid() << IOAPIC_RED_DEST_SHIFT);
+	ioapic_write(ioa, IOAPIC_REDLO(routes[intr].ri_pin), redlo);
+
+	*levelp = (redlo & IOAPIC_RED_LEVEL) != 0;
+	return 0;
+}
+
+void
+x86_ioapic_mask(int intr)
+{
+
+	routes[intr].ri_redlo |= IOAPIC_RED_MASKED;
+	ioapic_write(routes[intr].ri_ioa,
+	    IOAPIC_REDLO(routes[intr].ri_pin), routes[intr].ri_redlo);
+}
+
+void
+x86_ioapic_unmask(int intr)
+{
+
+	routes[intr].ri_redlo &= ~IOAPIC_RED_MASKED;
+	ioapic_write(routes[intr].ri_ioa,
+	    IOAPIC_REDLO(routes[intr].ri_pin), routes[intr].ri_redlo);
+}
@@ -0,0 +1,185 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Local APIC.  We use it in x2APIC mode (register access via MSRs)
+ * if available, since under virtualization an MSR write is cheaper
+ * than trapping an MMIO access.  Otherwise, we use the xAPIC MMIO
+ * page, which the amd64 page tables map 1:1 (as they do for all of
+ * the lowest 4GB).
+ *
+ * The PIC keeps on delivering interrupts through LINT0 configured
+ * as ExtINT ("virtual wire mode").
+ */
+
+#include <hw/types.h>
+#include <hw/kernel.h>
+
+#include <bmk-core/printf.h>
+
+/* lapic isr trampolines (in locore.S) */
+void cpu_isr_lapic_timer(void);
+void cpu_isr_lapic_spurious(void);
+
+static int lapic_x2apic;
+static uint32_t lapic_id;
+static volatile uint32_t *lapic_mmio;
+
+static inline uint32_t
+lapic_read(unsigned reg)
+{
+
+	if (lapic_x2apic)
+		return (uint32_t)rdmsr(MSR_X2APIC_BASE + (reg >> 4));
+	else
+		return lapic_mmio[reg >> 2];
+}
+
+static inline void
+lapic_write(unsigned reg, uint32_t value)
+{
+
+	if (lapic_x2apic)
+		wrmsr(MSR_X2APIC_BASE + (reg >> 4), value);
+	else
+		lapic_mmio[reg >> 2] = value;
+}
+
+/*
+ * Enable the local APIC.  Returns 0 if successful.
+ */
+int
+x86_lapic_init(void)
+{
+	uint32_t eax, ebx, ecx, edx, id;
+	uint64_t apicbase;
+	static int inited, rv;
+
+	if (inited)
+		return rv;
+	inited = 1;
+	rv = 1;
+
+	x86_cpuid(0x0, &eax, &ebx, &ecx, &edx);
+	if (eax < 0x1)
+		return rv;
+	x86_cpuid(0x1, &eax, &ebx, &ecx, &edx);
+	if ((edx & CPUID_01H_EDX_APIC) == 0)
+		return rv;
+
+	apicbase = rdmsr(MSR_APICBASE) | MSR_APICBASE_EN;
+	if (ecx & CPUID_01H_ECX_X2APIC) {
+		apicbase |= MSR_APICBASE_EXTD;
+		lapic_x2apic = 1;
+	} else {
+		lapic_mmio = (void *)(uintptr_t)(apicbase & MSR_APICBASE_ADDR);
+	}
+	wrmsr(MSR_APICBASE, apicbase);
+
+	x86_fillgate(LAPIC_SPURIOUS_VECTOR, cpu_isr_lapic_spurious, 0);
+
+	/*
+	 * Software-enable the APIC and make sure the PIC interrupts
+	 * still get through.  Accept interrupts of all priorities.
+	 */
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+	lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_EXTINT);
+	lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_NMI);
+	lapic_write(LAPIC_TPR, 0);
+
+	id = lapic_read(LAPIC_ID);
+	if (!lapic_x2apic)
+		id >>= 24;
+	lapic_id = id;
+	bmk_printf("x86_lapic_init(): local APIC id %u in %s mode\n",
+	    id, lapic_x2apic ? "x2APIC" : "xAPIC");
+
+	rv = 0;
+	return rv;
+}
+
+uint32_t
+x86_lapic_getid(void)
+{
+
+	return lapic_id;
+}
+
+void
+x86_lapic_eoi(void)
+{
+
+	lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+ * Configure the local APIC timer in TSC-deadline mode.
+ * Returns 0 if successful.
+ */
+int
+x86_lapic_tscdeadline_init(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	x86_cpuid(0x1, &eax, &ebx, &ecx, &edx);
+	if ((ecx & CPUID_01H_ECX_TSCDL) == 0)
+		return 1;
+	if (x86_lapic_init() != 0)
+		return 1;
+
+	x86_fillgate(LAPIC_TIMER_VECTOR, cpu_isr_lapic_timer, 0);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_TSCDL | LAPIC_TIMER_VECTOR);
+
+	/*
+	 * Intel SDM 10.5.4.1: the write to the LVT must be ordered
+	 * before the first write to IA32_TSC_DEADLINE.
+	 */
+	__asm__ __volatile__("mfence" ::: "memory");
+
+	return 0;
+}
+
+/*
+ * Arm the timer to fire when the TSC reaches the given value.  If the
+ * deadline has already passed, the interrupt is delivered immediately.
+ */
+void
+x86_lapic_tscdeadline(uint64_t tsc)
+{
+
+	wrmsr(MSR_TSC_DEADLINE, tsc);
+}
+
+/*
+ * Compose the MSI address/data pair for delivering a fixed,
+ * edge-triggered interrupt with the given vector to this CPU.
+ */
+void
+x86_lapic_msi(int vector, uint64_t *addrp, uint32_t *datap)
+{
+
+	*addrp = MSI_ADDR_BASE | ((lapic_id & 0xff) << MSI_ADDR_DEST_SHIFT);
+	*datap = vector;
+}
@@ -0,0 +1,258 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * PCI configuration space access and MSI/MSI-X setup.  This is shared
+ * by the rump kernel PCI hypercalls and any drivers living directly on
+ * the platform.
+ *
+ * MSI and MSI-X messages are targeted at the local APIC of the boot
+ * CPU, with each message getting its own IDT vector and interrupt
+ * number (see x86_msi_intr()).  The handlers are dispatched via
+ * bmk_isr_rumpkernel() just like legacy interrupts are.
+ */
+
+#include <hw/types.h>
+#include <hw/kernel.h>
+#include <hw/pci.h>
+
+#include <bmk-core/printf.h>
+
+#define PCI_CONF_ADDR 0xcf8
+#define PCI_CONF_DATA 0xcfc
+
+#define PCI_COMMAND		0x04
+#define PCI_COMMAND_MEM		0x00000002
+#define PCI_COMMAND_INTXDIS	0x00000400
+#define PCI_STATUS_CAPLIST	0x00100000
+#define PCI_BAR0		0x10
+#define PCI_BAR_IO		0x1
+#define PCI_BAR_64BIT		0x4
+#define PCI_CAPLIST		0x34
+
+#define PCI_CAP_MSI		0x05
+#define PCI_MSI_CTL_EN		0x00010000
+#define PCI_MSI_CTL_MME		0x00700000
+#define PCI_MSI_CTL_64BIT	0x00800000
+#define PCI_MSI_ADDRLO		0x4
+#define PCI_MSI_ADDRHI		0x8
+#define PCI_MSI_DATA32		0x8
+#define PCI_MSI_DATA64		0xc
+
+#define PCI_CAP_MSIX		0x11
+#define PCI_MSIX_CTL_TBLSZ	0x07ff0000
+#define PCI_MSIX_CTL_MASK	0x40000000
+#define PCI_MSIX_CTL_EN		0x80000000
+#define PCI_MSIX_TBL		0x4
+#define PCI_MSIX_TBL_BIR	0x7
+
+/* MSI-X table entry, 4 words */
+#define MSIX_ENT_ADDRLO		0
+#define MSIX_ENT_ADDRHI		1
+#define MSIX_ENT_DATA		2
+#define MSIX_ENT_CTL		3
+#define MSIX_ENT_CTL_MASK	0x1
+
+static uint32_t
+makeaddr(unsigned bus, unsigned dev, unsigned fun, int reg)
+{
+
+	return (1<<31) | (bus<<16) | (dev <<11) | (fun<<8) | (reg & 0xfc);
+}
+
+uint32_t
+bmk_pci_confread(unsigned bus, unsigned dev, unsigned fun, int reg)
+{
+
+	outl(PCI_CONF_ADDR, makeaddr(bus, dev, fun, reg));
+	return inl(PCI_CONF_DATA);
+}
+
+void
+bmk_pci_confwrite(unsigned bus, unsigned dev, unsigned fun, int reg,
+	uint32_t value)
+{
+
+	outl(PCI_CONF_ADDR, makeaddr(bus, dev, fun, reg));
+	outl(PCI_CONF_DATA, value);
+}
+
+/*
+ * Return the config space offset of the given capability,
+ * or 0 if the device does not have it.
+ */
+int
+bmk_pci_findcap(unsigned bus, unsigned dev, unsigned fun, int capid)
+{
+	uint32_t reg;
+	int off, n;
+
+	if ((bmk_pci_confread(bus, dev, fun, PCI_COMMAND)
+	    & PCI_STATUS_CAPLIST) == 0)
+		return 0;
+
+	off = bmk_pci_confread(bus, dev, fun, PCI_CAPLIST) & 0xfc;
+	/* bound the walk in case of a looping list */
+	for (n = 0; off != 0 && n < 48; n++) {
+		reg = bmk_pci_confread(bus, dev, fun, off);
+		if ((reg & 0xff) == (unsigned)capid)
+			return off;
+		off = (reg >> 8) & 0xfc;
+	}
+
+	return 0;
+}
+
+/*
+ * Set command register bits.  The upper half of the word is the
+ * status register, which is write-one-to-clear, so write zeroes there.
+ */
+static void
+setcommand(unsigned bus, unsigned dev, unsigned fun, uint32_t bits)
+{
+	uint32_t cmd;
+
+	cmd = bmk_pci_confread(bus, dev, fun, PCI_COMMAND);
+	bmk_pci_confwrite(bus, dev, fun, PCI_COMMAND, (cmd | bits) & 0xffff);
+}
+
+/*
+ * Establish a handler for the device's single MSI message and switch
+ * the device from INTx to MSI.  Returns 0 on success, in which case
+ * the device no longer asserts its INTx line.  "flags" are passed
+ * to bmk_isr_rumpkernel().
+ */
+int
+bmk_pci_msi_establish(unsigned bus, unsigned dev, unsigned fun,
+	int (*func)(void *), void *arg, int flags)
+{
+	uint64_t addr;
+	uint32_t ctl, data;
+	int cap, intr, error;
+
+	if ((cap = bmk_pci_findcap(bus, dev, fun, PCI_CAP_MSI)) == 0)
+		return BMK_ENOENT;
+	if ((error = x86_msi_intr(&intr, &addr, &data)) != 0)
+		return error;
+
+	ctl = bmk_pci_confread(bus, dev, fun, cap);
+	bmk_pci_confwrite(bus, dev, fun, cap + PCI_MSI_ADDRLO, (uint32_t)addr);
+	if (ctl & PCI_MSI_CTL_64BIT) {
+		bmk_pci_confwrite(bus, dev, fun,
+		    cap + PCI_MSI_ADDRHI, (uint32_t)(addr >> 32));
+		bmk_pci_confwrite(bus, dev, fun, cap + PCI_MSI_DATA64, data);
+	} else {
+		bmk_pci_confwrite(bus, dev, fun, cap + PCI_MSI_DATA32, data);
+	}
+
+	bmk_isr_rumpkernel(func, arg, intr, flags & ~BMK_INTR_ROUTED);
+
+	/* one message only */
+	ctl &= ~PCI_MSI_CTL_MME;
+	bmk_pci_confwrite(bus, dev, fun, cap, ctl | PCI_MSI_CTL_EN);
+	setcommand(bus, dev, fun, PCI_COMMAND_INTXDIS);
+
+	return 0;
+}
+
+/*
+ * Return the number of MSI-X vectors the device supports,
+ * or 0 if it does not support MSI-X.
+ */
+int
+bmk_pci_msix_nvec(unsigned bus, unsigned dev, unsigned fun)
+{
+	uint32_t ctl;
+	int cap;
+
+	if ((cap = bmk_pci_findcap(bus, dev, fun, PCI_CAP_MSIX)) == 0)
+		return 0;
+	ctl = bmk_pci_confread(bus, dev, fun, cap);
+	return ((ctl & PCI_MSIX_CTL_TBLSZ) >> 16) + 1;
+}
+
+/*
+ * Establish a handler for MSI-X table entry "vec" and enable MSI-X
+ * on the device.  Note that with MSI-X enabled, the device stops
+ * using INTx and any table entries not established stay masked.
+ * Enabling MSI-X may also change the device's register layout
+ * (e.g. legacy virtio), so this is for drivers which know about it.
+ */
+int
+bmk_pci_msix_establish(unsigned bus, unsigned dev, unsigned fun, int vec,
+	int (*func)(void *), void *arg, int flags)
+{
+	volatile uint32_t *ent;
+	uint64_t addr, bar;
+	uint32_t ctl, tbl, data;
+	int cap, bir, intr, error;
+
+	if ((cap = bmk_pci_findcap(bus, dev, fun, PCI_CAP_MSIX)) == 0)
+		return BMK_ENOENT;
+	ctl = bmk_pci_confread(bus, dev, fun, cap);
+	if (vec < 0 || vec > (int)((ctl & PCI_MSIX_CTL_TBLSZ) >> 16))
+		return BMK_EINVAL;
+
+	tbl = bmk_pci_confread(bus, dev, fun, cap + PCI_MSIX_TBL);
+	bir = tbl & PCI_MSIX_TBL_BIR;
+	if (bir > 5)
+		return BMK_EINVAL;
+	bar = bmk_pci_confread(bus, dev, fun, PCI_BAR0 + 4*bir);
+	if (bar & PCI_BAR_IO)
+		return BMK_EINVAL;
+	if (bar & PCI_BAR_64BIT) {
+		bar |= (uint64_t)bmk_pci_confread(bus, dev, fun,
+		    PCI_BAR0 + 4*(bir+1)) << 32;
+	}
+	bar &= ~(uint64_t)0xf;
+
+	/* we run on physical addresses, and only the low 4GB are mapped */
+	if (bar + (tbl & ~PCI_MSIX_TBL_BIR) + 16*(vec+1) > 0x100000000ULL) {
+		bmk_printf("pci %u:%u:%u: MSI-X table above 4GB\n",
+		    bus, dev, fun);
+		return BMK_EINVAL;
+	}
+	ent = (void *)(uintptr_t)(bar + (tbl & ~PCI_MSIX_TBL_BIR) + 16*vec);
+
+	if ((error = x86_msi_intr(&intr, &addr, &data)) != 0)
+		return error;
+	x86_msix_setctl(intr, &ent[MSIX_ENT_CTL]);
+	bmk_isr_rumpkernel(func, arg, intr, flags & ~BMK_INTR_ROUTED);
+
+	/* enable with all vectors masked while we poke the table */
+	setcommand(bus, dev, fun, PCI_COMMAND_MEM | PCI_COMMAND_INTXDIS);
+	bmk_pci_confwrite(bus, dev, fun, cap,
+	    ctl | PCI_MSIX_CTL_EN | PCI_MSIX_CTL_MASK);
+
+	ent[MSIX_ENT_ADDRLO] = (uint32_t)addr;
+	ent[MSIX_ENT_ADDRHI] = (uint32_t)(addr >> 32);
+	ent[MSIX_ENT_DATA] = data;
+	ent[MSIX_ENT_CTL] &= ~MSIX_ENT_CTL_MASK;
+
+	bmk_pci_confwrite(bus, dev, fun, cap,
+	    (ctl | PCI_MSIX_CTL_EN) & ~PCI_MSIX_CTL_MASK);
+
+	return 0;
+}
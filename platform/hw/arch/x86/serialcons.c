@@ -23,12 +23,35 @@
  * SUCH DAMAGE.
  */
 
+/*
+ * Serial console.  Until interrupts are available, and again when
+ * panicking, output is synchronous.  Otherwise, characters are put
+ * into a ring, and the ring is drained by the UART's transmitter
+ * empty interrupt, a FIFO's worth at a time.  Under virtualization
+ * each UART register access is an exit to the hypervisor, so not
+ * polling the line status for every character is a big win.
+ *
+ * If the ring fills up, we fall back to waiting for the UART.
+ */
+
 #include <hw/types.h>
 #include <hw/kernel.h>
 
 #include <arch/x86/cons.h>
 
+#define SC_BUFSIZE 16384
+#define SC_BUFMASK (SC_BUFSIZE-1)
+
 static uint16_t combase = 0;
+static int fifolen = 1;
+
+/* synchronous mode: characters we can write before checking the UART */
+static int fifospace;
+
+static char sc_buf[SC_BUFSIZE];
+static unsigned int sc_prod, sc_cons;
+static int sc_buffered;
+static int sc_txbusy;
 
 void
 serialcons_init(uint16_t combase_init, int speed)
@@ -42,6 +65,34 @@ serialcons_init(uint16_t combase_init, int speed)
 	outb(combase + COM_DLBH, divisor >> 8);
 	outb(combase + COM_LCTL, 0x03);
 	outb(combase + COM_FIFO, 0xc7);
+
+	/* check if we got a 16550 FIFO */
+	if ((inb(combase + COM_IIR) & COM_IIR_FIFOS) == COM_IIR_FIFOS)
+		fifolen = COM_FIFOLEN;
+}
+
+static void
+waittx(void)
+{
+
+	while ((inb(combase + COM_LSR) & COM_LSR_TXRDY) == 0)
+		continue;
+}
+
+/*
+ * Move up to a FIFO's worth of characters from the ring to the UART.
+ * The transmitter must be empty.  Returns the number of characters.
+ */
+static int
+txburst(void)
+{
+	int n;
+
+	for (n = 0; n < fifolen && sc_cons != sc_prod; n++) {
+		outb(combase + COM_DATA, sc_buf[sc_cons & SC_BUFMASK]);
+		sc_cons++;
+	}
+	return n;
 }
 
 void
@@ -53,10 +104,118 @@ serialcons_putc(int c)
 	if (c == '\n')
 		serialcons_putc('\r');
 
+	if (!sc_buffered) {
+		/* an empty transmitter can take a full FIFO */
+		if (fifospace == 0) {
+			waittx();
+			fifospace = fifolen;
+		}
+		outb(combase + COM_DATA, c);
+		fifospace--;
+		return;
+	}
+
+	splhigh();
+	if (sc_prod - sc_cons == SC_BUFSIZE) {
+		/* ring full.  make room the slow way */
+		waittx();
+		txburst();
+		sc_txbusy = 1;
+	}
+	sc_buf[sc_prod & SC_BUFMASK] = c;
+	sc_prod++;
+	spl0();
+}
+
+/*
+ * Start the transmitter, if it's not already running.  Called at
+ * the end of every bmk_printf().  If the transmitter is idle, the
+ * last interrupt saw it empty, so we can write without checking.
+ */
+void
+serialcons_flush(void)
+{
+
+	if (!sc_buffered)
+		return;
+
+	splhigh();
+	if (!sc_txbusy && sc_cons != sc_prod) {
+		txburst();
+		sc_txbusy = 1;
+	}
+	spl0();
+}
+
+static int
+serialcons_intr(void *arg)
+{
+	int rv;
+
+	if ((inb(combase + COM_IIR) & COM_IIR_IMASK) != COM_IIR_TXRDY)
+		return 0;
+
+	splhigh();
+	rv = txburst();
+	sc_txbusy = rv != 0;
+	spl0();
+
+	return rv;
+}
+
+/*
+ * Switch to buffered output.  Called once the interrupt and
+ * thread machinery is up.
+ */
+void
+serialcons_intr_init(void)
+{
+	int irq;
+
+	switch (combase) {
+	case 0x3f8:
+		irq = 4;
+		break;
+	case 0x2f8:
+		irq = 3;
+		break;
+	default:
+		return;
+	}
+
+	bmk_isr_rumpkernel(serialcons_intr, NULL, irq, BMK_INTR_NORUMP);
+
 	/*
-	 * Write a single character at a time, while the output FIFO has space.
+	 * serialcons_flush() assumes an idle transmitter is empty, so
+	 * let synchronous output still in the FIFO go out first.
 	 */
-	while ((inb(combase + COM_LSR) & 0x20) == 0)
-		;
-	outb(combase + COM_DATA, c);
+	splhigh();
+	waittx();
+	fifospace = 0;
+	outb(combase + COM_MCR, COM_MCR_DTR | COM_MCR_RTS | COM_MCR_OUT2);
+	outb(combase + COM_IER, COM_IER_ETXRDY);
+	sc_buffered = 1;
+	spl0();
+}
+
+/*
+ * Drain the ring and go back to synchronous output, so that
+ * e.g. panic messages make it out no matter what.
+ */
+void
+serialcons_sync(void)
+{
+
+	if (!sc_buffered)
+		return;
+
+	splhigh();
+	sc_buffered = 0;
+	outb(combase + COM_IER, 0x00);
+	while (sc_cons != sc_prod) {
+		waittx();
+		txburst();
+	}
+	fifospace = 0;
+	spl0();
 }
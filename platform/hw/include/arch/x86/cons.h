@@ -1,4 +1,9 @@
+void cons_intr_init(void);
+
 void serialcons_init(uint16_t, int);
 void serialcons_putc(int);
+void serialcons_flush(void);
+void serialcons_intr_init(void);
+void serialcons_sync(void);
 void vgacons_putc(int);
 
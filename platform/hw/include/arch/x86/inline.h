@@ -8,6 +8,16 @@ inb(uint16_t port)
         return rv;
 }
 
+static inline uint16_t
+inw(uint16_t port)
+{
+        uint16_t rv;
+
+        __asm__ __volatile__("inw %1, %0" : "=a"(rv) : "d"(port));
+
+        return rv;
+}
+
 static inline uint32_t
 inl(uint16_t port)
 {
@@ -25,6 +35,13 @@ outb(uint16_t port, uint8_t value)
         __asm__ __volatile__("outb %0, %1" :: "a"(value), "d"(port));
 }
 
+static inline void
+outw(uint16_t port, uint16_t value)
+{
+
+        __asm__ __volatile__("outw %0, %1" :: "a"(value), "d"(port));
+}
+
 static inline void
 outl(uint16_t port, uint32_t value)
 {
@@ -69,3 +86,20 @@ rdtsc(void)
 	val = ((uint64_t)edx<<32)|(eax);
 	return val;
 }
+
+static inline uint64_t
+rdmsr(uint32_t msr)
+{
+	uint32_t eax, edx;
+
+	__asm__ __volatile__("rdmsr" : "=a"(eax), "=d"(edx) : "c"(msr));
+	return ((uint64_t)edx<<32)|(eax);
+}
+
+static inline void
+wrmsr(uint32_t msr, uint64_t value)
+{
+
+	__asm__ __volatile__("wrmsr" ::
+		"c" (msr), "a" ((uint32_t)value), "d" ((uint32_t)(value >> 32)));
+}
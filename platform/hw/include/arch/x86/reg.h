@@ -15,6 +15,39 @@
 
 #define MSR_EFER_LME	0x00000100 /* Long Mode Enable */
 
+#define CPUID_01H_ECX_X2APIC	0x00200000 /* x2APIC mode */
+#define CPUID_01H_ECX_TSCDL	0x01000000 /* TSC-deadline timer */
+#define CPUID_01H_EDX_APIC	0x00000200 /* on-chip local APIC */
+
+#define MSR_APICBASE		0x0000001b
+#define MSR_APICBASE_EXTD	0x00000400 /* x2APIC mode */
+#define MSR_APICBASE_EN		0x00000800 /* global enable */
+#define MSR_APICBASE_ADDR	0xfffff000
+#define MSR_TSC_DEADLINE	0x000006e0
+#define MSR_X2APIC_BASE		0x00000800 /* x2APIC MSR = base + reg/16 */
+
+/* local APIC registers, as offsets into the xAPIC MMIO page */
+#define LAPIC_ID	0x020
+#define LAPIC_TPR	0x080
+#define LAPIC_EOI	0x0b0
+#define LAPIC_SVR	0x0f0
+#define LAPIC_SVR_ENABLE	0x00000100
+#define LAPIC_LVT_TIMER	0x320
+#define LAPIC_LVT_LINT0	0x350
+#define LAPIC_LVT_LINT1	0x360
+#define LAPIC_LVT_MASKED	0x00010000
+#define LAPIC_LVT_EXTINT	0x00000700
+#define LAPIC_LVT_NMI		0x00000400
+#define LAPIC_LVT_TSCDL		0x00040000 /* timer mode: TSC-deadline */
+
+/* IDT vectors used for local APIC interrupts */
+#define LAPIC_TIMER_VECTOR	0xef
+#define LAPIC_SPURIOUS_VECTOR	0xff
+
+/* MSI address for delivery to a local APIC, data is the vector */
+#define MSI_ADDR_BASE		0xfee00000
+#define MSI_ADDR_DEST_SHIFT	12
+
 #define PIC1_CMD	0x20
 #define PIC1_DATA	0x21
 #define PIC2_CMD	0xa0
@@ -22,6 +55,19 @@
 #define ICW1_IC4	0x01	/* we're going to do the fourth write */
 #define ICW1_INIT	0x10
 #define ICW4_8086	0x01	/* use 8086 mode */
+#define OCW2_SEOI	0x60	/* specific EOI, OR in the IRQ */
+
+/* IOAPIC */
+#define IOAPIC_REGSEL	0x00
+#define IOAPIC_WIN	0x10
+#define IOAPIC_VER	0x01
+#define IOAPIC_VER_MAXREDIR(v)	(((v) >> 16) & 0xff)
+#define IOAPIC_REDLO(pin)	(0x10 + 2*(pin))
+#define IOAPIC_REDHI(pin)	(0x11 + 2*(pin))
+#define IOAPIC_RED_MASKED	0x00010000
+#define IOAPIC_RED_LEVEL	0x00008000
+#define IOAPIC_RED_ACTLOW	0x00002000
+#define IOAPIC_RED_DEST_SHIFT	24
 
 #define TIMER_CNTR	0x40
 #define TIMER_MODE	0x43
@@ -53,9 +99,21 @@
 #define COM_DLBL	0
 #define COM_DLBH	1
 #define COM_IER		1
+#define COM_IIR		2
 #define COM_FIFO	2
 #define COM_LCTL	3
+#define COM_MCR		4
 #define COM_LSR		5
 
+#define COM_IER_ETXRDY	0x02
+#define COM_IIR_IMASK	0x0f
+#define COM_IIR_TXRDY	0x02
+#define COM_IIR_FIFOS	0xc0
+#define COM_MCR_DTR	0x01
+#define COM_MCR_RTS	0x02
+#define COM_MCR_OUT2	0x08
+#define COM_LSR_TXRDY	0x20
+#define COM_FIFOLEN	16
+
 #define BIOS_COM1_BASE	0x400
 #define BIOS_CRTC_BASE	0x463
@@ -5,6 +5,21 @@ void	x86_boot(struct multiboot_info *);
 void	x86_initpic(void);
 void	x86_initidt(void);
 void	x86_initclocks(void);
+
+int	x86_lapic_init(void);
+uint32_t x86_lapic_getid(void);
+void	x86_lapic_eoi(void);
+int	x86_lapic_tscdeadline_init(void);
+void	x86_lapic_tscdeadline(uint64_t);
+void	x86_lapic_msi(int, uint64_t *, uint32_t *);
+int	x86_msi_intr(int *, uint64_t *, uint32_t *);
+void	x86_msix_setctl(int, volatile uint32_t *);
+void	x86_intr(int);
+
+int	x86_ioapic_init(void);
+int	x86_ioapic_route(int, int, int, uint8_t *);
+void	x86_ioapic_mask(int);
+void	x86_ioapic_unmask(int);
 void	x86_fillgate(int, void *, int);
 
 /* trap "handlers" */
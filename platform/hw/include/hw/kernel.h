@@ -10,11 +10,14 @@ void multiboot(struct multiboot_info *);
 void cons_init(void);
 void cons_putc(int);
 void cons_puts(const char *);
+void cons_flush(void);
 
 void cpu_init(void);
 void cpu_block(bmk_time_t);
-int cpu_intr_init(int);
-void cpu_intr_ack(unsigned);
+int cpu_intr_init(int, int);
+void cpu_intr_ack(int);
+int cpu_intr_canmask(int);
+void cpu_intr_mask(int);
 
 bmk_time_t cpu_clock_now(void);
 bmk_time_t cpu_clock_epochoffset(void);
@@ -24,6 +27,11 @@ void intr_init(void);
 void bmk_isr_rumpkernel(int (*)(void *), void *, int, int);
 
 #define BMK_INTR_ROUTED 0x01
+#define BMK_INTR_NORUMP 0x02
+#define BMK_INTR_MITIGATE 0x04
+#define BMK_INTR_PRIOMASK 0xff00
+#define BMK_INTR_PRIO(p) (((p) << 8) & BMK_INTR_PRIOMASK)
+#define BMK_INTR_GETPRIO(f) (((f) & BMK_INTR_PRIOMASK) >> 8)
 
 #define BMK_MULTIBOOT_CMDLINE_SIZE 4096
 extern char multiboot_cmdline[];
@@ -32,6 +40,6 @@ extern char multiboot_cmdline[];
 
 #include <bmk-core/errno.h>
 
-#define BMK_MAXINTR	32
+#define BMK_MAXINTR	64
 
 #define HZ 100
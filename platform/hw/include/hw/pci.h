@@ -0,0 +1,14 @@
+#ifndef _BMK_PCI_H_
+#define _BMK_PCI_H_
+
+uint32_t bmk_pci_confread(unsigned, unsigned, unsigned, int);
+void	bmk_pci_confwrite(unsigned, unsigned, unsigned, int, uint32_t);
+int	bmk_pci_findcap(unsigned, unsigned, unsigned, int);
+
+int	bmk_pci_msi_establish(unsigned, unsigned, unsigned,
+			      int (*)(void *), void *, int);
+int	bmk_pci_msix_nvec(unsigned, unsigned, unsigned);
+int	bmk_pci_msix_establish(unsigned, unsigned, unsigned, int,
+			       int (*)(void *), void *, int);
+
+#endif /* _BMK_PCI_H_ */
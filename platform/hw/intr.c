@@ -26,10 +26,14 @@
 #include <hw/kernel.h>
 
 #include <bmk-core/core.h>
+#include <bmk-core/intrstat.h>
 #include <bmk-core/memalloc.h>
+#include <bmk-core/mitigate.h>
 #include <bmk-core/printf.h>
 #include <bmk-core/queue.h>
 #include <bmk-core/sched.h>
+#include <bmk-core/string.h>
+#include <bmk-core/trace.h>
 
 #include <bmk-rumpuser/core_types.h>
 #include <bmk-rumpuser/rumpuser.h>
@@ -40,6 +44,7 @@
 struct intrhand {
 	int (*ih_fun)(void *);
 	void *ih_arg;
+	int ih_flags;
 
 	SLIST_ENTRY(intrhand) ih_entries;
 };
@@ -51,10 +56,41 @@ static int isr_routed[INTR_LEVELS];
 #define INTR_ROUTED_YES		1
 #define INTR_ROUTED_NO		2
 
-static volatile unsigned int isr_todo;
-static unsigned int isr_lowest = sizeof(isr_todo)*8;
+/* pending interrupts, one bit per interrupt number */
+#define ISR_BITS (sizeof(unsigned int)*8)
+#define ISR_WORDS ((BMK_MAXINTR + ISR_BITS-1) / ISR_BITS)
 
-static struct bmk_thread *isr_thread;
+/*
+ * Each interrupt level is serviced by its own thread, so that e.g.
+ * a busy NIC does not hold up disk completions, and so that the
+ * threads can be given different priorities.  Interrupt threads
+ * always run before regular threads.
+ */
+struct isrthr {
+	struct bmk_thread *it_thread;
+	int it_level;
+	int it_prio;
+	int it_haslwp;
+	int it_nrump;	/* number of handlers needing the rump kernel */
+	int it_nomask;	/* an interrupt can't be masked for polling */
+	struct bmk_mitigate it_mit;
+
+	volatile unsigned int it_todo[ISR_WORDS];
+	volatile int it_pending;
+};
+static struct isrthr *isr_thr[INTR_LEVELS];
+
+/* interrupt number to servicing thread, for isr() */
+static struct isrthr *isr_intrthr[BMK_MAXINTR];
+
+#define ISR_PRIO_BASE (BMK_SCHED_PRIO_DEFAULT+1)
+
+/*
+ * Statistics, and the time of the oldest interrupt not yet picked up
+ * by the servicing thread.  Entry time 0 means nothing is pending.
+ */
+static struct bmk_intrstat isr_stat[BMK_MAXINTR];
+static bmk_time_t isr_entry[BMK_MAXINTR];
 
 static int
 routeintr(int i)
@@ -67,50 +103,133 @@ routeintr(int i)
 #endif
 }
 
+/* returns nonzero if any of the handlers claimed to have done work */
+static int
+runhandlers(struct isrthr *it, unsigned int *isrcopy, int needrump)
+{
+	struct intrhand *ih;
+	unsigned int bits;
+	int i, w, rv = 0;
+
+	for (w = 0; w < ISR_WORDS; w++) {
+		bits = isrcopy[w];
+		while (bits) {
+			i = __builtin_ctz(bits);
+			bits &= ~(1U<<i);
+
+			SLIST_FOREACH(ih, &isr_ih[it->it_level], ih_entries) {
+				if (((ih->ih_flags & BMK_INTR_NORUMP) == 0)
+				    == needrump)
+					rv |= ih->ih_fun(ih->ih_arg);
+			}
+		}
+	}
+	return rv;
+}
+
+/* account entry-to-service latency.  called at splhigh */
+static void
+isrlatency(unsigned int *isrcopy)
+{
+	bmk_time_t now;
+	unsigned int bits;
+	int i, w;
+
+	now = bmk_platform_cpu_clock_monotonic();
+	for (w = 0; w < ISR_WORDS; w++) {
+		bits = isrcopy[w];
+		while (bits) {
+			i = __builtin_ctz(bits);
+			bits &= ~(1U<<i);
+			i += w * ISR_BITS;
+
+			bmk_trace(BMK_TRACE_INTRRUN, i, 0);
+			if (isr_entry[i]) {
+				bmk_intrstat_latency(&isr_stat[i],
+				    now - isr_entry[i]);
+				isr_entry[i] = 0;
+			}
+		}
+	}
+}
+
 /* thread context we use to deliver interrupts to the rump kernel */
 static void
 doisr(void *arg)
 {
-	int i, totwork = 0;
+	struct isrthr *it = arg;
+	unsigned int totwork[ISR_WORDS];
+	int i, w;
 
-	rumpuser__hyp.hyp_schedule();
-	rumpuser__hyp.hyp_lwproc_newlwp(0);
-	rumpuser__hyp.hyp_unschedule();
+	for (w = 0; w < ISR_WORDS; w++)
+		totwork[w] = 0;
 
 	splhigh();
 	for (;;) {
-		unsigned int isrcopy;
+		unsigned int isrcopy[ISR_WORDS];
 		int nlocks = 1;
+		int didwork;
 
-		isrcopy = isr_todo;
-		isr_todo = 0;
-		spl0();
-
-		totwork |= isrcopy;
-
-		rumpkern_sched(nlocks, NULL);
-		for (i = isr_lowest; isrcopy; i++) {
-			struct intrhand *ih;
+		for (w = 0; w < ISR_WORDS; w++) {
+			isrcopy[w] = it->it_todo[w];
+			it->it_todo[w] = 0;
+			totwork[w] |= isrcopy[w];
+		}
+		it->it_pending = 0;
+		isrlatency(isrcopy);
 
-			bmk_assert(i < sizeof(isrcopy)*8);
-			if ((isrcopy & (1<<i)) == 0)
-				continue;
-			isrcopy &= ~(1<<i);
+		/* when polling, poll everything we haven't acked yet */
+		if (it->it_mit.mit_polling) {
+			for (w = 0; w < ISR_WORDS; w++)
+				isrcopy[w] = totwork[w];
+		}
+		spl0();
 
-			if (isr_routed[i] == INTR_ROUTED_YES)
-				i = routeintr(i);
+		/* first the handlers which can run without the rump kernel */
+		didwork = runhandlers(it, isrcopy, 0);
 
-			SLIST_FOREACH(ih, &isr_ih[i], ih_entries) {
-				ih->ih_fun(ih->ih_arg);
+		if (it->it_nrump) {
+			if (!it->it_haslwp) {
+				rumpuser__hyp.hyp_schedule();
+				rumpuser__hyp.hyp_lwproc_newlwp(0);
+				rumpuser__hyp.hyp_unschedule();
+				it->it_haslwp = 1;
 			}
+			rumpkern_sched(nlocks, NULL);
+			didwork |= runhandlers(it, isrcopy, 1);
+			rumpkern_unsched(&nlocks, NULL);
+		}
+
+		/*
+		 * If we're being flooded, leave the interrupts unacked,
+		 * i.e. masked at the source, and keep calling the handlers
+		 * until they run out of work.  Sleep between poll rounds
+		 * instead of yielding: we run at a higher priority, so a
+		 * yield would put us right back in front of the regular
+		 * threads, including the softints our handlers queue work
+		 * for, and a flood would never let them run.
+		 */
+		if (it->it_mit.mit_polling
+		    && bmk_mitigate_poll(&it->it_mit, didwork)) {
+			bmk_sched_blockprepare_timeout(
+			    bmk_platform_cpu_clock_monotonic()
+			    + it->it_mit.mit_pollint);
+			bmk_sched_block();
+			splhigh();
+			continue;
 		}
-		rumpkern_unsched(&nlocks, NULL);
 
 		splhigh();
-		if (isr_todo)
+		if (it->it_pending)
 			continue;
 
-		cpu_intr_ack(totwork);
+		for (w = 0; w < ISR_WORDS; w++) {
+			while (totwork[w]) {
+				i = __builtin_ctz(totwork[w]);
+				totwork[w] &= ~(1U<<i);
+				cpu_intr_ack(i + w * ISR_BITS);
+			}
+		}
 
 		/* no interrupts left. block until the next one. */
 		bmk_sched_blockprepare();
@@ -118,21 +237,67 @@ doisr(void *arg)
 		spl0();
 
 		bmk_sched_block();
-		totwork = 0;
 		splhigh();
 	}
 }
 
+static struct isrthr *
+getisrthr(int level)
+{
+	struct isrthr *it;
+	char name[16];
+
+	if ((it = isr_thr[level]) != NULL)
+		return it;
+
+	it = bmk_xmalloc_bmk(sizeof(*it));
+	if (!it)
+		bmk_platform_halt("getisrthr: xmalloc");
+	bmk_memset(it, 0, sizeof(*it));
+	it->it_level = level;
+	it->it_prio = ISR_PRIO_BASE;
+	bmk_mitigate_init(&it->it_mit);
+	it->it_mit.mit_enter = 0; /* until someone asks for it */
+
+	if (level == INTR_ROUTED)
+		bmk_snprintf(name, sizeof(name), "isrthr");
+	else
+		bmk_snprintf(name, sizeof(name), "isrthr%d", level);
+	it->it_thread = bmk_sched_create(name, NULL, 0, doisr, it, NULL, 0);
+	if (!it->it_thread)
+		bmk_platform_halt("getisrthr: create");
+	bmk_sched_setprio(it->it_thread, it->it_prio);
+
+	isr_thr[level] = it;
+	return it;
+}
+
+/*
+ * Establish an interrupt handler.  Flags:
+ *
+ *   BMK_INTR_ROUTED:	interrupt number may be shared and subject to routing
+ *   BMK_INTR_NORUMP:	the handler does not need the rump kernel, and will
+ *			be called without scheduling a rump kernel CPU
+ *   BMK_INTR_PRIO(p):	relative priority of the servicing thread.  If
+ *			handlers on a shared level specify different
+ *			priorities, the highest one wins.
+ *   BMK_INTR_MITIGATE:	switch the level to polling when the interrupt
+ *			rate is high.  The handler must return nonzero
+ *			if it found work.  Ignored if the platform can't
+ *			mask all of the level's interrupts at the source.
+ */
 void
 bmk_isr_rumpkernel(int (*func)(void *), void *arg, int intr, int flags)
 {
 	struct intrhand *ih;
-	int error, icheck, routedintr;
+	struct isrthr *it;
+	int error, icheck, routedintr, prio;
 
-	if (intr > sizeof(isr_todo)*8 || intr > BMK_MAXINTR)
+	if (intr < 0 || intr >= BMK_MAXINTR)
 		bmk_platform_halt("bmk_isr_rumpkernel: intr");
 
-	if ((flags & ~BMK_INTR_ROUTED) != 0)
+	if ((flags & ~(BMK_INTR_ROUTED|BMK_INTR_NORUMP|BMK_INTR_MITIGATE
+	    |BMK_INTR_PRIOMASK)) != 0)
 		bmk_platform_halt("bmk_isr_rumpkernel: flags");
 
 	ih = bmk_xmalloc_bmk(sizeof(*ih));
@@ -154,24 +319,89 @@ bmk_isr_rumpkernel(int (*func)(void *), void *arg, int intr, int flags)
 	if (isr_routed[intr] != icheck)
 		bmk_platform_halt("bmk_isr_rumpkernel: routed intr mismatch");
 
-	if ((error = cpu_intr_init(intr)) != 0) {
-		bmk_platform_halt("bmk_isr_rumpkernel: cpu_intr_init");
-	}
 	ih->ih_fun = func;
 	ih->ih_arg = arg;
+	ih->ih_flags = flags;
+
+	it = getisrthr(routedintr);
+	if ((flags & BMK_INTR_NORUMP) == 0)
+		it->it_nrump++;
+	prio = ISR_PRIO_BASE + BMK_INTR_GETPRIO(flags);
+	if (prio > it->it_prio) {
+		it->it_prio = prio;
+		bmk_sched_setprio(it->it_thread, prio);
+	}
 
 	SLIST_INSERT_HEAD(&isr_ih[routedintr], ih, ih_entries);
-	if ((unsigned)intr < isr_lowest)
-		isr_lowest = intr;
+	isr_intrthr[intr] = it;
+
+	if ((error = cpu_intr_init(intr, flags)) != 0) {
+		bmk_platform_halt("bmk_isr_rumpkernel: cpu_intr_init");
+	}
+
+	/*
+	 * Polling leaves the level's interrupts unacked, which must
+	 * mask them, and only them, while we poll.
+	 */
+	if (!cpu_intr_canmask(intr))
+		it->it_nomask = 1;
+	if (it->it_nomask)
+		it->it_mit.mit_enter = 0;
+	else if (flags & BMK_INTR_MITIGATE)
+		it->it_mit.mit_enter = BMK_MITIGATE_ENTER;
 }
 
+/*
+ * Called from interrupt context to mark interrupt number "intr" as
+ * pending and schedule the interrupt thread.
+ */
 void
-isr(int which)
+isr(int intr)
 {
+	struct isrthr *it;
+
+	isr_stat[intr].is_count++;
+	bmk_trace(BMK_TRACE_INTR, intr, 0);
+	if ((it = isr_intrthr[intr]) == NULL)
+		return;
+
+	if (isr_entry[intr] == 0)
+		isr_entry[intr] = bmk_platform_cpu_clock_monotonic();
 
 	/* schedule the interrupt handler */
-	isr_todo |= which;
-	bmk_sched_wake(isr_thread);
+	it->it_todo[intr / ISR_BITS] |= 1U << (intr % ISR_BITS);
+	it->it_pending = 1;
+	if (bmk_mitigate_intr(&it->it_mit))
+		cpu_intr_mask(intr);
+	bmk_sched_wake(it->it_thread);
+}
+
+/*
+ * Print interrupt statistics.  Can be called at any time, e.g.
+ * from the application when diagnosing throughput problems.
+ */
+void
+bmk_platform_intrstat_dump(void)
+{
+	struct isrthr *it;
+	char name[16];
+	int i;
+
+	bmk_printf("BEGIN interrupt statistics\n");
+	for (i = 0; i < BMK_MAXINTR; i++) {
+		if (isr_stat[i].is_count == 0)
+			continue;
+		bmk_snprintf(name, sizeof(name), "intr %d", i);
+		bmk_intrstat_print(name, &isr_stat[i]);
+	}
+	for (i = 0; i < INTR_LEVELS; i++) {
+		if ((it = isr_thr[i]) == NULL || it->it_mit.mit_enter == 0)
+			continue;
+		bmk_printf("level %d mitigation: %lu intrs, %lu polls, "
+		    "%lu switches to polling\n", i, it->it_mit.mit_nintr,
+		    it->it_mit.mit_npoll, it->it_mit.mit_nswitch);
+	}
+	bmk_printf("END interrupt statistics\n");
 }
 
 void
@@ -182,8 +412,4 @@ intr_init(void)
 	for (i = 0; i < INTR_LEVELS; i++) {
 		SLIST_INIT(&isr_ih[i]);
 	}
-
-	isr_thread = bmk_sched_create("isrthr", NULL, 0, doisr, NULL, NULL, 0);
-	if (!isr_thread)
-		bmk_platform_halt("intr_init");
 }
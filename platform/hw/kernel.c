@@ -52,6 +52,7 @@ void __attribute__((noreturn))
 bmk_platform_halt(const char *panicstring)
 {
 
+	cons_flush();
 	if (panicstring)
 		bmk_printf("PANIC: %s\n", panicstring);
 	bmk_printf("halted\n");
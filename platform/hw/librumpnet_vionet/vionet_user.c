@@ -0,0 +1,1245 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Native virtio-net driver.  Instead of going through the NetBSD
+ * PCI and virtio drivers, this drives the device directly from the
+ * hypercall layer and plugs into the rump kernel as a virtif-style
+ * interface ("vionet0", etc.).  That lets us:
+ *
+ *   - use multiple queue pairs (VIRTIO_NET_F_MQ), each RX queue
+ *     with its own MSI-X vector and hence its own interrupt thread
+ *   - post RX buffers once and have large packets span several
+ *     of them (VIRTIO_NET_F_MRG_RXBUF)
+ *   - suppress notifications in both directions with event indices
+ *     (VIRTIO_F_RING_EVENT_IDX).  TX completions never interrupt,
+ *     they are reaped when sending and when servicing RX.
+ *   - hand TCP/UDP checksumming and TCP segmentation to the host
+ *   - transmit mbufs without copying them, since we run on
+ *     physical addresses
+ *   - give applications the rings directly, see <rumprun/netring.h>
+ *
+ * Only the legacy virtio PCI interface is supported.  When this
+ * driver is linked in, virtio-net devices are hidden from the rump
+ * kernel PCI bus, see rumpcomp_pci_claimed().
+ *
+ * With QEMU, multiqueue requires something like:
+ *   -netdev tap,id=n0,queues=4,vhost=on
+ *   -device virtio-net-pci,netdev=n0,mq=on,vectors=10
+ */
+
+/* XXX */
+struct iovec {
+	void *iov_base;
+	unsigned long iov_len;
+};
+
+#include <hw/types.h>
+#include <hw/kernel.h>
+#include <hw/pci.h>
+
+#include <bmk-core/errno.h>
+#include <bmk-core/memalloc.h>
+#include <bmk-core/pgalloc.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/printf.h>
+#include <bmk-core/sched.h>
+#include <bmk-core/string.h>
+
+#include <bmk-pcpu/pcpu.h>
+
+#include <bmk-rumpuser/core_types.h>
+#include <bmk-rumpuser/rumpuser.h>
+
+#include <rumprun/netring.h>
+
+#include "if_virt.h"
+#include "if_virt_user.h"
+#include "virtioreg.h"
+
+#define PCI_ID_REG		0x00
+#define PCI_COMMAND		0x04
+#define PCI_COMMAND_IO		0x00000001
+#define PCI_COMMAND_MASTER	0x00000004
+#define PCI_BHLC_REG		0x0c
+#define PCI_BHLC_MULTIFN	0x00800000
+#define PCI_BAR0		0x10
+#define PCI_BAR_IO		0x1
+#define PCI_SUBSYS_REG		0x2c
+#define PCI_INTR_REG		0x3c
+
+#define VIONET_MAXPAIRS		8
+#define VIONET_RXBUFSZ		2048
+#define VIONET_MAXRXSEG		32
+#define VIONET_TXWAIT		(50*1000ULL)	/* ns */
+#define VIONET_CTRLWAIT		(1000*1000*1000ULL)
+
+#define VIONET_FEATURES \
+    (VIRTIO_NET_F_CSUM | VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_MAC	\
+    | VIRTIO_NET_F_HOST_TSO4 | VIRTIO_NET_F_MRG_RXBUF | VIRTIO_NET_F_STATUS \
+    | VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ | VIRTIO_F_RING_EVENT_IDX)
+
+/* we run on physical memory */
+#define VTOPHYS(va) ((uint64_t)(uintptr_t)(va))
+
+/* transmitted from a raw frame ring, n slots; mbufs are aligned */
+#define NETRING_COOKIE(n) ((void *)(((unsigned long)(n) << 1) | 1))
+#define NETRING_ISCOOKIE(c) (((unsigned long)(c) & 1) != 0)
+#define NETRING_COOKIE_NSLOTS(c) ((unsigned long)(c) >> 1)
+
+struct virtif_user;
+
+/*
+ * The raw frame rings of a queue pair, as large as the virtqueues.
+ * RX slots point into the buffers of the descriptors they hold.
+ */
+struct netring_q {
+	struct rumprun_netring nq_rx;
+	struct rumprun_netring nq_tx;
+	uint16_t *nq_rxid;		/* descriptor of each RX slot */
+	char *nq_txbuf;			/* own buffers of the TX slots */
+	int nq_txorder;
+	unsigned int nq_rxrel;		/* RX slots released up to here */
+	unsigned int nq_txsent;		/* TX slots sent up to here */
+	unsigned int nq_txdone;		/* and done up to here */
+	int nq_txbusy;			/* frames in flight */
+	struct bmk_thread *nq_waiter;
+};
+
+struct rumprun_netif {
+	struct virtif_user *ni_viu;
+	struct netring_q ni_q[VIONET_MAXPAIRS];
+	int ni_nrings;
+	unsigned long ni_rxdrop;
+	unsigned long ni_txerr;
+};
+
+struct vq {
+	struct virtif_user *vq_viu;
+	int vq_index;
+	int vq_pair;
+	uint16_t vq_num;
+
+	struct vring_desc *vq_desc;
+	volatile struct vring_avail *vq_avail;
+	volatile struct vring_used *vq_used;
+	volatile uint16_t *vq_usedevent;	/* in avail ring, we write */
+	volatile uint16_t *vq_availevent;	/* in used ring, device writes */
+	void *vq_mem;
+	int vq_memorder;
+
+	uint16_t vq_availidx;	/* next slot we fill */
+	uint16_t vq_pubidx;	/* last index published to the device */
+	uint16_t vq_lastused;	/* next used slot we look at */
+
+	/* RX: buffer i is always in descriptor i */
+	char *vq_rxbuf;
+	int vq_rxorder;
+
+	/* TX: free descriptor list, and header & mbuf per chain head */
+	uint16_t vq_freehead;
+	uint16_t vq_nfree;
+	struct virtio_net_hdr *vq_txhdr;
+	void **vq_txcookie;
+};
+
+struct virtif_user {
+	struct virtif_sc *viu_vifsc;
+
+	unsigned viu_bus, viu_dev, viu_fun;
+	unsigned viu_iobase;
+	uint32_t viu_features;
+	int viu_hdrlen;
+	int viu_msix;
+	int viu_maxpairs;
+	int viu_npairs;
+	int viu_intr;		/* handlers established, can't free */
+	volatile int viu_running;
+
+	struct vq viu_rxq[VIONET_MAXPAIRS];
+	struct vq viu_txq[VIONET_MAXPAIRS];
+	struct vq viu_ctrlq;
+
+	/* the raw frame rings, if open */
+	int viu_unit;
+	struct rumprun_netif *viu_netif;
+	struct virtif_user *viu_next;
+
+	/* control command buffer, device-accessible */
+	struct {
+		uint8_t class;
+		uint8_t cmd;
+		uint16_t data;
+		uint8_t ack;
+	} __attribute__((__packed__)) viu_ctrl;
+};
+
+#define barrier() __asm__ __volatile__("" ::: "memory")
+#define membar() __sync_synchronize()
+
+/* for finding interfaces by unit in rumprun_netring_open() */
+static struct virtif_user *viulist;
+
+static int
+isvionet(unsigned bus, unsigned dev, unsigned fun)
+{
+	uint32_t id;
+
+	id = bmk_pci_confread(bus, dev, fun, PCI_ID_REG);
+	if ((id & 0xffff) != VIRTIO_PCI_VENDOR
+	    || (id >> 16) < VIRTIO_PCI_DEV_LEGACY
+	    || (id >> 16) > VIRTIO_PCI_DEV_LEGACY + 0x3f)
+		return 0;
+	return (bmk_pci_confread(bus, dev, fun, PCI_SUBSYS_REG) >> 16)
+	    == VIRTIO_PCI_SUBSYS_NET;
+}
+
+/*
+ * Called by the rump kernel PCI hypercalls for each config space
+ * access.  Hide the devices we drive, lest vioif attach to them.
+ */
+int rumpcomp_pci_claimed(unsigned, unsigned, unsigned);
+int
+rumpcomp_pci_claimed(unsigned bus, unsigned dev, unsigned fun)
+{
+
+	return isvionet(bus, dev, fun);
+}
+
+/* find the devnum'th virtio-net device */
+static int
+findvionet(int devnum, unsigned *busp, unsigned *devp, unsigned *funp)
+{
+	unsigned bus, dev, fun;
+
+	for (bus = 0; bus < 256; bus++) {
+		for (dev = 0; dev < 32; dev++) {
+			for (fun = 0; fun < 8; fun++) {
+				if ((bmk_pci_confread(bus, dev, fun,
+				    PCI_ID_REG) & 0xffff) == 0xffff) {
+					if (fun == 0)
+						break;
+					continue;
+				}
+				if (isvionet(bus, dev, fun) && devnum-- == 0) {
+					*busp = bus;
+					*devp = dev;
+					*funp = fun;
+					return 0;
+				}
+				if (fun == 0 && (bmk_pci_confread(bus, dev, 0,
+				    PCI_BHLC_REG) & PCI_BHLC_MULTIFN) == 0)
+					break;
+			}
+		}
+	}
+
+	return BMK_ENXIO;
+}
+
+static int
+pgorder(unsigned long size)
+{
+	int order;
+
+	for (order = 0; (BMK_PCPU_PAGE_SIZE << order) < size; order++)
+		continue;
+	return order;
+}
+
+/*
+ * Make the ring entries added since the last call visible to the
+ * device, and kick it if it wants to be kicked.
+ */
+static void
+vq_publish(struct vq *vq)
+{
+	struct virtif_user *viu = vq->vq_viu;
+	uint16_t old = vq->vq_pubidx, new = vq->vq_availidx;
+	int kick;
+
+	if (old == new)
+		return;
+
+	/* descriptors and ring entries before the index (x86: stores) */
+	barrier();
+	vq->vq_avail->idx = new;
+	vq->vq_pubidx = new;
+
+	/* index before reading whether the device wants a kick */
+	membar();
+	if (viu->viu_features & VIRTIO_F_RING_EVENT_IDX)
+		kick = VRING_NEED_EVENT(*vq->vq_availevent, new, old);
+	else
+		kick = (vq->vq_used->flags & VRING_USED_F_NO_NOTIFY) == 0;
+	if (kick)
+		outw(viu->viu_iobase + VIRTIO_PCI_QNOTIFY, vq->vq_index);
+}
+
+static int
+vq_init(struct virtif_user *viu, struct vq *vq, int index, int pair,
+	int vector)
+{
+	unsigned iobase = viu->viu_iobase;
+	char *mem;
+	int i;
+
+	outw(iobase + VIRTIO_PCI_QSEL, index);
+	if ((vq->vq_num = inw(iobase + VIRTIO_PCI_QSIZE)) == 0)
+		return BMK_ENXIO;
+
+	vq->vq_memorder = pgorder(VRING_SIZE(vq->vq_num));
+	if ((mem = bmk_pgalloc(vq->vq_memorder)) == NULL)
+		return BMK_ENOMEM;
+	bmk_memset(mem, 0, BMK_PCPU_PAGE_SIZE << vq->vq_memorder);
+
+	vq->vq_viu = viu;
+	vq->vq_index = index;
+	vq->vq_pair = pair;
+	vq->vq_mem = mem;
+	vq->vq_desc = (void *)mem;
+	vq->vq_avail = (void *)(mem + VRING_AVAIL_OFF(vq->vq_num));
+	vq->vq_used = (void *)(mem + VRING_USED_OFF(vq->vq_num));
+	vq->vq_usedevent = &vq->vq_avail->ring[vq->vq_num];
+	vq->vq_availevent = (volatile uint16_t *)&vq->vq_used->ring[vq->vq_num];
+
+	for (i = 0; i < vq->vq_num; i++)
+		vq->vq_desc[i].next = i+1;
+	vq->vq_freehead = 0;
+	vq->vq_nfree = vq->vq_num;
+
+	outl(iobase + VIRTIO_PCI_QADDR,
+	    VTOPHYS(mem) >> VIRTIO_PCI_QADDR_SHIFT);
+	if (viu->viu_msix) {
+		outw(iobase + VIRTIO_PCI_QVEC, vector);
+		if (inw(iobase + VIRTIO_PCI_QVEC) != vector)
+			return BMK_ENXIO;
+	}
+
+	return 0;
+}
+
+static void
+vq_free(struct vq *vq)
+{
+
+	if (vq->vq_mem)
+		bmk_pgfree(vq->vq_mem, vq->vq_memorder);
+	if (vq->vq_rxbuf)
+		bmk_pgfree(vq->vq_rxbuf, vq->vq_rxorder);
+	if (vq->vq_txhdr)
+		bmk_memfree(vq->vq_txhdr, BMK_MEMWHO_RUMPKERN);
+	if (vq->vq_txcookie)
+		bmk_memfree(vq->vq_txcookie, BMK_MEMWHO_RUMPKERN);
+	vq->vq_mem = vq->vq_rxbuf = NULL;
+	vq->vq_txhdr = NULL;
+	vq->vq_txcookie = NULL;
+}
+
+static int
+rxq_init(struct vq *vq)
+{
+	int i;
+
+	vq->vq_rxorder = pgorder((unsigned long)vq->vq_num * VIONET_RXBUFSZ);
+	if ((vq->vq_rxbuf = bmk_pgalloc(vq->vq_rxorder)) == NULL)
+		return BMK_ENOMEM;
+
+	for (i = 0; i < vq->vq_num; i++) {
+		vq->vq_desc[i].addr = VTOPHYS(vq->vq_rxbuf + i*VIONET_RXBUFSZ);
+		vq->vq_desc[i].len = VIONET_RXBUFSZ;
+		vq->vq_desc[i].flags = VRING_DESC_F_WRITE;
+		vq->vq_avail->ring[i] = i;
+	}
+	vq->vq_availidx = vq->vq_num;
+	vq->vq_nfree = 0;
+
+	return 0;
+}
+
+static int
+txq_init(struct vq *vq)
+{
+
+	vq->vq_txhdr = bmk_memcalloc(vq->vq_num, sizeof(*vq->vq_txhdr),
+	    BMK_MEMWHO_RUMPKERN);
+	vq->vq_txcookie = bmk_memcalloc(vq->vq_num, sizeof(void *),
+	    BMK_MEMWHO_RUMPKERN);
+	if (vq->vq_txhdr == NULL || vq->vq_txcookie == NULL)
+		return BMK_ENOMEM;
+
+	/* we never want TX completion interrupts */
+	vq->vq_avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+	*vq->vq_usedevent = vq->vq_lastused - 1;
+
+	return 0;
+}
+
+/*
+ * Return transmitted packets to the rump kernel.  Must be called
+ * with the rump kernel scheduled.  Frames sent from a raw frame ring
+ * free their slots instead.  Those come back in order, and once none
+ * are in flight, so are the slots of frames which were refused.
+ */
+static void
+txq_reclaim(struct vq *vq)
+{
+	struct virtif_user *viu = vq->vq_viu;
+	struct netring_q *nq;
+	uint16_t usedidx, head, idx, n;
+	void *cookie;
+
+	usedidx = vq->vq_used->idx;
+	barrier();
+	while (vq->vq_lastused != usedidx) {
+		head = vq->vq_used->ring[vq->vq_lastused % vq->vq_num].id;
+		vq->vq_lastused++;
+
+		for (idx = head, n = 1;
+		    vq->vq_desc[idx].flags & VRING_DESC_F_NEXT;
+		    idx = vq->vq_desc[idx].next)
+			n++;
+		vq->vq_desc[idx].next = vq->vq_freehead;
+		vq->vq_freehead = head;
+		vq->vq_nfree += n;
+
+		cookie = vq->vq_txcookie[head];
+		vq->vq_txcookie[head] = NULL;
+		if (NETRING_ISCOOKIE(cookie)) {
+			nq = &viu->viu_netif->ni_q[vq->vq_pair];
+			nq->nq_txdone += NETRING_COOKIE_NSLOTS(cookie);
+			if (--nq->nq_txbusy == 0)
+				nq->nq_txdone = nq->nq_txsent;
+			continue;
+		}
+		rump_virtif_txdone(viu->viu_vifsc, cookie);
+	}
+	*vq->vq_usedevent = vq->vq_lastused - 1;
+}
+
+/*
+ * Give the next n used RX buffers back to the device.  They become
+ * visible to it with the next vq_publish().
+ */
+static void
+rxq_recycle(struct vq *vq, int n)
+{
+	volatile struct vring_used_elem *ue;
+
+	while (n-- > 0) {
+		ue = &vq->vq_used->ring[vq->vq_lastused++ % vq->vq_num];
+		vq->vq_avail->ring[vq->vq_availidx++ % vq->vq_num] = ue->id;
+	}
+}
+
+/*
+ * Number of buffers the frame at the head of the used ring takes,
+ * of the navail the device has returned.  If the frame is too short
+ * for the header, or claims more buffers than there are, there's no
+ * telling where the next frame starts, so the frame is bad and takes
+ * everything there is.  Returns nonzero for a bad frame.
+ */
+static int
+rxq_nbufs(struct vq *vq, uint16_t navail, int *nbufsp)
+{
+	struct virtif_user *viu = vq->vq_viu;
+	volatile struct vring_used_elem *ue;
+	struct virtio_net_hdr *hdr;
+	int nbufs;
+
+	ue = &vq->vq_used->ring[vq->vq_lastused % vq->vq_num];
+	hdr = (void *)(vq->vq_rxbuf + ue->id*VIONET_RXBUFSZ);
+
+	*nbufsp = 1;
+	if (ue->len < (unsigned)viu->viu_hdrlen) {
+		if (viu->viu_features & VIRTIO_NET_F_MRG_RXBUF)
+			*nbufsp = navail;
+		return 1;
+	}
+	if (viu->viu_features & VIRTIO_NET_F_MRG_RXBUF) {
+		nbufs = hdr->num_buffers;
+		if (nbufs < 1 || nbufs > navail) {
+			*nbufsp = navail;
+			return 1;
+		}
+		*nbufsp = nbufs;
+	}
+	return 0;
+}
+
+/*
+ * Pass received packets to the rump kernel and give the buffers
+ * back to the device.  Must be called with the rump kernel scheduled.
+ * Returns nonzero if there were packets.
+ */
+static int
+rxq_process(struct vq *vq)
+{
+	struct virtif_user *viu = vq->vq_viu;
+	struct iovec iov[VIONET_MAXRXSEG];
+	struct virtio_net_hdr *hdr;
+	volatile struct vring_used_elem *ue;
+	uint16_t usedidx;
+	int i, nbufs, flags, work = 0;
+
+ again:
+	usedidx = vq->vq_used->idx;
+	barrier();
+	while (vq->vq_lastused != usedidx) {
+		work = 1;
+		/* bad, or larger than any frame we'd send */
+		if (rxq_nbufs(vq, usedidx - vq->vq_lastused, &nbufs) != 0
+		    || nbufs > VIONET_MAXRXSEG) {
+			rxq_recycle(vq, nbufs);
+			rump_virtif_pkterror(viu->viu_vifsc, 1);
+			continue;
+		}
+
+		for (i = 0; i < nbufs; i++) {
+			ue = &vq->vq_used->ring[(uint16_t)(vq->vq_lastused + i)
+			    % vq->vq_num];
+			iov[i].iov_base = vq->vq_rxbuf + ue->id*VIONET_RXBUFSZ;
+			iov[i].iov_len = ue->len;
+		}
+		hdr = iov[0].iov_base;
+		iov[0].iov_base = (char *)hdr + viu->viu_hdrlen;
+		iov[0].iov_len -= viu->viu_hdrlen;
+
+		flags = 0;
+		if (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
+			flags |= VIF_RX_CSUMBLANK;
+		else if (hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID)
+			flags |= VIF_RX_CSUMOK;
+
+		/* only made visible to the device after delivery */
+		rxq_recycle(vq, nbufs);
+		if (rump_virtif_pktroom(viu->viu_vifsc) == 0)
+			rump_virtif_pktflush(viu->viu_vifsc);
+		rump_virtif_pktdeliver(viu->viu_vifsc, iov, nbufs, flags);
+	}
+	vq_publish(vq);
+	rump_virtif_pktflush(viu->viu_vifsc);
+
+	/* re-arm the interrupt, and check we didn't miss anything */
+	*vq->vq_usedevent = vq->vq_lastused;
+	membar();
+	if (vq->vq_used->idx != vq->vq_lastused)
+		goto again;
+
+	return work;
+}
+
+/* MSI-X: one interrupt per RX queue */
+static int
+vionet_rxintr(void *arg)
+{
+	struct vq *vq = arg;
+	struct virtif_user *viu = vq->vq_viu;
+	struct bmk_thread *waiter;
+
+	if (!viu->viu_running)
+		return 0;
+
+	txq_reclaim(&viu->viu_txq[vq->vq_pair]);
+
+	/* with the raw frame rings open, the application receives */
+	if (viu->viu_netif) {
+		waiter = viu->viu_netif->ni_q[vq->vq_pair].nq_waiter;
+		if (waiter)
+			bmk_sched_wake(waiter);
+		return 0;
+	}
+	return rxq_process(vq);
+}
+
+/* INTx: one interrupt for everything */
+static int
+vionet_intr(void *arg)
+{
+	struct virtif_user *viu = arg;
+	int i, work = 0;
+
+	/* reading the ISR acks the interrupt */
+	(void)inb(viu->viu_iobase + VIRTIO_PCI_ISR);
+	if (!viu->viu_running)
+		return 0;
+
+	for (i = 0; i < viu->viu_npairs; i++)
+		work |= vionet_rxintr(&viu->viu_rxq[i]);
+	return work;
+}
+
+/*
+ * Execute a command on the control queue.  Called only during
+ * attach, so just poll for the completion.
+ */
+static int
+vionet_ctrl(struct virtif_user *viu, uint8_t class, uint8_t cmd,
+	uint16_t data)
+{
+	struct vq *vq = &viu->viu_ctrlq;
+	struct vring_desc *d = vq->vq_desc;
+	bmk_time_t deadline;
+
+	viu->viu_ctrl.class = class;
+	viu->viu_ctrl.cmd = cmd;
+	viu->viu_ctrl.data = data;
+	viu->viu_ctrl.ack = 0xff;
+
+	d[0].addr = VTOPHYS(&viu->viu_ctrl.class);
+	d[0].len = 2;
+	d[0].flags = VRING_DESC_F_NEXT;
+	d[0].next = 1;
+	d[1].addr = VTOPHYS(&viu->viu_ctrl.data);
+	d[1].len = sizeof(viu->viu_ctrl.data);
+	d[1].flags = VRING_DESC_F_NEXT;
+	d[1].next = 2;
+	d[2].addr = VTOPHYS(&viu->viu_ctrl.ack);
+	d[2].len = sizeof(viu->viu_ctrl.ack);
+	d[2].flags = VRING_DESC_F_WRITE;
+
+	vq->vq_avail->ring[vq->vq_availidx++ % vq->vq_num] = 0;
+	vq_publish(vq);
+
+	deadline = bmk_platform_cpu_clock_monotonic() + VIONET_CTRLWAIT;
+	while (vq->vq_used->idx == vq->vq_lastused) {
+		if (bmk_platform_cpu_clock_monotonic() > deadline)
+			return BMK_ETIMEDOUT;
+		bmk_sched_yield();
+	}
+	vq->vq_lastused++;
+	barrier();
+
+	return viu->viu_ctrl.ack == VIRTIO_NET_OK ? 0 : BMK_EIO;
+}
+
+static int
+vionet_attach(struct virtif_user *viu, uint8_t *enaddr, int *capsp)
+{
+	unsigned bus = viu->viu_bus, dev = viu->viu_dev, fun = viu->viu_fun;
+	unsigned iobase;
+	uint32_t bar, cmd, hostfeat, feat;
+	int i, nvec, npairs, error;
+
+	bar = bmk_pci_confread(bus, dev, fun, PCI_BAR0);
+	if ((bar & PCI_BAR_IO) == 0)
+		return BMK_ENXIO;
+	iobase = viu->viu_iobase = bar & ~0x3;
+	cmd = bmk_pci_confread(bus, dev, fun, PCI_COMMAND);
+	bmk_pci_confwrite(bus, dev, fun, PCI_COMMAND,
+	    (cmd | PCI_COMMAND_IO | PCI_COMMAND_MASTER) & 0xffff);
+
+	outb(iobase + VIRTIO_PCI_STATUS, 0);
+	outb(iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK);
+	outb(iobase + VIRTIO_PCI_STATUS,
+	    VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER);
+
+	hostfeat = inl(iobase + VIRTIO_PCI_HOSTFEAT);
+	feat = hostfeat & VIONET_FEATURES;
+	if ((feat & VIRTIO_NET_F_CSUM) == 0)
+		feat &= ~VIRTIO_NET_F_HOST_TSO4;
+	if ((feat & VIRTIO_NET_F_CTRL_VQ) == 0)
+		feat &= ~VIRTIO_NET_F_MQ;
+	viu->viu_features = feat;
+	viu->viu_hdrlen = (feat & VIRTIO_NET_F_MRG_RXBUF)
+	    ? VIRTIO_NET_HDR_LEN_MRG : VIRTIO_NET_HDR_LEN;
+
+	/* device config moves when MSI-X is enabled, so read it first */
+	if (feat & VIRTIO_NET_F_MAC) {
+		for (i = 0; i < 6; i++)
+			enaddr[i] = inb(iobase + VIRTIO_PCI_CONFIG(0)
+			    + VIRTIO_NET_CONFIG_MAC + i);
+	}
+	viu->viu_maxpairs = 1;
+	if (feat & VIRTIO_NET_F_MQ)
+		viu->viu_maxpairs = inw(iobase + VIRTIO_PCI_CONFIG(0)
+		    + VIRTIO_NET_CONFIG_MAXPAIRS);
+	npairs = viu->viu_maxpairs;
+	if (npairs > VIONET_MAXPAIRS)
+		npairs = VIONET_MAXPAIRS;
+
+	/*
+	 * Interrupts.  Multiple queue pairs are only worth it if each
+	 * RX queue gets its own vector.
+	 */
+	nvec = bmk_pci_msix_nvec(bus, dev, fun);
+	if (npairs > nvec)
+		npairs = nvec > 0 ? nvec : 1;
+	for (i = 0; i < npairs && nvec > 0; i++) {
+		if (bmk_pci_msix_establish(bus, dev, fun, i, vionet_rxintr,
+		    &viu->viu_rxq[i], BMK_INTR_MITIGATE) != 0)
+			break;
+		viu->viu_msix = 1;
+		viu->viu_intr = 1;
+	}
+	if (viu->viu_msix) {
+		npairs = i;
+		outw(iobase + VIRTIO_PCI_CONFVEC, VIRTIO_MSI_NO_VECTOR);
+	} else {
+		npairs = 1;
+		bmk_isr_rumpkernel(vionet_intr, viu,
+		    bmk_pci_confread(bus, dev, fun, PCI_INTR_REG) & 0xff,
+		    BMK_INTR_ROUTED | BMK_INTR_MITIGATE);
+		viu->viu_intr = 1;
+	}
+	viu->viu_npairs = npairs;
+
+	outl(iobase + VIRTIO_PCI_GUESTFEAT, feat);
+
+	for (i = 0; i < npairs; i++) {
+		if ((error = vq_init(viu, &viu->viu_rxq[i], 2*i, i,
+		    viu->viu_msix ? i : VIRTIO_MSI_NO_VECTOR)) != 0
+		  || (error = rxq_init(&viu->viu_rxq[i])) != 0)
+			goto fail;
+		if ((error = vq_init(viu, &viu->viu_txq[i], 2*i+1, i,
+		    VIRTIO_MSI_NO_VECTOR)) != 0
+		  || (error = txq_init(&viu->viu_txq[i])) != 0)
+			goto fail;
+	}
+	if (feat & VIRTIO_NET_F_CTRL_VQ) {
+		if ((error = vq_init(viu, &viu->viu_ctrlq,
+		    2*viu->viu_maxpairs, 0, VIRTIO_MSI_NO_VECTOR)) != 0)
+			goto fail;
+	}
+
+	outb(iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACK
+	    | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+	for (i = 0; i < npairs; i++)
+		vq_publish(&viu->viu_rxq[i]);
+
+	/* the device starts out using only the first pair */
+	if (npairs > 1 && vionet_ctrl(viu, VIRTIO_NET_CTRL_MQ,
+	    VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET, npairs) != 0) {
+		bmk_printf("vionet: failed to enable %d queue pairs\n", npairs);
+		viu->viu_npairs = 1;
+	}
+	viu->viu_running = 1;
+
+	*capsp = 0;
+	if (feat & VIRTIO_NET_F_CSUM)
+		*capsp |= VIF_CAP_CSUM;
+	if (feat & VIRTIO_NET_F_HOST_TSO4)
+		*capsp |= VIF_CAP_TSO4;
+	if (feat & VIRTIO_NET_F_GUEST_CSUM)
+		*capsp |= VIF_CAP_RXCSUM;
+
+	bmk_printf("vionet: pci %u:%u:%u, %d queue pair%s, %s, "
+	    "features 0x%x\n", bus, dev, fun, viu->viu_npairs,
+	    viu->viu_npairs == 1 ? "" : "s",
+	    viu->viu_msix ? "MSI-X" : "INTx", feat);
+	return 0;
+
+ fail:
+	/* stop the device before it loses its rings */
+	outb(iobase + VIRTIO_PCI_STATUS, 0);
+	outb(iobase + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+	for (i = 0; i < VIONET_MAXPAIRS; i++) {
+		vq_free(&viu->viu_rxq[i]);
+		vq_free(&viu->viu_txq[i]);
+	}
+	vq_free(&viu->viu_ctrlq);
+	return error;
+}
+
+int
+VIFHYPER_CREATE(int devnum, struct virtif_sc *vif_sc, uint8_t *enaddr,
+	int *capsp, struct virtif_user **viup)
+{
+	struct virtif_user *viu = NULL;
+	int rv, nlocks;
+
+	rumpkern_unsched(&nlocks, NULL);
+
+	viu = bmk_memcalloc(1, sizeof(*viu), BMK_MEMWHO_RUMPKERN);
+	if (viu == NULL) {
+		rv = BMK_ENOMEM;
+		goto out;
+	}
+	viu->viu_vifsc = vif_sc;
+	viu->viu_unit = devnum;
+
+	if ((rv = findvionet(devnum,
+	    &viu->viu_bus, &viu->viu_dev, &viu->viu_fun)) != 0) {
+		bmk_memfree(viu, BMK_MEMWHO_RUMPKERN);
+		goto out;
+	}
+	rv = vionet_attach(viu, enaddr, capsp);
+	if (rv == 0) {
+		viu->viu_next = viulist;
+		viulist = viu;
+	} else if (!viu->viu_intr) {
+		/* else the handlers still look at it, see VIFHYPER_DESTROY */
+		bmk_memfree(viu, BMK_MEMWHO_RUMPKERN);
+		viu = NULL;
+	}
+
+ out:
+	rumpkern_sched(nlocks, NULL);
+
+	*viup = viu;
+	return rv;
+}
+
+void
+VIFHYPER_SEND(struct virtif_user *viu, struct iovec *iov, size_t iovlen,
+	const struct virtif_txinfo *vt, void *cookie)
+{
+	struct virtio_net_hdr *hdr;
+	struct vring_desc *d;
+	struct vq *vq;
+	uint16_t head, idx, prev;
+	size_t i;
+	int nlocks;
+
+	/* dropped if the application has the interface */
+	vq = &viu->viu_txq[vt->vt_flowhash % viu->viu_npairs];
+	if (!viu->viu_running || viu->viu_netif || iovlen+1 > vq->vq_num) {
+		rump_virtif_txdone(viu->viu_vifsc, cookie);
+		return;
+	}
+
+	/*
+	 * If the ring is full, the host is behind.  There's no
+	 * interrupt telling when it catches up, so poll.
+	 */
+	while (vq->vq_nfree < iovlen+1) {
+		txq_reclaim(vq);
+		if (vq->vq_nfree >= iovlen+1)
+			break;
+
+		rumpkern_unsched(&nlocks, NULL);
+		bmk_sched_blockprepare_timeout(
+		    bmk_platform_cpu_clock_monotonic() + VIONET_TXWAIT);
+		bmk_sched_block();
+		rumpkern_sched(nlocks, NULL);
+	}
+
+	head = vq->vq_freehead;
+	hdr = &vq->vq_txhdr[head];
+	bmk_memset(hdr, 0, sizeof(*hdr));
+	if (vt->vt_flags & VIF_TX_CSUM) {
+		hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+		hdr->csum_start = vt->vt_csumstart;
+		hdr->csum_offset = vt->vt_csumoff;
+	}
+	if (vt->vt_flags & VIF_TX_TSO4) {
+		hdr->gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+		hdr->gso_size = vt->vt_mss;
+		hdr->hdr_len = vt->vt_hdrlen;
+	}
+
+	d = &vq->vq_desc[head];
+	d->addr = VTOPHYS(hdr);
+	d->len = viu->viu_hdrlen;
+	d->flags = VRING_DESC_F_NEXT;
+	prev = head;
+	idx = d->next;
+	for (i = 0; i < iovlen; i++) {
+		d = &vq->vq_desc[idx];
+		d->addr = VTOPHYS(iov[i].iov_base);
+		d->len = iov[i].iov_len;
+		d->flags = VRING_DESC_F_NEXT;
+		prev = idx;
+		idx = d->next;
+	}
+	vq->vq_desc[prev].flags = 0;
+	vq->vq_freehead = idx;
+	vq->vq_nfree -= iovlen+1;
+
+	vq->vq_txcookie[head] = cookie;
+	vq->vq_avail->ring[vq->vq_availidx++ % vq->vq_num] = head;
+	vq_publish(vq);
+}
+
+/*
+ * VIFHYPER_SEND() hands each packet to the device right away, since
+ * it may have to wait for the device to make room.
+ */
+void
+VIFHYPER_FLUSH(struct virtif_user *viu)
+{
+}
+
+/* never called, received frames are always copied */
+void
+VIFHYPER_RXDONE(void *cookie, void *data)
+{
+}
+
+void
+VIFHYPER_DYING(struct virtif_user *viu)
+{
+
+	viu->viu_running = 0;
+}
+
+/*
+ * Interrupt handlers can't be removed, so the memory stays around.
+ * So do the raw frame rings, which the application should have
+ * closed.
+ */
+void
+VIFHYPER_DESTROY(struct virtif_user *viu)
+{
+	struct virtif_user **viup;
+	struct vq *vq;
+	int i, j;
+
+	for (viup = &viulist; *viup != viu; viup = &(*viup)->viu_next)
+		continue;
+	*viup = viu->viu_next;
+
+	outb(viu->viu_iobase + VIRTIO_PCI_STATUS, 0);
+
+	for (i = 0; i < viu->viu_npairs; i++) {
+		vq = &viu->viu_txq[i];
+		for (j = 0; j < vq->vq_num; j++) {
+			if (vq->vq_txcookie[j] == NULL
+			    || NETRING_ISCOOKIE(vq->vq_txcookie[j]))
+				continue;
+			rump_virtif_txdone(viu->viu_vifsc, vq->vq_txcookie[j]);
+			vq->vq_txcookie[j] = NULL;
+		}
+	}
+}
+
+/*
+ * The raw frame rings, see <rumprun/netring.h>.  A ring per virtqueue,
+ * with as many slots.  RX slots hold the descriptors of the frames in
+ * them until released, TX slots have buffers of VIONET_RXBUFSZ.
+ * The RX interrupt only wakes up the application while the rings
+ * are open.
+ *
+ * XXX: unlike the xenif rings, which platform/xen/tests/netring runs
+ * against a mock backend, this code has not been run: there is no
+ * virtio mock, and no test in tests/ opens the rings.
+ */
+
+static void
+netring_free(struct rumprun_netif *ni)
+{
+	struct netring_q *nq;
+	int i;
+
+	for (i = 0; i < ni->ni_nrings; i++) {
+		nq = &ni->ni_q[i];
+		if (nq->nq_rx.nr_slot)
+			bmk_memfree(nq->nq_rx.nr_slot, BMK_MEMWHO_RUMPKERN);
+		if (nq->nq_tx.nr_slot)
+			bmk_memfree(nq->nq_tx.nr_slot, BMK_MEMWHO_RUMPKERN);
+		if (nq->nq_rxid)
+			bmk_memfree(nq->nq_rxid, BMK_MEMWHO_RUMPKERN);
+		if (nq->nq_txbuf)
+			bmk_pgfree(nq->nq_txbuf, nq->nq_txorder);
+	}
+	bmk_memfree(ni, BMK_MEMWHO_RUMPKERN);
+}
+
+static int
+netring_init(struct rumprun_netif *ni, int ring)
+{
+	struct virtif_user *viu = ni->ni_viu;
+	struct netring_q *nq = &ni->ni_q[ring];
+	struct rumprun_netring *rx = &nq->nq_rx, *tx = &nq->nq_tx;
+	unsigned int i;
+
+	rx->nr_num = viu->viu_rxq[ring].vq_num;
+	rx->nr_bufsize = VIONET_RXBUFSZ;
+	tx->nr_num = tx->nr_tail = viu->viu_txq[ring].vq_num;
+	tx->nr_bufsize = VIONET_RXBUFSZ;
+
+	rx->nr_slot = bmk_memcalloc(rx->nr_num, sizeof(*rx->nr_slot),
+	    BMK_MEMWHO_RUMPKERN);
+	tx->nr_slot = bmk_memcalloc(tx->nr_num, sizeof(*tx->nr_slot),
+	    BMK_MEMWHO_RUMPKERN);
+	nq->nq_rxid = bmk_memcalloc(rx->nr_num, sizeof(*nq->nq_rxid),
+	    BMK_MEMWHO_RUMPKERN);
+	nq->nq_txorder = pgorder((unsigned long)tx->nr_num * VIONET_RXBUFSZ);
+	nq->nq_txbuf = bmk_pgalloc(nq->nq_txorder);
+	if (rx->nr_slot == NULL || tx->nr_slot == NULL
+	    || nq->nq_rxid == NULL || nq->nq_txbuf == NULL)
+		return BMK_ENOMEM;
+
+	for (i = 0; i < tx->nr_num; i++)
+		tx->nr_slot[i].ns_buf = nq->nq_txbuf + i*VIONET_RXBUFSZ;
+
+	return 0;
+}
+
+int
+rumprun_netring_open(int unit, struct rumprun_netif **nip)
+{
+	struct virtif_user *viu;
+	struct rumprun_netif *ni;
+	int i, rv;
+
+	for (viu = viulist; viu; viu = viu->viu_next)
+		if (viu->viu_unit == unit && viu->viu_running)
+			break;
+	if (viu == NULL)
+		return BMK_ENXIO;
+	if (viu->viu_netif)
+		return BMK_EBUSY;
+
+	ni = bmk_memcalloc(1, sizeof(*ni), BMK_MEMWHO_RUMPKERN);
+	if (ni == NULL)
+		return BMK_ENOMEM;
+	ni->ni_viu = viu;
+	ni->ni_nrings = viu->viu_npairs;
+	for (i = 0; i < ni->ni_nrings; i++) {
+		if ((rv = netring_init(ni, i)) != 0) {
+			netring_free(ni);
+			return rv;
+		}
+	}
+
+	viu->viu_netif = ni;
+	*nip = ni;
+	return 0;
+}
+
+/*
+ * Wait for the frames in flight, give the device back the buffers
+ * of the frames still in the RX rings, and give the interface back
+ * to the stack.
+ */
+void
+rumprun_netring_close(struct rumprun_netif *ni)
+{
+	struct virtif_user *viu = ni->ni_viu;
+	struct netring_q *nq;
+	struct vq *vq;
+	int i;
+
+	for (i = 0; i < ni->ni_nrings; i++) {
+		nq = &ni->ni_q[i];
+		while (nq->nq_txbusy) {
+			rumpuser__hyp.hyp_schedule();
+			txq_reclaim(&viu->viu_txq[i]);
+			rumpuser__hyp.hyp_unschedule();
+			if (nq->nq_txbusy)
+				bmk_sched_yield();
+		}
+
+		vq = &viu->viu_rxq[i];
+		for (; nq->nq_rxrel != nq->nq_rx.nr_tail; nq->nq_rxrel++) {
+			vq->vq_avail->ring[vq->vq_availidx++ % vq->vq_num]
+			    = nq->nq_rxid[nq->nq_rxrel & (nq->nq_rx.nr_num-1)];
+		}
+		vq_publish(vq);
+	}
+	viu->viu_netif = NULL;
+	netring_free(ni);
+}
+
+int
+rumprun_netring_nrings(struct rumprun_netif *ni)
+{
+
+	return ni->ni_nrings;
+}
+
+struct rumprun_netring *
+rumprun_netring_rx(struct rumprun_netif *ni, int ring)
+{
+
+	return &ni->ni_q[ring].nq_rx;
+}
+
+struct rumprun_netring *
+rumprun_netring_tx(struct rumprun_netif *ni, int ring)
+{
+
+	return &ni->ni_q[ring].nq_tx;
+}
+
+/*
+ * Give the device back the buffers of the released slots, and put
+ * the frames it has received in the free ones.  A frame in buffers
+ * merged by the device takes a slot per buffer.  Returns the number
+ * of slots holding frames.
+ */
+int
+rumprun_netring_rxsync(struct rumprun_netif *ni, int ring)
+{
+	struct virtif_user *viu = ni->ni_viu;
+	struct netring_q *nq = &ni->ni_q[ring];
+	struct rumprun_netring *r = &nq->nq_rx;
+	struct rumprun_netring_slot *slot;
+	struct vq *vq = &viu->viu_rxq[ring];
+	struct virtio_net_hdr *hdr;
+	volatile struct vring_used_elem *ue;
+	uint16_t usedidx;
+	unsigned int idx;
+	int i, nbufs, flags;
+
+	for (; nq->nq_rxrel != r->nr_head; nq->nq_rxrel++) {
+		vq->vq_avail->ring[vq->vq_availidx++ % vq->vq_num]
+		    = nq->nq_rxid[nq->nq_rxrel & (r->nr_num-1)];
+	}
+
+	usedidx = vq->vq_used->idx;
+	barrier();
+	while (vq->vq_lastused != usedidx) {
+		/* bad frames go straight back to the device */
+		if (rxq_nbufs(vq, usedidx - vq->vq_lastused, &nbufs) != 0) {
+			rxq_recycle(vq, nbufs);
+			ni->ni_rxdrop++;
+			continue;
+		}
+		if (r->nr_num - (r->nr_tail - r->nr_head) < (unsigned)nbufs)
+			break;
+
+		ue = &vq->vq_used->ring[vq->vq_lastused % vq->vq_num];
+		hdr = (void *)(vq->vq_rxbuf + ue->id*VIONET_RXBUFSZ);
+		flags = 0;
+		if (hdr->flags
+		    & (VIRTIO_NET_HDR_F_DATA_VALID|VIRTIO_NET_HDR_F_NEEDS_CSUM))
+			flags |= NETRING_F_CSUMOK;
+		for (i = 0; i < nbufs; i++) {
+			ue = &vq->vq_used->ring[vq->vq_lastused++ % vq->vq_num];
+			idx = r->nr_tail++ & (r->nr_num-1);
+			slot = &r->nr_slot[idx];
+			slot->ns_buf = vq->vq_rxbuf + ue->id*VIONET_RXBUFSZ;
+			slot->ns_len = ue->len;
+			if (i == 0) {
+				slot->ns_buf = (char *)slot->ns_buf
+				    + viu->viu_hdrlen;
+				slot->ns_len -= viu->viu_hdrlen;
+			}
+			slot->ns_flags = flags;
+			if (i < nbufs-1)
+				slot->ns_flags |= NETRING_F_MORE;
+			nq->nq_rxid[idx] = ue->id;
+		}
+	}
+	vq_publish(vq);
+
+	/* interrupt for the next one, see rumprun_netring_wait() */
+	*vq->vq_usedevent = vq->vq_lastused;
+	membar();
+
+	return r->nr_tail - r->nr_head;
+}
+
+/*
+ * Send the complete frames the application has added, as long as
+ * there are descriptors for them, and free the slots of the ones the
+ * device is done with.  Returns the number of free slots.
+ */
+int
+rumprun_netring_txsync(struct rumprun_netif *ni, int ring)
+{
+	struct virtif_user *viu = ni->ni_viu;
+	struct netring_q *nq = &ni->ni_q[ring];
+	struct rumprun_netring *r = &nq->nq_tx;
+	struct rumprun_netring_slot *slot;
+	struct vq *vq = &viu->viu_txq[ring];
+	struct vring_desc *d;
+	unsigned int idx, first;
+	uint16_t head, didx, prev;
+	int n, more;
+
+	rumpuser__hyp.hyp_schedule();
+	txq_reclaim(vq);
+	rumpuser__hyp.hyp_unschedule();
+
+	for (;;) {
+		for (idx = nq->nq_txsent, n = 0, more = 1;
+		    more && idx != r->nr_head; n++) {
+			slot = &r->nr_slot[idx++ & (r->nr_num-1)];
+			more = slot->ns_flags & NETRING_F_MORE;
+		}
+		/* nothing, or the rest of the frame is still to come */
+		if (n == 0 || more)
+			break;
+
+		if (n+1 > vq->vq_num) {
+			nq->nq_txsent = idx;
+			ni->ni_txerr++;
+			if (nq->nq_txbusy == 0)
+				nq->nq_txdone = nq->nq_txsent;
+			continue;
+		}
+		if (vq->vq_nfree < n+1)
+			break;
+
+		head = vq->vq_freehead;
+		bmk_memset(&vq->vq_txhdr[head], 0, sizeof(vq->vq_txhdr[head]));
+		d = &vq->vq_desc[head];
+		d->addr = VTOPHYS(&vq->vq_txhdr[head]);
+		d->len = viu->viu_hdrlen;
+		d->flags = VRING_DESC_F_NEXT;
+		prev = head;
+		didx = d->next;
+		for (; nq->nq_txsent != idx; nq->nq_txsent++) {
+			slot = &r->nr_slot[nq->nq_txsent & (r->nr_num-1)];
+			d = &vq->vq_desc[didx];
+			d->addr = VTOPHYS(slot->ns_buf);
+			d->len = slot->ns_len;
+			d->flags = VRING_DESC_F_NEXT;
+			prev = didx;
+			didx = d->next;
+		}
+		vq->vq_desc[prev].flags = 0;
+		vq->vq_freehead = didx;
+		vq->vq_nfree -= n+1;
+
+		vq->vq_txcookie[head] = NETRING_COOKIE(n);
+		vq->vq_avail->ring[vq->vq_availidx++ % vq->vq_num] = head;
+		nq->nq_txbusy++;
+	}
+	vq_publish(vq);
+
+	/* the slots come back with their own buffers */
+	for (first = r->nr_tail - r->nr_num; first != nq->nq_txdone; first++) {
+		idx = first & (r->nr_num-1);
+		r->nr_slot[idx].ns_buf = nq->nq_txbuf + idx*VIONET_RXBUFSZ;
+	}
+	r->nr_tail = nq->nq_txdone + r->nr_num;
+
+	return r->nr_tail - r->nr_head;
+}
+
+/*
+ * Block until the device has received something for the ring.
+ * Wakeups may be spurious.  There are no TX completion interrupts,
+ * so frames in flight are reaped by rumprun_netring_txsync().
+ */
+void
+rumprun_netring_wait(struct rumprun_netif *ni, int ring)
+{
+	struct virtif_user *viu = ni->ni_viu;
+	struct netring_q *nq = &ni->ni_q[ring];
+	struct vq *vq = &viu->viu_rxq[ring];
+
+	if (vq->vq_used->idx != vq->vq_lastused)
+		return;
+
+	nq->nq_waiter = bmk_current;
+	bmk_sched_blockprepare();
+	bmk_sched_block();
+	nq->nq_waiter = NULL;
+}
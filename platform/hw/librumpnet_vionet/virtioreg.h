@@ -0,0 +1,157 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Legacy ("virtio 0.9.5") PCI transport and virtio-net definitions.
+ * The legacy interface is what QEMU and most other hypervisors
+ * provide by default, with register access via I/O ports.
+ */
+
+#ifndef _VIONET_VIRTIOREG_H_
+#define _VIONET_VIRTIOREG_H_
+
+#define VIRTIO_PCI_VENDOR	0x1af4
+#define VIRTIO_PCI_DEV_LEGACY	0x1000	/* 0x1000-0x103f, transitional */
+#define VIRTIO_PCI_SUBSYS_NET	1
+
+/* registers in I/O space BAR0 */
+#define VIRTIO_PCI_HOSTFEAT	0x00	/* 32bit */
+#define VIRTIO_PCI_GUESTFEAT	0x04	/* 32bit */
+#define VIRTIO_PCI_QADDR	0x08	/* 32bit, page frame number */
+#define VIRTIO_PCI_QSIZE	0x0c	/* 16bit */
+#define VIRTIO_PCI_QSEL		0x0e	/* 16bit */
+#define VIRTIO_PCI_QNOTIFY	0x10	/* 16bit */
+#define VIRTIO_PCI_STATUS	0x12	/* 8bit */
+#define VIRTIO_PCI_ISR		0x13	/* 8bit, read clears */
+#define VIRTIO_PCI_CONFVEC	0x14	/* 16bit, only with MSI-X */
+#define VIRTIO_PCI_QVEC		0x16	/* 16bit, only with MSI-X */
+#define VIRTIO_PCI_CONFIG(msix)	((msix) ? 0x18 : 0x14)
+
+#define VIRTIO_PCI_QADDR_SHIFT	12
+#define VIRTIO_PCI_VRING_ALIGN	4096
+#define VIRTIO_MSI_NO_VECTOR	0xffff
+
+#define VIRTIO_STATUS_ACK	0x01
+#define VIRTIO_STATUS_DRIVER	0x02
+#define VIRTIO_STATUS_DRIVER_OK	0x04
+#define VIRTIO_STATUS_FAILED	0x80
+
+#define VIRTIO_F_RING_EVENT_IDX	(1U<<29)
+
+#define VIRTIO_NET_F_CSUM	(1U<<0)
+#define VIRTIO_NET_F_GUEST_CSUM	(1U<<1)
+#define VIRTIO_NET_F_MAC	(1U<<5)
+#define VIRTIO_NET_F_HOST_TSO4	(1U<<11)
+#define VIRTIO_NET_F_MRG_RXBUF	(1U<<15)
+#define VIRTIO_NET_F_STATUS	(1U<<16)
+#define VIRTIO_NET_F_CTRL_VQ	(1U<<17)
+#define VIRTIO_NET_F_MQ		(1U<<22)
+
+/* virtio-net device config */
+#define VIRTIO_NET_CONFIG_MAC		0
+#define VIRTIO_NET_CONFIG_STATUS	6
+#define VIRTIO_NET_CONFIG_MAXPAIRS	8
+
+/*
+ * Header preceding each packet.  num_buffers is present only
+ * if VIRTIO_NET_F_MRG_RXBUF was negotiated (in both directions).
+ */
+struct virtio_net_hdr {
+	uint8_t flags;
+	uint8_t gso_type;
+	uint16_t hdr_len;
+	uint16_t gso_size;
+	uint16_t csum_start;
+	uint16_t csum_offset;
+	uint16_t num_buffers;
+} __attribute__((__packed__));
+#define VIRTIO_NET_HDR_LEN		10
+#define VIRTIO_NET_HDR_LEN_MRG		12
+
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM	0x01
+#define VIRTIO_NET_HDR_F_DATA_VALID	0x02
+#define VIRTIO_NET_HDR_GSO_NONE		0
+#define VIRTIO_NET_HDR_GSO_TCPV4	1
+
+/* control virtqueue */
+#define VIRTIO_NET_CTRL_MQ		4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET	0
+#define VIRTIO_NET_OK			0
+
+/*
+ * Virtqueue ("vring") layout.  The descriptor table is followed
+ * by the available ring, and the used ring starts on the next
+ * VIRTIO_PCI_VRING_ALIGN boundary.  With VIRTIO_F_RING_EVENT_IDX,
+ * each ring has an extra field at the end telling the other side
+ * when to notify.
+ */
+struct vring_desc {
+	uint64_t addr;
+	uint32_t len;
+	uint16_t flags;
+	uint16_t next;
+};
+#define VRING_DESC_F_NEXT	1
+#define VRING_DESC_F_WRITE	2
+
+struct vring_avail {
+	uint16_t flags;
+	uint16_t idx;
+	uint16_t ring[];
+	/* uint16_t used_event; */
+};
+#define VRING_AVAIL_F_NO_INTERRUPT	1
+
+struct vring_used_elem {
+	uint32_t id;
+	uint32_t len;
+};
+
+struct vring_used {
+	uint16_t flags;
+	uint16_t idx;
+	struct vring_used_elem ring[];
+	/* uint16_t avail_event; */
+};
+#define VRING_USED_F_NO_NOTIFY	1
+
+#define VRING_ALIGN(x) \
+    (((x) + VIRTIO_PCI_VRING_ALIGN-1) & ~(VIRTIO_PCI_VRING_ALIGN-1))
+#define VRING_AVAIL_OFF(num) \
+    ((num) * sizeof(struct vring_desc))
+#define VRING_USED_OFF(num) \
+    VRING_ALIGN(VRING_AVAIL_OFF(num) + sizeof(uint16_t)*(3+(num)))
+#define VRING_SIZE(num) \
+    (VRING_USED_OFF(num) \
+      + VRING_ALIGN(sizeof(uint16_t)*3 + sizeof(struct vring_used_elem)*(num)))
+
+/*
+ * Has the other side asked to be notified when the index moves
+ * from "old" to "new"?
+ */
+#define VRING_NEED_EVENT(event, new, old) \
+    ((uint16_t)((new) - (event) - 1) < (uint16_t)((new) - (old)))
+
+#endif /* _VIONET_VIRTIOREG_H_ */
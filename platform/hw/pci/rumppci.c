@@ -32,10 +32,9 @@
 
 #include <bmk-rumpuser/core_types.h>
 
-#include "pci_user.h"
+#include <hw/pci.h>
 
-#define PCI_CONF_ADDR 0xcf8
-#define PCI_CONF_DATA 0xcfc
+#include "pci_user.h"
 
 int
 rumpcomp_pci_iospace_init(void)
@@ -44,25 +43,24 @@ rumpcomp_pci_iospace_init(void)
 	return 0;
 }
 
-static uint32_t
-makeaddr(unsigned bus, unsigned dev, unsigned fun, int reg)
-{
-
-	return (1<<31) | (bus<<16) | (dev <<11) | (fun<<8) | (reg & 0xfc);
-}
+/*
+ * Provided by drivers living on the platform (e.g. the native
+ * virtio-net driver) if they are linked in.  Devices they claim
+ * are hidden from the rump kernel so that it does not try to
+ * attach its own driver.
+ */
+int rumpcomp_pci_claimed(unsigned, unsigned, unsigned) __attribute__((weak));
 
 int
 rumpcomp_pci_confread(unsigned bus, unsigned dev, unsigned fun, int reg,
 	unsigned int *value)
 {
-	uint32_t addr;
-	unsigned int data;
-
-	addr = makeaddr(bus, dev, fun, reg);
-	outl(PCI_CONF_ADDR, addr);
-	data = inl(PCI_CONF_DATA);
 
-	*value = data;
+	if (rumpcomp_pci_claimed && rumpcomp_pci_claimed(bus, dev, fun)) {
+		*value = 0xffffffff;
+		return 0;
+	}
+	*value = bmk_pci_confread(bus, dev, fun, reg);
 	return 0;
 }
 
@@ -70,34 +68,75 @@ int
 rumpcomp_pci_confwrite(unsigned bus, unsigned dev, unsigned fun, int reg,
 	unsigned int value)
 {
-	uint32_t addr;
-
-	addr = makeaddr(bus, dev, fun, reg);
-	outl(PCI_CONF_ADDR, addr);
-	outl(PCI_CONF_DATA, value);
 
+	bmk_pci_confwrite(bus, dev, fun, reg, value);
 	return 0;
 }
 
-static int intrs[BMK_MAXINTR];
+static struct {
+	int intrline;
+	unsigned bus, dev, fun;
+} intrs[BMK_MAXINTR];
 
 int
 rumpcomp_pci_irq_map(unsigned bus, unsigned device, unsigned fun,
 	int intrline, unsigned cookie)
 {
 
-	if (cookie > BMK_MAXINTR)
+	if (cookie >= BMK_MAXINTR)
 		return BMK_EGENERIC;
 
-	intrs[cookie] = intrline;
+	intrs[cookie].intrline = intrline;
+	intrs[cookie].bus = bus;
+	intrs[cookie].dev = device;
+	intrs[cookie].fun = fun;
 	return 0;
 }
 
+#define PCI_CLASS_REG		0x08
+#define PCI_CLASS(r)		((r) >> 24)
+#define PCI_CLASS_MASS_STORAGE	0x01
+#define PCI_CLASS_NETWORK	0x02
+
+/*
+ * Use MSI if the device supports it, since then the interrupt is
+ * not shared and doesn't require a PIC roundtrip.  Drivers are
+ * oblivious to whether they get interrupts via INTx or MSI, so we
+ * can do this behind their back.  MSI-X we can't, since enabling it
+ * may change the device register layout and requires vectors to be
+ * assigned, and the rump kernel PCI interface has no notion of that.
+ *
+ * XXX: none of the devices the tests run with (virtio) has plain MSI,
+ * so this path is untested and off unless built with RUMPRUN_PCI_MSI,
+ * see Makefile.pcihyperdefs.
+ *
+ * Storage completions are usually what something is waiting for, so
+ * service them ahead of e.g. network interrupts.  NICs can generate
+ * interrupts at high rates, so let them switch to polling.
+ */
 void *
 rumpcomp_pci_irq_establish(unsigned cookie, int (*handler)(void *), void *data)
 {
-
-	bmk_isr_rumpkernel(handler, data, intrs[cookie], BMK_INTR_ROUTED);
+	unsigned bus = intrs[cookie].bus;
+	unsigned dev = intrs[cookie].dev;
+	unsigned fun = intrs[cookie].fun;
+	int flags = 0;
+
+	switch (PCI_CLASS(bmk_pci_confread(bus, dev, fun, PCI_CLASS_REG))) {
+	case PCI_CLASS_MASS_STORAGE:
+		flags |= BMK_INTR_PRIO(1);
+		break;
+	case PCI_CLASS_NETWORK:
+		flags |= BMK_INTR_MITIGATE;
+		break;
+	}
+
+#ifdef RUMPRUN_PCI_MSI
+	if (bmk_pci_msi_establish(bus, dev, fun, handler, data, flags) == 0)
+		return &intrs[cookie];
+#endif
+	bmk_isr_rumpkernel(handler, data,
+	    intrs[cookie].intrline, flags | BMK_INTR_ROUTED);
 	return &intrs[cookie];
 }
 
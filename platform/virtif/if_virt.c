@@ -0,0 +1,717 @@
+/*	$NetBSD: if_virt.c,v 1.36 2013/07/04 11:46:51 pooka Exp $	*/
+
+/*
+ * Copyright (c) 2008, 2013 Antti Kantee.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+__KERNEL_RCSID(0, "$NetBSD: if_virt.c,v 1.36 2013/07/04 11:46:51 pooka Exp $");
+
+#include <sys/param.h>
+#include <sys/condvar.h>
+#include <sys/fcntl.h>
+#include <sys/kernel.h>
+#include <sys/kmem.h>
+#include <sys/kthread.h>
+#include <sys/mbuf.h>
+#include <sys/mutex.h>
+#include <sys/poll.h>
+#include <sys/sockio.h>
+#include <sys/socketvar.h>
+#include <sys/sysctl.h>
+#include <sys/cprng.h>
+
+#include <net/bpf.h>
+#include <net/if.h>
+#include <net/if_ether.h>
+#include <net/if_tap.h>
+
+#include <netinet/in.h>
+#include <netinet/in_systm.h>
+#include <netinet/in_var.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+
+#include <rump/rump.h>
+
+#include "rump_private.h"
+#include "rump_net_private.h"
+
+#include "if_virt.h"
+#include "if_virt_user.h"
+
+/*
+ * Virtual interface.  Uses hypercalls to shovel packets back
+ * and forth.  The exact method for shoveling depends on the
+ * hypercall implementation.  This file is compiled into each
+ * driver library, xenif and vionet, with the driver's VIRTIF_BASE.
+ */
+
+static int	virtif_init(struct ifnet *);
+static int	virtif_ioctl(struct ifnet *, u_long, void *);
+static void	virtif_start(struct ifnet *);
+static void	virtif_stop(struct ifnet *, int);
+
+struct virtif_sc {
+	struct ethercom sc_ec;
+	struct virtif_user *sc_viu;
+
+	/*
+	 * Received packets waiting for rump_virtif_pktflush().  The
+	 * hypervisor side asks for room before delivering, see
+	 * rump_virtif_pktroom(), so normally nothing is dropped here.
+	 */
+	struct ifqueue sc_rxq;
+	int sc_rxqfull;			/* times the queue filled up */
+	int sc_rxqmaxocc;		/* max packets queued */
+	struct sysctllog *sc_sysctllog;
+};
+
+/* default max received packets per batch, see net.interfaces.*.rcvq */
+#define VIRTIF_RXQLEN 64
+
+static int  virtif_clone(struct if_clone *, int);
+static int  virtif_unclone(struct ifnet *);
+static void virtif_sysctl_setup(struct virtif_sc *);
+
+struct if_clone VIF_CLONER =
+    IF_CLONE_INITIALIZER(VIF_NAME, virtif_clone, virtif_unclone);
+
+static int
+virtif_clone(struct if_clone *ifc, int num)
+{
+	struct virtif_sc *sc;
+	struct virtif_user *viu;
+	struct ifnet *ifp;
+	uint8_t enaddr[ETHER_ADDR_LEN] = { 0xb2, 0x0a, 0x00, 0x0b, 0x0e, 0x01 };
+	char enaddrstr[3*ETHER_ADDR_LEN];
+	int caps = 0, error = 0;
+
+	if (num >= 0x100)
+		return E2BIG;
+
+	enaddr[2] = cprng_fast32() & 0xff;
+	enaddr[5] = num;
+
+	sc = kmem_zalloc(sizeof(*sc), KM_SLEEP);
+
+	if ((error = VIFHYPER_CREATE(num, sc, enaddr, &caps, &viu)) != 0) {
+		kmem_free(sc, sizeof(*sc));
+		return error;
+	}
+	sc->sc_viu = viu;
+
+	ifp = &sc->sc_ec.ec_if;
+	snprintf(ifp->if_xname, sizeof(ifp->if_xname), "%s%d", VIF_NAME, num);
+	ifp->if_softc = sc;
+
+	ifp->if_flags = IFF_BROADCAST | IFF_SIMPLEX | IFF_MULTICAST;
+	ifp->if_init = virtif_init;
+	ifp->if_ioctl = virtif_ioctl;
+	ifp->if_start = virtif_start;
+	ifp->if_stop = virtif_stop;
+	IFQ_SET_READY(&ifp->if_snd);
+	sc->sc_rxq.ifq_maxlen = VIRTIF_RXQLEN;
+
+	if (caps & VIF_CAP_CSUM) {
+		ifp->if_capabilities |=
+		    IFCAP_CSUM_TCPv4_Tx | IFCAP_CSUM_UDPv4_Tx;
+		ifp->if_csum_flags_tx |= M_CSUM_TCPv4 | M_CSUM_UDPv4;
+	}
+	if (caps & VIF_CAP_CSUM6) {
+		ifp->if_capabilities |=
+		    IFCAP_CSUM_TCPv6_Tx | IFCAP_CSUM_UDPv6_Tx;
+		ifp->if_csum_flags_tx |= M_CSUM_TCPv6 | M_CSUM_UDPv6;
+	}
+	if (caps & VIF_CAP_TSO4)
+		ifp->if_capabilities |= IFCAP_TSOv4;
+	if (caps & VIF_CAP_TSO6)
+		ifp->if_capabilities |= IFCAP_TSOv6;
+	if (caps & VIF_CAP_RXCSUM) {
+		ifp->if_capabilities |=
+		    IFCAP_CSUM_TCPv4_Rx | IFCAP_CSUM_UDPv4_Rx |
+		    IFCAP_CSUM_TCPv6_Rx | IFCAP_CSUM_UDPv6_Rx;
+		ifp->if_csum_flags_rx |= M_CSUM_TCPv4 | M_CSUM_UDPv4 |
+		    M_CSUM_TCPv6 | M_CSUM_UDPv6;
+	}
+	ifp->if_capenable = ifp->if_capabilities;
+	if (caps & VIF_CAP_JUMBO)
+		sc->sc_ec.ec_capabilities |= ETHERCAP_JUMBO_MTU;
+
+	if_attach(ifp);
+	ether_ifattach(ifp, enaddr);
+	virtif_sysctl_setup(sc);
+
+	ether_snprintf(enaddrstr, sizeof(enaddrstr), enaddr);
+	aprint_normal_ifnet(ifp, "Ethernet address %s\n", enaddrstr);
+
+	if (error) {
+		virtif_unclone(ifp);
+	}
+
+	return error;
+}
+
+static int
+virtif_unclone(struct ifnet *ifp)
+{
+	struct virtif_sc *sc = ifp->if_softc;
+
+	VIFHYPER_DYING(sc->sc_viu);
+
+	virtif_stop(ifp, 1);
+	if_down(ifp);
+
+	VIFHYPER_DESTROY(sc->sc_viu);
+
+	aprint_verbose_ifnet(ifp, "receive queue filled up %d times, "
+	    "max %d packets, %d dropped\n", sc->sc_rxqfull,
+	    sc->sc_rxqmaxocc, sc->sc_rxq.ifq_drops);
+	sysctl_teardown(&sc->sc_sysctllog);
+	kmem_free(sc, sizeof(*sc));
+
+	ether_ifdetach(ifp);
+	if_detach(ifp);
+
+	return 0;
+}
+
+/* the queue length must leave room for at least a packet */
+static int
+virtif_sysctl_rxqlen(SYSCTLFN_ARGS)
+{
+	struct sysctlnode node = *rnode;
+	int error, len;
+
+	len = *(int *)rnode->sysctl_data;
+	node.sysctl_data = &len;
+	error = sysctl_lookup(SYSCTLFN_CALL(&node));
+	if (error || newp == NULL)
+		return error;
+	if (len < 1)
+		return EINVAL;
+	*(int *)rnode->sysctl_data = len;
+	return 0;
+}
+
+/*
+ * net.interfaces.<if>.rcvq, like the sndq nodes if_attach() creates.
+ * The receive queue length can be tuned with maxlen.
+ */
+static void
+virtif_sysctl_setup(struct virtif_sc *sc)
+{
+	struct sysctllog **clog = &sc->sc_sysctllog;
+	struct ifqueue *ifq = &sc->sc_rxq;
+	const struct sysctlnode *cnode, *rnode;
+	const char *ifname = sc->sc_ec.ec_if.if_xname;
+
+	if (sysctl_createv(clog, 0, NULL, &rnode,
+		       CTLFLAG_PERMANENT,
+		       CTLTYPE_NODE, "interfaces",
+		       SYSCTL_DESCR("Per-interface controls"),
+		       NULL, 0, NULL, 0,
+		       CTL_NET, CTL_CREATE, CTL_EOL) != 0)
+		goto bad;
+
+	if (sysctl_createv(clog, 0, &rnode, &rnode,
+		       CTLFLAG_PERMANENT,
+		       CTLTYPE_NODE, ifname,
+		       SYSCTL_DESCR("Interface controls"),
+		       NULL, 0, NULL, 0,
+		       CTL_CREATE, CTL_EOL) != 0)
+		goto bad;
+
+	if (sysctl_createv(clog, 0, &rnode, &rnode,
+		       CTLFLAG_PERMANENT,
+		       CTLTYPE_NODE, "rcvq",
+		       SYSCTL_DESCR("Interface input queue controls"),
+		       NULL, 0, NULL, 0,
+		       CTL_CREATE, CTL_EOL) != 0)
+		goto bad;
+
+	if (sysctl_createv(clog, 0, &rnode, &cnode,
+		       CTLFLAG_PERMANENT|CTLFLAG_READWRITE,
+		       CTLTYPE_INT, "maxlen",
+		       SYSCTL_DESCR("Maximum packets passed to the stack at once"),
+		       virtif_sysctl_rxqlen, 0, &ifq->ifq_maxlen, 0,
+		       CTL_CREATE, CTL_EOL) != 0)
+		goto bad;
+
+	if (sysctl_createv(clog, 0, &rnode, &cnode,
+		       CTLFLAG_PERMANENT,
+		       CTLTYPE_INT, "drops",
+		       SYSCTL_DESCR("Packets dropped due to full input queue"),
+		       NULL, 0, &ifq->ifq_drops, 0,
+		       CTL_CREATE, CTL_EOL) != 0)
+		goto bad;
+
+	if (sysctl_createv(clog, 0, &rnode, &cnode,
+		       CTLFLAG_PERMANENT,
+		       CTLTYPE_INT, "full",
+		       SYSCTL_DESCR("Times the input queue filled up"),
+		       NULL, 0, &sc->sc_rxqfull, 0,
+		       CTL_CREATE, CTL_EOL) != 0)
+		goto bad;
+
+	if (sysctl_createv(clog, 0, &rnode, &cnode,
+		       CTLFLAG_PERMANENT,
+		       CTLTYPE_INT, "maxocc",
+		       SYSCTL_DESCR("Maximum input queue length seen"),
+		       NULL, 0, &sc->sc_rxqmaxocc, 0,
+		       CTL_CREATE, CTL_EOL) != 0)
+		goto bad;
+
+	return;
+ bad:
+	printf("%s: could not attach sysctl nodes\n", ifname);
+}
+
+static int
+virtif_init(struct ifnet *ifp)
+{
+
+	ifp->if_flags |= IFF_RUNNING;
+	return 0;
+}
+
+static int
+virtif_ioctl(struct ifnet *ifp, u_long cmd, void *data)
+{
+	int s, rv;
+
+	s = splnet();
+	rv = ether_ioctl(ifp, cmd, data);
+	if (rv == ENETRESET)
+		rv = 0;
+	splx(s);
+
+	return rv;
+}
+
+/*
+ * Translate the stack's offload request into something which does
+ * not require knowledge of mbufs, and hash the flow.  The headers
+ * are Ethernet and IPv4 or IPv6.
+ */
+static void
+virtif_txinfo(struct mbuf *m, struct virtif_txinfo *vt)
+{
+	struct ether_header eh;
+	struct ip ip;
+	struct ip6_hdr ip6;
+	uint32_t *a;
+	uint16_t ports[2];
+	int flags = m->m_pkthdr.csum_flags;
+	int i, iphl, proto;
+	uint8_t b;
+
+	vt->vt_flags = 0;
+	vt->vt_flowhash = 0;
+
+	if (m->m_pkthdr.len < ETHER_HDR_LEN + (int)sizeof(ip))
+		return;
+	m_copydata(m, 0, sizeof(eh), &eh);
+	if (eh.ether_type == htons(ETHERTYPE_IP)) {
+		m_copydata(m, ETHER_HDR_LEN, sizeof(ip), &ip);
+		iphl = ip.ip_hl << 2;
+		proto = ip.ip_p;
+		vt->vt_flowhash = ip.ip_src.s_addr ^ ip.ip_dst.s_addr ^ proto;
+		if (ip.ip_off & htons(IP_MF|IP_OFFMASK))
+			proto = 0;
+	} else if (eh.ether_type == htons(ETHERTYPE_IPV6)
+	    && m->m_pkthdr.len >= ETHER_HDR_LEN + (int)sizeof(ip6)) {
+		m_copydata(m, ETHER_HDR_LEN, sizeof(ip6), &ip6);
+		iphl = sizeof(ip6);
+		proto = ip6.ip6_nxt;
+		a = (uint32_t *)&ip6.ip6_src;
+		for (i = 0; i < 8; i++)
+			vt->vt_flowhash ^= a[i];
+		vt->vt_flowhash ^= proto;
+	} else {
+		return;
+	}
+
+	if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP)
+	    && m->m_pkthdr.len >= ETHER_HDR_LEN + iphl + (int)sizeof(ports)) {
+		m_copydata(m, ETHER_HDR_LEN + iphl, sizeof(ports), ports);
+		vt->vt_flowhash ^= ports[0] ^ ports[1];
+	}
+
+	if ((flags & (M_CSUM_TCPv4|M_CSUM_UDPv4|M_CSUM_TSOv4
+	    |M_CSUM_TCPv6|M_CSUM_UDPv6|M_CSUM_TSOv6)) == 0)
+		return;
+
+	/* the stack knows where the extension headers end */
+	if (flags & (M_CSUM_TCPv6|M_CSUM_UDPv6|M_CSUM_TSOv6))
+		iphl = M_CSUM_DATA_IPv6_HL(m->m_pkthdr.csum_data);
+
+	vt->vt_csumstart = ETHER_HDR_LEN + iphl;
+	if (flags & (M_CSUM_UDPv4|M_CSUM_UDPv6))
+		vt->vt_csumoff = offsetof(struct udphdr, uh_sum);
+	else
+		vt->vt_csumoff = offsetof(struct tcphdr, th_sum);
+	vt->vt_flags = VIF_TX_CSUM;
+
+	if (flags & (M_CSUM_TSOv4|M_CSUM_TSOv6)) {
+		m_copydata(m, vt->vt_csumstart + 12, 1, &b);
+		vt->vt_hdrlen = vt->vt_csumstart + ((b >> 4) << 2);
+		vt->vt_mss = m->m_pkthdr.segsz;
+		vt->vt_flags |= flags & M_CSUM_TSOv4 ? VIF_TX_TSO4 : VIF_TX_TSO6;
+	}
+}
+
+static int
+virtif_nfrags(struct mbuf *m)
+{
+	int n;
+
+	for (n = 0; m; m = m->m_next)
+		if (m->m_len)
+			n++;
+	return n;
+}
+
+/*
+ * Copy a chain with too many pieces into a new one, which
+ * m_copyback() makes out of clusters.  The original is freed.
+ * Returns NULL if out of mbufs.
+ */
+static struct mbuf *
+virtif_defrag(struct mbuf *m0)
+{
+	struct mbuf *m, *mn;
+	int off;
+
+	mn = m_gethdr(M_NOWAIT, MT_DATA);
+	if (mn != NULL) {
+		mn->m_len = mn->m_pkthdr.len = 0;
+		for (m = m0, off = 0; m; off += m->m_len, m = m->m_next) {
+			m_copyback(mn, off, m->m_len, mtod(m, void *));
+			if (mn->m_pkthdr.len != off + m->m_len) {
+				m_freem(mn);
+				mn = NULL;
+				break;
+			}
+		}
+	}
+	m_freem(m0);
+
+	return mn;
+}
+
+/*
+ * Output packets in-context until outgoing queue is empty.
+ * Assume that VIFHYPER_SEND() is fast enough to not make it
+ * necessary to drop kernel_lock.  The hypervisor gets the whole
+ * burst at once with VIFHYPER_FLUSH().  Empty mbufs are skipped,
+ * and the rare chain of more than VIRTIF_MAXFRAGS pieces, e.g. from
+ * lots of small writes, is compacted first.
+ */
+static void
+virtif_start(struct ifnet *ifp)
+{
+	struct virtif_sc *sc = ifp->if_softc;
+	struct virtif_txinfo vt;
+	struct mbuf *m, *m0;
+	struct iovec io[VIRTIF_MAXFRAGS];
+	int i;
+
+	ifp->if_flags |= IFF_OACTIVE;
+
+	for (;;) {
+		IF_DEQUEUE(&ifp->if_snd, m0);
+		if (!m0) {
+			break;
+		}
+
+		bpf_mtap(ifp, m0);
+		virtif_txinfo(m0, &vt);
+
+		if (virtif_nfrags(m0) > VIRTIF_MAXFRAGS) {
+			m0 = virtif_defrag(m0);
+			if (m0 == NULL || virtif_nfrags(m0) > VIRTIF_MAXFRAGS) {
+				ifp->if_oerrors++;
+				m_freem(m0);
+				continue;
+			}
+		}
+
+		for (m = m0, i = 0; m; m = m->m_next) {
+			if (m->m_len == 0)
+				continue;
+			io[i].iov_base = mtod(m, void *);
+			io[i].iov_len = m->m_len;
+			i++;
+		}
+
+		VIFHYPER_SEND(sc->sc_viu, io, i, &vt, m0);
+	}
+	VIFHYPER_FLUSH(sc->sc_viu);
+
+	ifp->if_flags &= ~IFF_OACTIVE;
+}
+
+/*
+ * The hypervisor is done with a packet given to VIFHYPER_SEND().
+ */
+void
+rump_virtif_txdone(struct virtif_sc *sc, void *cookie)
+{
+
+	m_freem(cookie);
+}
+
+static void
+virtif_stop(struct ifnet *ifp, int disable)
+{
+
+	ifp->if_flags &= ~IFF_RUNNING;
+}
+
+/*
+ * The sender, another domain on this host, left the TCP/UDP checksum
+ * for the hardware to fill in, with the pseudo header sum in place.
+ * There is no hardware, so fill it in ourselves in case the packet
+ * is forwarded.  Unsupported headers are left alone.
+ */
+static void
+virtif_csumfill(struct mbuf *m)
+{
+	struct ether_header eh;
+	struct ip ip;
+	struct ip6_hdr ip6;
+	int off, proto;
+	uint16_t sum;
+
+	if (m->m_pkthdr.len < ETHER_HDR_LEN + (int)sizeof(ip))
+		return;
+	m_copydata(m, 0, sizeof(eh), &eh);
+	if (eh.ether_type == htons(ETHERTYPE_IP)) {
+		m_copydata(m, ETHER_HDR_LEN, sizeof(ip), &ip);
+		off = ETHER_HDR_LEN + (ip.ip_hl << 2);
+		proto = ip.ip_p;
+	} else if (eh.ether_type == htons(ETHERTYPE_IPV6)
+	    && m->m_pkthdr.len >= ETHER_HDR_LEN + (int)sizeof(ip6)) {
+		m_copydata(m, ETHER_HDR_LEN, sizeof(ip6), &ip6);
+		off = ETHER_HDR_LEN + sizeof(ip6);
+		proto = ip6.ip6_nxt;
+	} else {
+		return;
+	}
+
+	if (proto == IPPROTO_TCP
+	    && m->m_pkthdr.len >= off + (int)sizeof(struct tcphdr)) {
+		sum = cpu_in_cksum(m, m->m_pkthdr.len - off, off, 0);
+		off += offsetof(struct tcphdr, th_sum);
+	} else if (proto == IPPROTO_UDP
+	    && m->m_pkthdr.len >= off + (int)sizeof(struct udphdr)) {
+		sum = cpu_in_cksum(m, m->m_pkthdr.len - off, off, 0);
+		if (sum == 0)
+			sum = 0xffff;
+		off += offsetof(struct udphdr, uh_sum);
+	} else {
+		return;
+	}
+	m_copyback(m, off, sizeof(sum), &sum);
+}
+
+/*
+ * Queue a received packet for rump_virtif_pktflush(), which passes
+ * the whole batch to the stack under one kernel lock.
+ */
+static void
+virtif_input(struct ifnet *ifp, struct mbuf *m, int flags)
+{
+	struct virtif_sc *sc = ifp->if_softc;
+
+	if (flags & VIF_RX_CSUMBLANK)
+		virtif_csumfill(m);
+	if (flags & (VIF_RX_CSUMOK|VIF_RX_CSUMBLANK))
+		m->m_pkthdr.csum_flags = M_CSUM_TCPv4 | M_CSUM_UDPv4 |
+		    M_CSUM_TCPv6 | M_CSUM_UDPv6;
+
+#if __NetBSD_Prereq__(7,99,31)
+	m_set_rcvif(m, ifp);
+#else
+	m->m_pkthdr.rcvif = ifp;
+#endif
+
+	if (IF_QFULL(&sc->sc_rxq)) {
+		IF_DROP(&sc->sc_rxq);
+		ifp->if_iqdrops++;
+		m_freem(m);
+		return;
+	}
+	IF_ENQUEUE(&sc->sc_rxq, m);
+	if (sc->sc_rxq.ifq_len > sc->sc_rxqmaxocc)
+		sc->sc_rxqmaxocc = sc->sc_rxq.ifq_len;
+	if (IF_QFULL(&sc->sc_rxq))
+		sc->sc_rxqfull++;
+}
+
+/*
+ * The number of packets the hypervisor side may deliver before it
+ * must call rump_virtif_pktflush().
+ */
+int
+rump_virtif_pktroom(struct virtif_sc *sc)
+{
+	int room = sc->sc_rxq.ifq_maxlen - sc->sc_rxq.ifq_len;
+
+	return room > 0 ? room : 0;
+}
+
+/*
+ * The hypervisor side dropped n received packets as malformed.
+ */
+void
+rump_virtif_pkterror(struct virtif_sc *sc, int n)
+{
+
+	sc->sc_ec.ec_if.if_ierrors += n;
+}
+
+/*
+ * Pass the packets queued by rump_virtif_pktdeliver() and
+ * rump_virtif_pktdeliver_ext() to the stack.  The hypervisor side
+ * calls this once it has delivered what it has, e.g. after it has
+ * emptied its receive ring.
+ */
+void
+rump_virtif_pktflush(struct virtif_sc *sc)
+{
+	struct ifnet *ifp = &sc->sc_ec.ec_if;
+	struct mbuf *m, *next;
+
+	/* the stack may block, and more packets come in meanwhile */
+	m = sc->sc_rxq.ifq_head;
+	if (m == NULL)
+		return;
+	sc->sc_rxq.ifq_head = sc->sc_rxq.ifq_tail = NULL;
+	sc->sc_rxq.ifq_len = 0;
+
+	if ((ifp->if_flags & IFF_RUNNING) == 0) {
+		for (; m; m = next) {
+			next = m->m_nextpkt;
+			m_freem(m);
+		}
+		return;
+	}
+
+	KERNEL_LOCK(1, NULL);
+	for (; m; m = next) {
+		next = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+		bpf_mtap(ifp, m);
+		ether_input(ifp, m);
+	}
+	KERNEL_UNLOCK_LAST(NULL);
+}
+
+void
+rump_virtif_pktdeliver(struct virtif_sc *sc, struct iovec *iov, size_t iovlen,
+	int flags)
+{
+	struct ifnet *ifp = &sc->sc_ec.ec_if;
+	struct mbuf *m;
+	size_t i;
+	int off;
+
+	if ((ifp->if_flags & IFF_RUNNING) == 0)
+		return;
+
+	m = m_gethdr(M_NOWAIT, MT_DATA);
+	if (m == NULL) {
+		ifp->if_iqdrops++;
+		return; /* drop packet */
+	}
+	m->m_len = m->m_pkthdr.len = 0;
+
+	for (i = 0, off = 0; i < iovlen; i++) {
+		m_copyback(m, off, iov[i].iov_len, iov[i].iov_base);
+		off += iov[i].iov_len;
+		if (off != m->m_pkthdr.len) {
+			aprint_verbose_ifnet(ifp, "m_copyback failed\n");
+			ifp->if_iqdrops++;
+			m_freem(m);
+			return;
+		}
+	}
+
+	virtif_input(ifp, m, flags);
+}
+
+static void
+virtif_extfree(struct mbuf *m, void *buf, size_t size, void *arg)
+{
+
+	VIFHYPER_RXDONE(arg, buf);
+	if (__predict_true(m != NULL))
+		pool_cache_put(mb_cache, m);
+}
+
+/*
+ * Deliver a packet without copying it.  Each mbuf of the chain points
+ * to one of the hypervisor-side buffers, which is given back with
+ * VIFHYPER_RXDONE() once the mbuf is freed.  Returns an error if the
+ * packet could not be delivered, in which case the buffers still
+ * belong to the caller.
+ */
+int
+rump_virtif_pktdeliver_ext(struct virtif_sc *sc, struct iovec *iov,
+	size_t iovlen, int flags, void *arg)
+{
+	struct ifnet *ifp = &sc->sc_ec.ec_if;
+	struct mbuf *m0, *m, **mp;
+	size_t i;
+
+	if ((ifp->if_flags & IFF_RUNNING) == 0)
+		return ENETDOWN;
+
+	/* get all the mbufs first, so that failing leaves the buffers */
+	m0 = m_gethdr(M_NOWAIT, MT_DATA);
+	for (i = 1, mp = &m0; i < iovlen && *mp; i++) {
+		mp = &(*mp)->m_next;
+		*mp = m_get(M_NOWAIT, MT_DATA);
+	}
+	if (m0 == NULL || *mp == NULL) {
+		m_freem(m0);
+		return ENOBUFS;
+	}
+
+	m0->m_pkthdr.len = 0;
+	for (i = 0, m = m0; i < iovlen; i++, m = m->m_next) {
+		MEXTADD(m, iov[i].iov_base, iov[i].iov_len, M_DEVBUF,
+		    virtif_extfree, arg);
+		m->m_flags |= M_EXT_RW; /* we own the buffer */
+		m->m_len = iov[i].iov_len;
+		m0->m_pkthdr.len += m->m_len;
+	}
+
+	virtif_input(ifp, m0, flags);
+	return 0;
+}
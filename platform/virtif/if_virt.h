@@ -0,0 +1,72 @@
+/*	$NetBSD: if_virt.h,v 1.2 2013/07/04 11:58:11 pooka Exp $	*/
+
+/*
+ * NOTE!  This file is supposed to work on !NetBSD platforms.
+ */
+
+#ifndef VIRTIF_BASE
+#error Define VIRTIF_BASE
+#endif
+
+#define VIF_STRING(x) #x
+#define VIF_STRINGIFY(x) VIF_STRING(x)
+#define VIF_CONCAT(x,y) x##y
+#define VIF_CONCAT3(x,y,z) x##y##z
+#define VIF_BASENAME(x,y) VIF_CONCAT(x,y)
+#define VIF_BASENAME3(x,y,z) VIF_CONCAT3(x,y,z)
+
+#define VIF_CLONER VIF_BASENAME(VIRTIF_BASE,_cloner)
+#define VIF_NAME VIF_STRINGIFY(VIRTIF_BASE)
+
+#define VIFHYPER_CREATE VIF_BASENAME3(rumpcomp_,VIRTIF_BASE,_create)
+#define VIFHYPER_DYING VIF_BASENAME3(rumpcomp_,VIRTIF_BASE,_dying)
+#define VIFHYPER_DESTROY VIF_BASENAME3(rumpcomp_,VIRTIF_BASE,_destroy)
+#define VIFHYPER_SEND VIF_BASENAME3(rumpcomp_,VIRTIF_BASE,_send)
+#define VIFHYPER_FLUSH VIF_BASENAME3(rumpcomp_,VIRTIF_BASE,_flush)
+#define VIFHYPER_RXDONE VIF_BASENAME3(rumpcomp_,VIRTIF_BASE,_rxdone)
+
+/*
+ * Offloads the hypervisor side can do, reported by VIFHYPER_CREATE().
+ */
+#define VIF_CAP_CSUM	0x01	/* TCP/UDPv4 checksum on transmit */
+#define VIF_CAP_TSO4	0x02	/* TCPv4 segmentation on transmit */
+#define VIF_CAP_RXCSUM	0x04	/* validates checksums on receive */
+#define VIF_CAP_CSUM6	0x08	/* TCP/UDPv6 checksum on transmit */
+#define VIF_CAP_TSO6	0x10	/* TCPv6 segmentation on transmit */
+#define VIF_CAP_JUMBO	0x20	/* frames up to ETHERMTU_JUMBO */
+
+/*
+ * Per-packet information for VIFHYPER_SEND(): offload requests and
+ * a flow hash for picking a transmit queue.  Offsets are from the
+ * start of the Ethernet frame.
+ */
+struct virtif_txinfo {
+	int vt_flags;
+	unsigned short vt_csumstart;	/* start of checksummed data */
+	unsigned short vt_csumoff;	/* checksum field, from csumstart */
+	unsigned short vt_hdrlen;	/* TSO: length of all headers */
+	unsigned short vt_mss;		/* TSO: segment payload size */
+	unsigned int vt_flowhash;	/* same for all packets of a flow */
+};
+#define VIF_TX_CSUM	0x01
+#define VIF_TX_TSO4	0x02
+#define VIF_TX_TSO6	0x04
+
+/*
+ * Max pieces per packet given to VIFHYPER_SEND().  Enough for any
+ * packet up to IP_MAXPACKET in clusters, see virtif_defrag().
+ */
+#define VIRTIF_MAXFRAGS 64
+
+/* flags for rump_virtif_pktdeliver() */
+#define VIF_RX_CSUMOK	0x01	/* checksum validated, or not needed */
+#define VIF_RX_CSUMBLANK 0x02	/* checksum not filled in by the sender */
+
+struct virtif_sc;
+void rump_virtif_pktdeliver(struct virtif_sc *, struct iovec *, size_t, int);
+int rump_virtif_pktdeliver_ext(struct virtif_sc *, struct iovec *, size_t,
+    int, void *);
+void rump_virtif_pktflush(struct virtif_sc *);
+int rump_virtif_pktroom(struct virtif_sc *);
+void rump_virtif_pkterror(struct virtif_sc *, int);
+void rump_virtif_txdone(struct virtif_sc *, void *);
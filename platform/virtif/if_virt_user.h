@@ -27,9 +27,20 @@
 
 struct virtif_user;
 
-int 	VIFHYPER_CREATE(int, struct virtif_sc *, uint8_t *,
+int 	VIFHYPER_CREATE(int, struct virtif_sc *, uint8_t *, int *,
 			struct virtif_user **);
 void	VIFHYPER_DYING(struct virtif_user *);
 void	VIFHYPER_DESTROY(struct virtif_user *);
 
-void	VIFHYPER_SEND(struct virtif_user *, struct iovec *, size_t);
+/*
+ * Queue a packet.  The data must stay intact until the hypervisor
+ * side hands the cookie back via rump_virtif_txdone().
+ */
+void	VIFHYPER_SEND(struct virtif_user *, struct iovec *, size_t,
+			const struct virtif_txinfo *, void *);
+
+/* end of a burst of VIFHYPER_SEND()s, push them to the device */
+void	VIFHYPER_FLUSH(struct virtif_user *);
+
+/* buffer given with rump_virtif_pktdeliver_ext() is free again */
+void	VIFHYPER_RXDONE(void *, void *);
@@ -34,117 +34,285 @@ struct iovec {
 
 #include <bmk-core/errno.h>
 #include <bmk-core/memalloc.h>
+#include <bmk-core/pgalloc.h>
 #include <bmk-core/string.h>
 #include <bmk-core/sched.h>
 
 #include <bmk-rumpuser/core_types.h>
 #include <bmk-rumpuser/rumpuser.h>
 
+#include <rumprun/netring.h>
+
 #include "if_virt.h"
 #include "if_virt_user.h"
 
+/* slots per raw frame ring, one page each */
+#define NETRING_NUM 256
+#define NETRING_MAXSEG 32
+
 /*
- * For now, shovel the packets from the interrupt to a
- * thread context via an intermediate set of buffers.  Need
- * to fix this a bit down the road.
+ * Transmitted from a raw frame ring, n slots.  mbufs are aligned,
+ * so their cookies never have the low bit set.
  */
-#define MAXPKT 2000
-struct onepkt {
-	unsigned char pkt_data[MAXPKT];
-	int pkt_dlen;
+#define NETRING_COOKIE(n) ((void *)(((unsigned long)(n) << 1) | 1))
+#define NETRING_ISCOOKIE(c) (((unsigned long)(c) & 1) != 0)
+#define NETRING_COOKIE_NSLOTS(c) ((unsigned long)(c) >> 1)
+
+/* the raw frame rings of a queue, see <rumprun/netring.h> */
+struct netring_q {
+	struct rumprun_netring nq_rx;
+	struct rumprun_netring nq_tx;
+	void **nq_rxbuf;		/* own buffer of each slot */
+	void **nq_txbuf;
+	unsigned int nq_rxrel;		/* RX slots released up to here */
+	unsigned int nq_txsent;		/* TX slots sent up to here */
+	unsigned int nq_txdone;		/* and done up to here */
+	int nq_txbusy;			/* frames in flight */
+	struct bmk_thread *nq_waiter;
+};
+
+struct rumprun_netif {
+	struct virtif_user *ni_viu;
+	struct netring_q *ni_q;
+	int ni_nrings;
+	int ni_rxq;			/* ring being received into */
+	unsigned long ni_rxdrop;
+	unsigned long ni_txerr;
+};
+
+/* a netfront queue and the thread serving it */
+struct virtif_queue {
+	struct virtif_user *viq_viu;
+	int viq_id;
+	struct bmk_thread *viq_rcvr;
+	struct bmk_thread *viq_thr;
 };
 
-#define NBUF 64
 struct virtif_user {
 	struct netfront_dev *viu_dev;
-	struct bmk_thread *viu_rcvr;
-	struct bmk_thread *viu_thr;
 	struct virtif_sc *viu_vifsc;
+	struct virtif_queue *viu_queues;
+	int viu_nqueues;
+	unsigned long viu_rxerr;
+
+	/* the raw frame rings, if open */
+	int viu_unit;
+	struct rumprun_netif *viu_netif;
+	struct virtif_user *viu_next;
 
-	int viu_read;
-	int viu_write;
 	int viu_dying;
-	struct onepkt viu_pkts[NBUF];
 };
 
+/* for finding interfaces by unit in rumprun_netring_open() */
+static struct virtif_user *viulist;
+
 /*
- * Ok, based on how (the unmodified) netfront works, we need to
- * consume the data here.  So store it locally (and revisit some day).
+ * Called from the netfront event handler in interrupt context:
+ * the packets are processed by the queue's pusher thread.
  */
 static void
-myrecv(struct netfront_dev *dev, unsigned char *data, int dlen)
+myrxwake(struct netfront_dev *dev, int q)
 {
 	struct virtif_user *viu = netfront_get_private(dev);
-	int nextw;
 
-	/* TODO: we should be at the correct spl already, assert how? */
+	/* an event before VIFHYPER_CREATE() is done is picked up later */
+	if (viu->viu_queues && viu->viu_queues[q].viq_rcvr)
+		bmk_sched_wake(viu->viu_queues[q].viq_rcvr);
+	if (viu->viu_netif && viu->viu_netif->ni_q[q].nq_waiter)
+		bmk_sched_wake(viu->viu_netif->ni_q[q].nq_waiter);
+}
 
-	nextw = (viu->viu_write+1) % NBUF;
-	/* queue full?  drop packet */
-	if (nextw == viu->viu_read) {
+/*
+ * Put a received frame in the RX ring rumprun_netring_rxsync() is
+ * filling, a slot per piece.  Loaned pages are handed out as is and
+ * given back to netfront when the slot is released, the rest is
+ * copied into the slots' own pages.
+ */
+static void
+netring_recv(struct rumprun_netif *ni, const struct netfront_seg *seg,
+	int nseg, int flags, int loaned)
+{
+	struct netring_q *nq = &ni->ni_q[ni->ni_rxq];
+	struct rumprun_netring *r = &nq->nq_rx;
+	struct rumprun_netring_slot *slot;
+	unsigned int idx;
+	int i;
+
+	if (r->nr_num - (r->nr_tail - r->nr_head) < (unsigned int)nseg) {
+		ni->ni_rxdrop++;
+		if (loaned)
+			for (i = 0; i < nseg; i++)
+				netfront_rxpage_put(ni->ni_viu->viu_dev,
+				    seg[i].data);
 		return;
 	}
 
-	if (dlen > MAXPKT) {
-		minios_printk("myrecv: pkt len %d too big\n", dlen);
+	for (i = 0; i < nseg; i++) {
+		idx = r->nr_tail++ & (r->nr_num-1);
+		slot = &r->nr_slot[idx];
+		if (loaned) {
+			slot->ns_buf = seg[i].data;
+		} else {
+			slot->ns_buf = nq->nq_rxbuf[idx];
+			bmk_memcpy(slot->ns_buf, seg[i].data, seg[i].len);
+		}
+		slot->ns_len = seg[i].len;
+		slot->ns_flags = i < nseg-1 ? NETRING_F_MORE : 0;
+		if (flags & NETFRONT_RX_CSUMOK)
+			slot->ns_flags |= NETRING_F_CSUMOK;
+	}
+}
+
+/*
+ * Called from netfront_rx() with the rump kernel scheduled.  If the
+ * pages are loaned to us, they become the mbuf storage, a page per
+ * mbuf.  They come back via VIFHYPER_RXDONE() when the mbufs are
+ * freed.  Otherwise, we must copy.  The packets reach the stack in
+ * one batch when the pusher calls rump_virtif_pktflush().
+ */
+static void
+myrecv(struct netfront_dev *dev, const struct netfront_seg *seg, int nseg,
+	int flags, int loaned)
+{
+	struct virtif_user *viu = netfront_get_private(dev);
+	struct iovec iov[NETFRONT_RX_MAXSEG];
+	int i, vflags = 0;
+
+	if (viu->viu_netif) {
+		netring_recv(viu->viu_netif, seg, nseg, flags, loaned);
 		return;
 	}
 
-	bmk_memcpy(viu->viu_pkts[viu->viu_write].pkt_data, data, dlen);
-	viu->viu_pkts[viu->viu_write].pkt_dlen = dlen;
-	viu->viu_write = nextw;
+	if (flags & NETFRONT_RX_CSUMOK)
+		vflags |= VIF_RX_CSUMOK;
+	if (flags & NETFRONT_RX_CSUMBLANK)
+		vflags |= VIF_RX_CSUMBLANK;
+
+	for (i = 0; i < nseg; i++) {
+		iov[i].iov_base = seg[i].data;
+		iov[i].iov_len = seg[i].len;
+	}
+
+	if (loaned) {
+		if (rump_virtif_pktdeliver_ext(viu->viu_vifsc,
+		    iov, nseg, vflags, dev) == 0)
+			return;
+	}
+
+	rump_virtif_pktdeliver(viu->viu_vifsc, iov, nseg, vflags);
+
+	if (loaned)
+		for (i = 0; i < nseg; i++)
+			netfront_rxpage_put(dev, seg[i].data);
+}
+
+#define NREAP 32
+
+/*
+ * Give the stack back the packets netfront is done sending on
+ * queue q.  Called with the rump kernel scheduled.  Frames sent from
+ * a raw frame ring free their slots instead.  Those come back in
+ * order, and once none are in flight, so are the slots of frames
+ * netfront refused.
+ */
+static void
+txreap(struct virtif_user *viu, int q)
+{
+	struct netring_q *nq;
+	void *cookies[NREAP];
+	int i, n;
+
+	do {
+		n = netfront_xmit_reap(viu->viu_dev, q, cookies, NREAP);
+		for (i = 0; i < n; i++) {
+			if (!NETRING_ISCOOKIE(cookies[i])) {
+				rump_virtif_txdone(viu->viu_vifsc, cookies[i]);
+				continue;
+			}
+			nq = &viu->viu_netif->ni_q[q];
+			nq->nq_txdone += NETRING_COOKIE_NSLOTS(cookies[i]);
+			if (--nq->nq_txbusy == 0)
+				nq->nq_txdone = nq->nq_txsent;
+		}
+	} while (n == NREAP);
+}
+
+/*
+ * Pass the stack as many packets as its receive queue has room for.
+ * What does not fit stays in the ring, which is not refilled until
+ * the next round, so netback holds off instead of us dropping.
+ */
+static int
+rxbatch(struct virtif_user *viu, int q)
+{
+	struct netfront_stats ns;
+	int work;
+
+	work = netfront_rx(viu->viu_dev, q,
+	    rump_virtif_pktroom(viu->viu_vifsc));
+	rump_virtif_pktflush(viu->viu_vifsc);
+
+	netfront_getstats(viu->viu_dev, &ns);
+	if (ns.ns_rxerr != viu->viu_rxerr) {
+		rump_virtif_pkterror(viu->viu_vifsc,
+		    ns.ns_rxerr - viu->viu_rxerr);
+		viu->viu_rxerr = ns.ns_rxerr;
+	}
 
-	if (viu->viu_rcvr)
-		bmk_sched_wake(viu->viu_rcvr);
+	return work;
 }
 
 static void
 pusher(void *arg)
 {
-	struct virtif_user *viu = arg;
-	struct iovec iov;
-	struct onepkt *mypkt;
-	int flags;
+	struct virtif_queue *viq = arg;
+	struct virtif_user *viu = viq->viq_viu;
+	int q = viq->viq_id;
+	int flags, work;
 
 	/* give us a rump kernel context */
 	rumpuser__hyp.hyp_schedule();
 	rumpuser__hyp.hyp_lwproc_newlwp(0);
 	rumpuser__hyp.hyp_unschedule();
 
-	local_irq_save(flags);
- again:
 	while (!viu->viu_dying) {
-		while (viu->viu_read == viu->viu_write) {
-			viu->viu_rcvr = bmk_current;
+		/* with the raw frame rings open, the application receives */
+		rumpuser__hyp.hyp_schedule();
+		work = viu->viu_netif ? 0 : rxbatch(viu, q);
+		txreap(viu, q);
+		rumpuser__hyp.hyp_unschedule();
+
+		/*
+		 * If netfront switched to polling due to a high
+		 * event rate, poll instead of waiting for a wakeup.
+		 */
+		if (netfront_poll(viu->viu_dev, q, work)) {
+			bmk_sched_yield();
+			continue;
+		}
+
+		local_irq_save(flags);
+		if ((viu->viu_netif || !netfront_rx_pending(viu->viu_dev, q))
+		    && !netfront_xmit_reapable(viu->viu_dev, q)
+		    && !viu->viu_dying) {
+			viq->viq_rcvr = bmk_current;
 			bmk_sched_blockprepare();
 			local_irq_restore(flags);
 			bmk_sched_block();
 			local_irq_save(flags);
-			viu->viu_rcvr = NULL;
-			goto again;
+			viq->viq_rcvr = NULL;
 		}
-		mypkt = &viu->viu_pkts[viu->viu_read];
 		local_irq_restore(flags);
-
-		iov.iov_base = mypkt->pkt_data;
-		iov.iov_len =  mypkt->pkt_dlen;
-
-		rumpuser__hyp.hyp_schedule();
-		rump_virtif_pktdeliver(viu->viu_vifsc, &iov, 1);
-		rumpuser__hyp.hyp_unschedule();
-
-		local_irq_save(flags);
-		viu->viu_read = (viu->viu_read+1) % NBUF;
 	}
-	local_irq_restore(flags);
 }
 
 int
 VIFHYPER_CREATE(int devnum, struct virtif_sc *vif_sc, uint8_t *enaddr,
-	struct virtif_user **viup)
+	int *caps, struct virtif_user **viup)
 {
 	struct virtif_user *viu = NULL;
-	int rv, nlocks;
+	struct virtif_queue *viq;
+	int features, i, nq, rv, nlocks;
 
 	rumpkern_unsched(&nlocks, NULL);
 
@@ -155,20 +323,50 @@ VIFHYPER_CREATE(int devnum, struct virtif_sc *vif_sc, uint8_t *enaddr,
 	}
 	bmk_memset(viu, 0, sizeof(*viu));
 	viu->viu_vifsc = vif_sc;
+	viu->viu_unit = devnum;
 
-	viu->viu_dev = netfront_init(NULL, myrecv, enaddr, NULL, viu);
+	viu->viu_dev = netfront_init(NULL, myrecv, myrxwake, enaddr, NULL, viu);
 	if (!viu->viu_dev) {
 		rv = BMK_EINVAL; /* ? */
 		bmk_memfree(viu, BMK_MEMWHO_RUMPKERN);
 		goto out;
 	}
 
-	viu->viu_thr = bmk_sched_create("xenifp",
-	    NULL, 1, pusher, viu, NULL, 0);
-	if (viu->viu_thr == NULL) {
-		minios_printk("fatal thread creation failure\n"); /* XXX */
+	/* netback validates what it passes us, unless it left it blank */
+	features = netfront_features(viu->viu_dev);
+	*caps = VIF_CAP_RXCSUM;
+	if (features & NETFRONT_F_CSUM)
+		*caps |= VIF_CAP_CSUM;
+	if (features & NETFRONT_F_CSUM6)
+		*caps |= VIF_CAP_CSUM6;
+	if (features & NETFRONT_F_TSO4)
+		*caps |= VIF_CAP_TSO4;
+	if (features & NETFRONT_F_TSO6)
+		*caps |= VIF_CAP_TSO6;
+	if (features & NETFRONT_F_SG)
+		*caps |= VIF_CAP_JUMBO;
+
+	/* a receive thread per queue */
+	nq = netfront_nqueues(viu->viu_dev);
+	viq = bmk_memcalloc(nq, sizeof(*viq), BMK_MEMWHO_RUMPKERN);
+	if (viq == NULL) {
+		minios_printk("fatal queue allocation failure\n"); /* XXX */
 		minios_do_exit();
 	}
+	viu->viu_nqueues = nq;
+	viu->viu_queues = viq;
+	for (i = 0; i < nq; i++) {
+		viq[i].viq_viu = viu;
+		viq[i].viq_id = i;
+		viq[i].viq_thr = bmk_sched_create("xenifp",
+		    NULL, 1, pusher, &viq[i], NULL, 0);
+		if (viq[i].viq_thr == NULL) {
+			minios_printk("fatal thread creation failure\n"); /* XXX */
+			minios_do_exit();
+		}
+	}
+	viu->viu_next = viulist;
+	viulist = viu;
 
 	rv = 0;
 
@@ -179,69 +377,372 @@ VIFHYPER_CREATE(int devnum, struct virtif_sc *vif_sc, uint8_t *enaddr,
 	return rv;
 }
 
+/*
+ * The data is handed to netfront as is, and the mbuf is returned via
+ * rump_virtif_txdone() once the backend is done with it.  The backend
+ * is told about the packet in VIFHYPER_FLUSH().  netback knows where
+ * the checksum goes from the headers, so of the offload information
+ * only the request, the segment size and the flow hash, which picks
+ * the queue, are passed on.
+ */
 void
-VIFHYPER_SEND(struct virtif_user *viu,
-	struct iovec *iov, size_t iovlen)
+VIFHYPER_SEND(struct virtif_user *viu, struct iovec *iov, size_t iovlen,
+	const struct virtif_txinfo *vt, void *cookie)
 {
-	size_t tlen, i;
-	int nlocks;
-	void *d;
-	char *d0;
+	struct netfront_seg seg[VIRTIF_MAXFRAGS];
+	size_t i;
+	int flags, nlocks, rv;
+
+	/* the application has the interface, or too many pieces */
+	if (viu->viu_netif || iovlen > VIRTIF_MAXFRAGS) {
+		rump_virtif_txdone(viu->viu_vifsc, cookie);
+		return;
+	}
+
+	flags = 0;
+	if (vt->vt_flags & VIF_TX_CSUM)
+		flags |= NETFRONT_TX_CSUM;
+	if (vt->vt_flags & VIF_TX_TSO4)
+		flags |= NETFRONT_TX_TSO4;
+	if (vt->vt_flags & VIF_TX_TSO6)
+		flags |= NETFRONT_TX_TSO6;
+
+	for (i = 0; i < iovlen; i++) {
+		seg[i].data = iov[i].iov_base;
+		seg[i].len = iov[i].iov_len;
+	}
 
 	rumpkern_unsched(&nlocks, NULL);
-	/*
-	 * netfront doesn't do scatter-gather, so just simply
-	 * copy the data into one lump here.  drop packet if we
-	 * can't allocate temp memory space.
-	 */
-	if (iovlen == 1) {
-		d = iov->iov_base;
-		tlen = iov->iov_len;
-	} else {
-		for (i = 0, tlen = 0; i < iovlen; i++) {
-			tlen += iov[i].iov_len;
-		}
+	rv = netfront_xmit_sg(viu->viu_dev, seg, iovlen,
+	    flags, vt->vt_mss, vt->vt_flowhash, cookie);
+	rumpkern_sched(nlocks, NULL);
 
-		/*
-		 * allocate the temp space from RUMPKERN instead of BMK
-		 * since there are no huge repercussions if we fail or
-		 * succeed.
-		 */
-		d = d0 = bmk_memalloc(tlen, 0, BMK_MEMWHO_RUMPKERN);
-		if (d == NULL)
-			goto out;
+	/* dropped */
+	if (rv != 0)
+		rump_virtif_txdone(viu->viu_vifsc, cookie);
+}
 
-		for (i = 0; i < iovlen; i++) {
-			bmk_memcpy(d0, iov[i].iov_base, iov[i].iov_len);
-			d0 += iov[i].iov_len;
-		}
-	}
+void
+VIFHYPER_FLUSH(struct virtif_user *viu)
+{
+	int i;
 
-	netfront_xmit(viu->viu_dev, d, tlen);
+	netfront_xmit_flush(viu->viu_dev);
+	for (i = 0; i < viu->viu_nqueues; i++)
+		txreap(viu, i);
+}
 
-	if (iovlen != 1)
-		bmk_memfree(d, BMK_MEMWHO_RUMPKERN);
+/*
+ * An mbuf with a page loaned by myrecv() was freed.  Called with the
+ * rump kernel scheduled, but netfront does not care.
+ */
+void
+VIFHYPER_RXDONE(void *cookie, void *data)
+{
 
- out:
-	rumpkern_sched(nlocks, NULL);
+	netfront_rxpage_put(cookie, data);
+}
+
+/*
+ * Release the rings and their pages.  RX slots still holding pages
+ * loaned by netfront give them back.
+ */
+static void
+netring_free(struct rumprun_netif *ni)
+{
+	struct netring_q *nq;
+	struct rumprun_netring *r;
+	unsigned int idx;
+	int i, j;
+
+	for (i = 0; i < ni->ni_nrings; i++) {
+		nq = &ni->ni_q[i];
+		r = &nq->nq_rx;
+		if (r->nr_slot) {
+			for (; nq->nq_rxrel != r->nr_tail; nq->nq_rxrel++) {
+				idx = nq->nq_rxrel & (r->nr_num-1);
+				if (r->nr_slot[idx].ns_buf != nq->nq_rxbuf[idx])
+					netfront_rxpage_put(ni->ni_viu->viu_dev,
+					    r->nr_slot[idx].ns_buf);
+			}
+			bmk_memfree(r->nr_slot, BMK_MEMWHO_RUMPKERN);
+		}
+		if (nq->nq_tx.nr_slot)
+			bmk_memfree(nq->nq_tx.nr_slot, BMK_MEMWHO_RUMPKERN);
+		for (j = 0; j < NETRING_NUM; j++) {
+			if (nq->nq_rxbuf && nq->nq_rxbuf[j])
+				bmk_pgfree_one(nq->nq_rxbuf[j]);
+			if (nq->nq_txbuf && nq->nq_txbuf[j])
+				bmk_pgfree_one(nq->nq_txbuf[j]);
+		}
+		if (nq->nq_rxbuf)
+			bmk_memfree(nq->nq_rxbuf, BMK_MEMWHO_RUMPKERN);
+		if (nq->nq_txbuf)
+			bmk_memfree(nq->nq_txbuf, BMK_MEMWHO_RUMPKERN);
+	}
+	bmk_memfree(ni->ni_q, BMK_MEMWHO_RUMPKERN);
+	bmk_memfree(ni, BMK_MEMWHO_RUMPKERN);
 }
 
 void
 VIFHYPER_DYING(struct virtif_user *viu)
 {
+	int i;
 
 	viu->viu_dying = 1;
-	if (viu->viu_rcvr)
-		bmk_sched_wake(viu->viu_rcvr);
+	for (i = 0; i < viu->viu_nqueues; i++)
+		if (viu->viu_queues[i].viq_rcvr)
+			bmk_sched_wake(viu->viu_queues[i].viq_rcvr);
 }
 
 void
 VIFHYPER_DESTROY(struct virtif_user *viu)
 {
+	struct virtif_user **viup;
+	int i;
 
 	ASSERT(viu->viu_dying == 1);
 
-	bmk_sched_join(viu->viu_thr);
+	for (viup = &viulist; *viup != viu; viup = &(*viup)->viu_next)
+		continue;
+	*viup = viu->viu_next;
+
+	for (i = 0; i < viu->viu_nqueues; i++)
+		bmk_sched_join(viu->viu_queues[i].viq_thr);
+	/* XXX: packets the backend finishes during shutdown are leaked */
+	for (i = 0; i < viu->viu_nqueues; i++)
+		txreap(viu, i);
+	/* XXX: the application should have closed the rings */
+	if (viu->viu_netif) {
+		netring_free(viu->viu_netif);
+		viu->viu_netif = NULL;
+	}
 	netfront_shutdown(viu->viu_dev);
+	bmk_memfree(viu->viu_queues, BMK_MEMWHO_RUMPKERN);
 	bmk_memfree(viu, BMK_MEMWHO_RUMPKERN);
 }
+
+/*
+ * The raw frame rings, see <rumprun/netring.h>.  A ring per netfront
+ * queue.  RX frames come straight from netfront_rx() run in the
+ * caller's context, not via the receive thread, which only reaps
+ * transmitted frames while the rings are open.
+ */
+
+static int
+netring_init(struct rumprun_netring *r, void ***bufp)
+{
+	void **buf;
+	int i;
+
+	r->nr_num = NETRING_NUM;
+	r->nr_bufsize = PAGE_SIZE;
+	r->nr_slot = bmk_memcalloc(NETRING_NUM, sizeof(*r->nr_slot),
+	    BMK_MEMWHO_RUMPKERN);
+	buf = *bufp = bmk_memcalloc(NETRING_NUM, sizeof(*buf),
+	    BMK_MEMWHO_RUMPKERN);
+	if (r->nr_slot == NULL || buf == NULL)
+		return BMK_ENOMEM;
+
+	for (i = 0; i < NETRING_NUM; i++) {
+		if ((buf[i] = bmk_pgalloc_one()) == NULL)
+			return BMK_ENOMEM;
+		r->nr_slot[i].ns_buf = buf[i];
+	}
+
+	return 0;
+}
+
+int
+rumprun_netring_open(int unit, struct rumprun_netif **nip)
+{
+	struct virtif_user *viu;
+	struct rumprun_netif *ni;
+	int i, rv;
+
+	for (viu = viulist; viu; viu = viu->viu_next)
+		if (viu->viu_unit == unit && !viu->viu_dying)
+			break;
+	if (viu == NULL)
+		return BMK_ENXIO;
+	if (viu->viu_netif)
+		return BMK_EBUSY;
+
+	ni = bmk_memcalloc(1, sizeof(*ni), BMK_MEMWHO_RUMPKERN);
+	if (ni == NULL)
+		return BMK_ENOMEM;
+	ni->ni_viu = viu;
+	ni->ni_nrings = viu->viu_nqueues;
+	ni->ni_q = bmk_memcalloc(ni->ni_nrings, sizeof(*ni->ni_q),
+	    BMK_MEMWHO_RUMPKERN);
+	if (ni->ni_q == NULL) {
+		bmk_memfree(ni, BMK_MEMWHO_RUMPKERN);
+		return BMK_ENOMEM;
+	}
+	for (i = 0; i < ni->ni_nrings; i++) {
+		if ((rv = netring_init(&ni->ni_q[i].nq_rx,
+		    &ni->ni_q[i].nq_rxbuf)) != 0
+		  || (rv = netring_init(&ni->ni_q[i].nq_tx,
+		    &ni->ni_q[i].nq_txbuf)) != 0) {
+			netring_free(ni);
+			return rv;
+		}
+		ni->ni_q[i].nq_tx.nr_tail = NETRING_NUM;
+	}
+
+	viu->viu_netif = ni;
+	*nip = ni;
+	return 0;
+}
+
+/*
+ * Wait for the frames in flight, and give the interface back to the
+ * stack.
+ */
+void
+rumprun_netring_close(struct rumprun_netif *ni)
+{
+	struct virtif_user *viu = ni->ni_viu;
+	int i;
+
+	for (i = 0; i < ni->ni_nrings; i++) {
+		while (ni->ni_q[i].nq_txbusy) {
+			rumpuser__hyp.hyp_schedule();
+			txreap(viu, i);
+			rumpuser__hyp.hyp_unschedule();
+			if (ni->ni_q[i].nq_txbusy)
+				bmk_sched_yield();
+		}
+	}
+	viu->viu_netif = NULL;
+	netring_free(ni);
+}
+
+int
+rumprun_netring_nrings(struct rumprun_netif *ni)
+{
+
+	return ni->ni_nrings;
+}
+
+struct rumprun_netring *
+rumprun_netring_rx(struct rumprun_netif *ni, int ring)
+{
+
+	return &ni->ni_q[ring].nq_rx;
+}
+
+struct rumprun_netring *
+rumprun_netring_tx(struct rumprun_netif *ni, int ring)
+{
+
+	return &ni->ni_q[ring].nq_tx;
+}
+
+/*
+ * Give netfront back the pages of the released slots, then receive
+ * as many packets as there are free slots.  Returns the number of
+ * slots holding frames.
+ */
+int
+rumprun_netring_rxsync(struct rumprun_netif *ni, int ring)
+{
+	struct netring_q *nq = &ni->ni_q[ring];
+	struct rumprun_netring *r = &nq->nq_rx;
+	struct rumprun_netring_slot *slot;
+	unsigned int idx;
+
+	for (; nq->nq_rxrel != r->nr_head; nq->nq_rxrel++) {
+		idx = nq->nq_rxrel & (r->nr_num-1);
+		slot = &r->nr_slot[idx];
+		if (slot->ns_buf != nq->nq_rxbuf[idx]) {
+			netfront_rxpage_put(ni->ni_viu->viu_dev, slot->ns_buf);
+			slot->ns_buf = nq->nq_rxbuf[idx];
+		}
+	}
+
+	ni->ni_rxq = ring;
+	netfront_rx(ni->ni_viu->viu_dev, ring,
+	    r->nr_num - (r->nr_tail - r->nr_head));
+
+	return r->nr_tail - r->nr_head;
+}
+
+/*
+ * Send the complete frames the application has added, and free the
+ * slots of the ones netfront is done with.  Returns the number of
+ * free slots.
+ */
+int
+rumprun_netring_txsync(struct rumprun_netif *ni, int ring)
+{
+	struct virtif_user *viu = ni->ni_viu;
+	struct netring_q *nq = &ni->ni_q[ring];
+	struct rumprun_netring *r = &nq->nq_tx;
+	struct rumprun_netring_slot *slot;
+	struct netfront_seg seg[NETRING_MAXSEG];
+	unsigned int idx, first;
+	int n, more;
+
+	for (;;) {
+		for (idx = nq->nq_txsent, n = 0, more = 1;
+		    more && idx != r->nr_head; n++) {
+			slot = &r->nr_slot[idx++ & (r->nr_num-1)];
+			if (n < NETRING_MAXSEG) {
+				seg[n].data = slot->ns_buf;
+				seg[n].len = slot->ns_len;
+			}
+			more = slot->ns_flags & NETRING_F_MORE;
+		}
+		/* nothing, or the rest of the frame is still to come */
+		if (n == 0 || more)
+			break;
+
+		nq->nq_txsent = idx;
+		if (n <= NETRING_MAXSEG && netfront_xmit_sg(viu->viu_dev,
+		    seg, n, 0, 0, ring, NETRING_COOKIE(n)) == 0) {
+			nq->nq_txbusy++;
+		} else {
+			ni->ni_txerr++;
+			if (nq->nq_txbusy == 0)
+				nq->nq_txdone = nq->nq_txsent;
+		}
+	}
+	netfront_xmit_flush(viu->viu_dev);
+
+	rumpuser__hyp.hyp_schedule();
+	txreap(viu, ring);
+	rumpuser__hyp.hyp_unschedule();
+
+	/* the slots come back with their own buffers */
+	for (first = r->nr_tail - r->nr_num; first != nq->nq_txdone; first++) {
+		idx = first & (r->nr_num-1);
+		r->nr_slot[idx].ns_buf = nq->nq_txbuf[idx];
+	}
+	r->nr_tail = nq->nq_txdone + r->nr_num;
+
+	return r->nr_tail - r->nr_head;
+}
+
+/*
+ * Block until netfront has something for the ring.  Wakeups may be
+ * spurious.
+ */
+void
+rumprun_netring_wait(struct rumprun_netif *ni, int ring)
+{
+	struct netring_q *nq = &ni->ni_q[ring];
+	int flags;
+
+	local_irq_save(flags);
+	if (!netfront_rx_pending(ni->ni_viu->viu_dev, ring)
+	    && !netfront_xmit_reapable(ni->ni_viu->viu_dev, ring)) {
+		nq->nq_waiter = bmk_current;
+		bmk_sched_blockprepare();
+		local_irq_restore(flags);
+		bmk_sched_block();
+		local_irq_save(flags);
+		nq->nq_waiter = NULL;
+	}
+	local_irq_restore(flags);
+}
@@ -290,6 +290,7 @@ biocomp(struct blkfront_aiocb *aiocb, int ret)
 	struct biocb *bio = aiocb->data;
 	int dummy, num;
 
+	bmk_trace(BMK_TRACE_BIODONE, ret, (uintptr_t)bio);
 	rumpkern_sched(0, NULL);
 	if (ret)
 		bio->bio_done(bio->bio_arg, 0, BMK_EIO);
@@ -382,6 +383,8 @@ rumpuser_bio(int fd, int op, void *data, size_t dlen, int64_t off,
 	aiocb->aio_cb = biocomp;
 	aiocb->data  = bio;
 
+	bmk_trace(BMK_TRACE_BIOSUBMIT, (op & RUMPUSER_BIO_READ) != 0,
+	    (uintptr_t)bio);
 	if (op & RUMPUSER_BIO_READ)
 		blkfront_aio_read(aiocb);
 	else
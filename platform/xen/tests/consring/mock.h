@@ -0,0 +1,81 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Just enough of Mini-OS and the Xen console interface to compile
+ * console.c and xencons_ring.c on the host.  The Mini-OS and Xen
+ * headers those files include are empty stubs (see test.sh), and
+ * this file is force-included instead.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint16_t domid_t;
+typedef uint32_t evtchn_port_t;
+typedef uint32_t grant_ref_t;
+struct pt_regs;
+struct xenbus_event_queue { int dummy; };
+typedef void (*evtchn_handler_t)(evtchn_port_t, struct pt_regs *, void *);
+
+typedef uint32_t XENCONS_RING_IDX;
+#define MASK_XENCONS_IDX(idx, ring) ((idx) & (sizeof(ring)-1))
+struct xencons_interface {
+	char in[1024];
+	char out[2048];
+	XENCONS_RING_IDX in_cons, in_prod;
+	XENCONS_RING_IDX out_cons, out_prod;
+};
+
+struct mock_start_info {
+	struct {
+		struct {
+			unsigned long mfn;
+			uint32_t evtchn;
+		} domU;
+	} console;
+};
+extern struct mock_start_info start_info;
+void *mfn_to_virt(unsigned long);
+
+#define mb() __sync_synchronize()
+#define wmb() __sync_synchronize()
+#define BUG_ON(x) assert(!(x))
+#define ASSERT(x) assert(x)
+
+#define local_irq_save(x) ((x) = 0)
+#define local_irq_restore(x) ((void)(x))
+
+#define DECLARE_WAIT_QUEUE_HEAD(name) struct wait_queue_head { int wq; } name
+
+#define CONSOLEIO_write 0
+int HYPERVISOR_console_io(int, int, char *);
+
+int minios_notify_remote_via_evtchn(evtchn_port_t);
+evtchn_port_t minios_bind_evtchn(evtchn_port_t, evtchn_handler_t, void *);
+void minios_unmask_evtchn(uint32_t);
+
+#include <mini-os/console.h>
@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Count the hypercalls made by the Xen console output path, using
+# a mock console ring.  Runs on the build host.
+#
+
+set -e
+
+: ${CC:=cc}
+
+TOP=$(cd $(dirname $0)/../../../.. && pwd)
+XEN=${TOP}/platform/xen/xen
+OBJ=$(mktemp -d)
+trap "rm -rf ${OBJ}" 0
+
+# the Mini-OS and Xen headers are stubbed out, mock.h has what's used
+for hdr in mini-os/types.h mini-os/wait.h mini-os/mm.h mini-os/hypervisor.h \
+    mini-os/events.h mini-os/os.h mini-os/lib.h mini-os/xenbus.h \
+    mini-os/gnttab.h mini-os/machine/traps.h xen/grant_table.h \
+    xen/io/console.h xen/io/protocols.h xen/io/ring.h; do
+	mkdir -p ${OBJ}/stub/$(dirname ${hdr})
+	: > ${OBJ}/stub/${hdr}
+done
+cp ${XEN}/include/mini-os/console.h ${OBJ}/stub/mini-os/
+
+${CC} -g -Wall -o ${OBJ}/consring -I${OBJ}/stub -I${TOP}/include \
+    -include $(dirname $0)/mock.h -fno-builtin \
+    $(dirname $0)/consring.c ${XEN}/console/console.c \
+    ${XEN}/console/xencons_ring.c \
+    ${TOP}/lib/libbmk_core/bmk_string.c ${TOP}/lib/libbmk_core/subr_prf.c
+
+${OBJ}/consring
@@ -0,0 +1,414 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Run the rump kernel side of a virtual interface driver, if_virt.c,
+ * with the kernel and the hypervisor side mocked up.  Packets are
+ * delivered in a varying number of pieces through the copying
+ * receive path, rump_virtif_pktdeliver(), and must come out of the
+ * stack end whole, or be dropped and counted if out of mbufs.
+ */
+
+#include "if_virt.h"
+#include "if_virt_user.h"
+
+#define MAXPKT 9018
+
+extern struct if_clone VIF_CLONER;
+
+struct pool_cache *mb_cache;
+static int nmbufs;		/* allocated */
+static int mbuflimit = -1;	/* fail allocations beyond this */
+
+static struct virtif_sc *vsc;
+static struct ifnet *vifp;
+static struct mbuf *input;	/* from ether_input() */
+static int ninput;
+
+static struct mbuf *
+mget(int pkthdr)
+{
+	struct mbuf *m;
+
+	if (mbuflimit >= 0 && nmbufs >= mbuflimit)
+		return NULL;
+	if ((m = calloc(1, sizeof(*m))) == NULL)
+		abort();
+	m->m_data = m->m_dat;
+	m->m_flags = pkthdr ? M_PKTHDR : 0;
+	nmbufs++;
+	return m;
+}
+
+struct mbuf *
+m_get(int how, int type)
+{
+
+	return mget(0);
+}
+
+struct mbuf *
+m_gethdr(int how, int type)
+{
+
+	return mget(1);
+}
+
+void
+pool_cache_put(struct pool_cache *pc, void *m)
+{
+
+	free(m);
+	nmbufs--;
+}
+
+void
+m_freem(struct mbuf *m)
+{
+	struct mbuf *next;
+
+	for (; m; m = next) {
+		next = m->m_next;
+		if (m->m_flags & M_EXT)
+			m->m_extfree(m, m->m_data, m->m_extsize, m->m_extarg);
+		else
+			pool_cache_put(mb_cache, m);
+	}
+}
+
+/*
+ * Like the real one, extend the chain as needed and update the
+ * packet header length only if everything was copied.  Only writes
+ * starting within or right at the end of the data are supported.
+ */
+void
+m_copyback(struct mbuf *m0, int off, int len, const void *vp)
+{
+	const char *cp = vp;
+	struct mbuf *m = m0;
+	int n, end = off + len;
+
+	assert((m0->m_flags & M_EXT) == 0);
+	while (off >= MLEN) {
+		assert(m->m_len == MLEN);
+		off -= MLEN;
+		if (m->m_next == NULL && (m->m_next = m_get(0, 0)) == NULL)
+			return;
+		m = m->m_next;
+	}
+	assert(off <= m->m_len);
+
+	while (len > 0) {
+		n = MLEN - off < len ? MLEN - off : len;
+		memcpy(m->m_data + off, cp, n);
+		if (off + n > m->m_len)
+			m->m_len = off + n;
+		cp += n;
+		len -= n;
+		off = 0;
+		if (len > 0) {
+			if (m->m_next == NULL
+			    && (m->m_next = m_get(0, 0)) == NULL)
+				return;
+			m = m->m_next;
+		}
+	}
+	if ((m0->m_flags & M_PKTHDR) && end > m0->m_pkthdr.len)
+		m0->m_pkthdr.len = end;
+}
+
+void
+m_copydata(struct mbuf *m, int off, int len, void *vp)
+{
+	char *cp = vp;
+	int n;
+
+	for (; m && off >= m->m_len; m = m->m_next)
+		off -= m->m_len;
+	for (; m && len > 0; m = m->m_next, off = 0) {
+		n = m->m_len - off < len ? m->m_len - off : len;
+		memcpy(cp, m->m_data + off, n);
+		cp += n;
+		len -= n;
+	}
+	assert(len == 0);
+}
+
+struct mbuf *
+m_dup(struct mbuf *m0, int off, int len, int how)
+{
+	struct mbuf *m, *mn;
+
+	if ((mn = m_gethdr(how, MT_DATA)) == NULL)
+		return NULL;
+	for (m = m0, off = 0; m; off += m->m_len, m = m->m_next)
+		m_copyback(mn, off, m->m_len, mtod(m, void *));
+	if (mn->m_pkthdr.len != m0->m_pkthdr.len) {
+		m_freem(mn);
+		return NULL;
+	}
+	return mn;
+}
+
+int
+cpu_in_cksum(struct mbuf *m, int len, int off, uint32_t sum)
+{
+
+	return 0;
+}
+
+void
+if_attach(struct ifnet *ifp)
+{
+
+	vifp = ifp;
+}
+
+void
+if_detach(struct ifnet *ifp)
+{
+
+	vifp = NULL;
+}
+
+void
+if_down(struct ifnet *ifp)
+{
+}
+
+void
+ether_ifattach(struct ifnet *ifp, const uint8_t *enaddr)
+{
+}
+
+void
+ether_ifdetach(struct ifnet *ifp)
+{
+}
+
+int
+ether_ioctl(struct ifnet *ifp, u_long cmd, void *data)
+{
+
+	return 0;
+}
+
+void
+ether_input(struct ifnet *ifp, struct mbuf *m)
+{
+
+	assert(m->m_pkthdr.rcvif == ifp);
+	if (input == NULL)
+		input = m;
+	else
+		m_freem(m);
+	ninput++;
+}
+
+char *
+ether_snprintf(char *buf, size_t len, const uint8_t *ea)
+{
+
+	snprintf(buf, len, "%02x:%02x:%02x:%02x:%02x:%02x",
+	    ea[0], ea[1], ea[2], ea[3], ea[4], ea[5]);
+	return buf;
+}
+
+int
+sysctl_lookup(SYSCTLFN_ARGS)
+{
+
+	return 0;
+}
+
+int
+sysctl_createv(struct sysctllog **log, int cflags,
+	const struct sysctlnode **rnode, const struct sysctlnode **cnode,
+	int flags, int type, const char *name, const char *descr,
+	void *func, u_quad_t qv, void *newp, size_t newlen, ...)
+{
+
+	return 0;
+}
+
+void
+sysctl_teardown(struct sysctllog **log)
+{
+}
+
+/* the hypervisor side */
+int
+VIFHYPER_CREATE(int num, struct virtif_sc *sc, uint8_t *enaddr, int *caps,
+	struct virtif_user **viup)
+{
+
+	vsc = sc;
+	*caps = 0;
+	*viup = (struct virtif_user *)sc;
+	return 0;
+}
+
+void
+VIFHYPER_DYING(struct virtif_user *viu)
+{
+}
+
+void
+VIFHYPER_DESTROY(struct virtif_user *viu)
+{
+
+	vsc = NULL;
+}
+
+void
+VIFHYPER_SEND(struct virtif_user *viu, struct iovec *iov, size_t iovlen,
+	const struct virtif_txinfo *vt, void *cookie)
+{
+
+	rump_virtif_txdone(vsc, cookie);
+}
+
+void
+VIFHYPER_FLUSH(struct virtif_user *viu)
+{
+}
+
+void
+VIFHYPER_RXDONE(void *arg, void *buf)
+{
+}
+
+/*
+ * Deliver a frame of len bytes split into nseg pieces of about equal
+ * size, with limit mbufs available.  Returns the delivered packet,
+ * or NULL if it was dropped.
+ */
+static struct mbuf *
+deliver(int len, int nseg, int limit)
+{
+	static unsigned char pkt[MAXPKT];
+	struct iovec iov[16];
+	int i, off;
+
+	assert(nseg <= 16 && len <= MAXPKT);
+	for (i = 0; i < len; i++)
+		pkt[i] = i * 7 + nseg;
+	for (i = 0, off = 0; i < nseg; i++) {
+		iov[i].iov_base = pkt + off;
+		iov[i].iov_len = i == nseg-1 ? len - off : len / nseg;
+		off += iov[i].iov_len;
+	}
+
+	input = NULL;
+	ninput = 0;
+	mbuflimit = limit;
+	rump_virtif_pktdeliver(vsc, iov, nseg, 0);
+	rump_virtif_pktflush(vsc);
+	mbuflimit = -1;
+
+	if (input) {
+		static unsigned char got[MAXPKT];
+
+		if (ninput != 1 || input->m_pkthdr.len != len) {
+			printf("FAIL: %d bytes in %d pieces: %d packets, "
+			    "%d bytes\n", len, nseg, ninput,
+			    input->m_pkthdr.len);
+			m_freem(input);
+			return NULL;
+		}
+		m_copydata(input, 0, len, got);
+		if (memcmp(got, pkt, len) != 0) {
+			printf("FAIL: %d bytes in %d pieces: data "
+			    "differs\n", len, nseg);
+			m_freem(input);
+			return NULL;
+		}
+	}
+	return input;
+}
+
+static int
+test_pktdeliver(void)
+{
+	static const struct {
+		int len, nseg;
+	} t[] = {
+		{ 60, 1 }, { 1514, 1 }, { 1514, 2 }, { 4000, 2 },
+		{ 9014, 3 }, { 9018, 5 }, { 9014, 16 },
+	};
+	struct mbuf *m;
+	uint64_t drops;
+	unsigned int i;
+	int rv = 0;
+
+	if (VIF_CLONER.ifc_create(&VIF_CLONER, 0) != 0 || vifp == NULL) {
+		printf("FAIL: create interface\n");
+		return 1;
+	}
+	vifp->if_init(vifp);
+
+	for (i = 0; i < sizeof(t)/sizeof(t[0]); i++) {
+		if ((m = deliver(t[i].len, t[i].nseg, -1)) == NULL) {
+			printf("FAIL: %d bytes in %d pieces not delivered\n",
+			    t[i].len, t[i].nseg);
+			rv = 1;
+			continue;
+		}
+		m_freem(m);
+	}
+
+	/* a jumbo frame needs several mbufs, have only the first */
+	drops = vifp->if_iqdrops;
+	if ((m = deliver(9014, 3, 1)) != NULL) {
+		printf("FAIL: delivered without mbufs\n");
+		m_freem(m);
+		rv = 1;
+	}
+	if (vifp->if_iqdrops != drops + 1) {
+		printf("FAIL: drop not counted\n");
+		rv = 1;
+	}
+
+	VIF_CLONER.ifc_destroy(vifp);
+	if (vsc != NULL) {
+		printf("FAIL: destroy interface\n");
+		rv = 1;
+	}
+	if (nmbufs != 0) {
+		printf("FAIL: leaked %d mbufs\n", nmbufs);
+		rv = 1;
+	}
+	return rv;
+}
+
+int
+main(void)
+{
+	int rv;
+
+	rv = test_pktdeliver();
+	printf("%s\n", rv ? "FAILED" : "OK");
+	return rv;
+}
@@ -0,0 +1,296 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Just enough of the NetBSD kernel to compile the rump kernel side
+ * of the virtual interface drivers, if_virt.c, on the host.  The
+ * kernel headers it includes are empty stubs (see test.sh), and this
+ * file is force-included instead.  Mbufs have room for MLEN bytes
+ * each, so that m_copyback() builds chains like the real one does.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define __KERNEL_RCSID(n, s) struct __hack
+#define __NetBSD_Prereq__(a, b, c) 1
+#define __predict_true(x) (x)
+#define __predict_false(x) (x)
+#define __packed __attribute__((__packed__))
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define htons(x) __builtin_bswap16(x)
+#else
+#define htons(x) (x)
+#endif
+
+struct lwp;
+
+/* mbufs */
+#define MLEN 2048
+#define M_EXT		0x01
+#define M_PKTHDR	0x02
+#define M_EXT_RW	0x04
+#define M_NOWAIT 0
+#define M_DONTWAIT M_NOWAIT
+#define M_COPYALL 1000000000
+#define MT_DATA 1
+#define M_DEVBUF 0
+
+#define M_CSUM_TCPv4	0x01
+#define M_CSUM_UDPv4	0x02
+#define M_CSUM_TCPv6	0x04
+#define M_CSUM_UDPv6	0x08
+#define M_CSUM_TSOv4	0x10
+#define M_CSUM_TSOv6	0x20
+#define M_CSUM_DATA_IPv6_HL(x) ((x) >> 16)
+
+struct ifnet;
+struct mbuf {
+	struct mbuf *m_next;
+	struct mbuf *m_nextpkt;
+	char *m_data;
+	int m_len;
+	int m_flags;
+	struct {
+		int len;
+		int csum_flags;
+		uint32_t csum_data;
+		int segsz;
+		struct ifnet *rcvif;
+	} m_pkthdr;
+	void (*m_extfree)(struct mbuf *, void *, size_t, void *);
+	void *m_extarg;
+	size_t m_extsize;
+	char m_dat[MLEN];
+};
+#define mtod(m, t) ((t)((m)->m_data))
+
+struct mbuf *m_get(int, int);
+struct mbuf *m_gethdr(int, int);
+void m_freem(struct mbuf *);
+void m_copyback(struct mbuf *, int, int, const void *);
+void m_copydata(struct mbuf *, int, int, void *);
+struct mbuf *m_dup(struct mbuf *, int, int, int);
+#define m_set_rcvif(m, ifp) ((m)->m_pkthdr.rcvif = (ifp))
+#define MEXTADD(m, buf, size, type, free, arg) do {			\
+	(m)->m_data = (void *)(buf);					\
+	(m)->m_flags |= M_EXT;						\
+	(m)->m_extsize = (size);					\
+	(m)->m_extfree = (free);					\
+	(m)->m_extarg = (arg);						\
+} while (0)
+
+struct pool_cache;
+extern struct pool_cache *mb_cache;
+void pool_cache_put(struct pool_cache *, void *);
+
+/* network interfaces */
+#define IFNAMSIZ 16
+#define IFF_BROADCAST	0x0002
+#define IFF_RUNNING	0x0040
+#define IFF_SIMPLEX	0x0800
+#define IFF_OACTIVE	0x0400
+#define IFF_MULTICAST	0x8000
+
+#define IFCAP_CSUM_TCPv4_Rx	0x0001
+#define IFCAP_CSUM_TCPv4_Tx	0x0002
+#define IFCAP_CSUM_UDPv4_Rx	0x0004
+#define IFCAP_CSUM_UDPv4_Tx	0x0008
+#define IFCAP_CSUM_TCPv6_Rx	0x0010
+#define IFCAP_CSUM_TCPv6_Tx	0x0020
+#define IFCAP_CSUM_UDPv6_Rx	0x0040
+#define IFCAP_CSUM_UDPv6_Tx	0x0080
+#define IFCAP_TSOv4		0x0100
+#define IFCAP_TSOv6		0x0200
+#define ETHERCAP_JUMBO_MTU	0x0002
+
+struct ifqueue {
+	struct mbuf *ifq_head;
+	struct mbuf *ifq_tail;
+	int ifq_len;
+	int ifq_maxlen;
+	int ifq_drops;
+};
+#define IF_QFULL(ifq) ((ifq)->ifq_len >= (ifq)->ifq_maxlen)
+#define IF_DROP(ifq) ((ifq)->ifq_drops++)
+#define IF_ENQUEUE(ifq, m) do {						\
+	(m)->m_nextpkt = NULL;						\
+	if ((ifq)->ifq_tail == NULL)					\
+		(ifq)->ifq_head = (m);					\
+	else								\
+		(ifq)->ifq_tail->m_nextpkt = (m);			\
+	(ifq)->ifq_tail = (m);						\
+	(ifq)->ifq_len++;						\
+} while (0)
+#define IF_DEQUEUE(ifq, m) do {						\
+	(m) = (ifq)->ifq_head;						\
+	if (m) {							\
+		if (((ifq)->ifq_head = (m)->m_nextpkt) == NULL)		\
+			(ifq)->ifq_tail = NULL;				\
+		(m)->m_nextpkt = NULL;					\
+		(ifq)->ifq_len--;					\
+	}								\
+} while (0)
+#define IFQ_SET_READY(ifq) ((void)(ifq))
+
+struct ifnet {
+	char if_xname[IFNAMSIZ];
+	void *if_softc;
+	int if_flags;
+	int (*if_init)(struct ifnet *);
+	int (*if_ioctl)(struct ifnet *, u_long, void *);
+	void (*if_start)(struct ifnet *);
+	void (*if_stop)(struct ifnet *, int);
+	struct ifqueue if_snd;
+	int if_capabilities;
+	int if_capenable;
+	int if_csum_flags_tx;
+	int if_csum_flags_rx;
+	uint64_t if_ipackets, if_ierrors, if_opackets, if_oerrors;
+	uint64_t if_ibytes, if_obytes, if_iqdrops;
+};
+
+struct ethercom {
+	struct ifnet ec_if;
+	int ec_capabilities;
+};
+
+struct if_clone {
+	const char *ifc_name;
+	int (*ifc_create)(struct if_clone *, int);
+	int (*ifc_destroy)(struct ifnet *);
+};
+#define IF_CLONE_INITIALIZER(name, create, destroy)			\
+	{ name, create, destroy }
+
+void if_attach(struct ifnet *);
+void if_detach(struct ifnet *);
+void if_down(struct ifnet *);
+void ether_ifattach(struct ifnet *, const uint8_t *);
+void ether_ifdetach(struct ifnet *);
+int ether_ioctl(struct ifnet *, u_long, void *);
+void ether_input(struct ifnet *, struct mbuf *);
+char *ether_snprintf(char *, size_t, const uint8_t *);
+#define bpf_mtap(ifp, m) ((void)(ifp), (void)(m))
+
+#define aprint_normal_ifnet(ifp, ...) ((void)(ifp))
+#define aprint_verbose_ifnet(ifp, ...) ((void)(ifp))
+
+/* protocol headers */
+#define ETHER_ADDR_LEN 6
+#define ETHER_HDR_LEN 14
+#define ETHERTYPE_IP 0x0800
+#define ETHERTYPE_IPV6 0x86dd
+
+struct ether_header {
+	uint8_t ether_dhost[ETHER_ADDR_LEN];
+	uint8_t ether_shost[ETHER_ADDR_LEN];
+	uint16_t ether_type;
+} __packed;
+
+struct in_addr {
+	uint32_t s_addr;
+};
+struct in6_addr {
+	uint8_t s6_addr[16];
+};
+
+#define IPPROTO_TCP 6
+#define IPPROTO_UDP 17
+#define IP_MF 0x2000
+#define IP_OFFMASK 0x1fff
+
+struct ip {
+	unsigned int ip_hl:4, ip_v:4;
+	uint8_t ip_tos;
+	uint16_t ip_len, ip_id, ip_off;
+	uint8_t ip_ttl, ip_p;
+	uint16_t ip_sum;
+	struct in_addr ip_src, ip_dst;
+} __packed;
+
+struct ip6_hdr {
+	uint32_t ip6_flow;
+	uint16_t ip6_plen;
+	uint8_t ip6_nxt, ip6_hlim;
+	struct in6_addr ip6_src, ip6_dst;
+} __packed;
+
+struct tcphdr {
+	uint16_t th_sport, th_dport;
+	uint32_t th_seq, th_ack;
+	uint8_t th_offx2, th_flags;
+	uint16_t th_win, th_sum, th_urp;
+};
+
+struct udphdr {
+	uint16_t uh_sport, uh_dport, uh_ulen, uh_sum;
+};
+
+int cpu_in_cksum(struct mbuf *, int, int, uint32_t);
+
+/* sysctl */
+struct sysctllog;
+struct sysctlnode {
+	void *sysctl_data;
+};
+#define SYSCTLFN_ARGS const int *name, u_int namelen, void *oldp,	\
+	size_t *oldlenp, const void *newp, size_t newlen,		\
+	const int *oldname, struct lwp *l, const struct sysctlnode *rnode
+#define SYSCTLFN_CALL(node) name, namelen, oldp, oldlenp, newp, newlen, \
+	oldname, l, node
+#define SYSCTL_DESCR(s) s
+#define CTLFLAG_PERMANENT 0x1
+#define CTLFLAG_READWRITE 0x2
+#define CTLTYPE_NODE 1
+#define CTLTYPE_INT 2
+#define CTL_NET 4
+#define CTL_CREATE -1
+#define CTL_EOL -2
+int sysctl_lookup(SYSCTLFN_ARGS);
+int sysctl_createv(struct sysctllog **, int, const struct sysctlnode **,
+	const struct sysctlnode **, int, int, const char *, const char *,
+	void *, u_quad_t, void *, size_t, ...);
+void sysctl_teardown(struct sysctllog **);
+
+/* the rest */
+#define KM_SLEEP 0
+#define kmem_zalloc(size, flags) calloc(1, size)
+#define kmem_free(p, size) free(p)
+#define cprng_fast32() 0x5a5a5a5aU
+#define splnet() 0
+#define splx(s) ((void)(s))
+#define KERNEL_LOCK(n, l) ((void)0)
+#define KERNEL_UNLOCK_LAST(l) ((void)0)
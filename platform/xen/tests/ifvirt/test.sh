@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# Run the rump kernel side of the virtual interface drivers, if_virt.c,
+# with the kernel and the hypervisor side mocked up.  It is built as
+# each driver, xenif and vionet, builds it.  Runs on the build host.
+#
+
+set -e
+
+: ${CC:=cc}
+
+TOP=$(cd $(dirname $0)/../../../.. && pwd)
+OBJ=$(mktemp -d)
+trap "rm -rf ${OBJ}" 0
+
+# the kernel headers are stubbed out, kmock.h has what's used
+for hdr in sys/param.h sys/condvar.h sys/fcntl.h sys/kernel.h sys/kmem.h \
+    sys/kthread.h sys/mbuf.h sys/mutex.h sys/poll.h sys/sockio.h \
+    sys/socketvar.h sys/sysctl.h sys/cprng.h net/bpf.h net/if.h \
+    net/if_ether.h net/if_tap.h netinet/in.h netinet/in_systm.h \
+    netinet/in_var.h netinet/ip.h netinet/ip6.h netinet/tcp.h \
+    netinet/udp.h rump/rump.h rump_private.h rump_net_private.h; do
+	mkdir -p ${OBJ}/stub/$(dirname ${hdr})
+	: > ${OBJ}/stub/${hdr}
+done
+
+CFLAGS="-g -Wall -Wno-format-truncation -I${OBJ}/stub"
+CFLAGS="${CFLAGS} -include $(dirname $0)/kmock.h"
+
+VIRTIF=${TOP}/platform/virtif
+for base in xenif vionet; do
+	${CC} ${CFLAGS} -DVIRTIF_BASE=${base} -I${VIRTIF} \
+	    -o ${OBJ}/ifvirt_${base} $(dirname $0)/ifvirt.c \
+	    ${VIRTIF}/if_virt.c
+	printf '%s: ' ${base}
+	${OBJ}/ifvirt_${base}
+done
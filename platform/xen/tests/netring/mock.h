@@ -0,0 +1,248 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Just enough of Mini-OS, the Xen netif interface and the rump kernel
+ * hypercalls to compile netfront.c and xenif_user.c on the host.  The Mini-OS and Xen headers it includes
+ * are empty stubs (see test.sh), and this file is force-included
+ * instead.  The ring macros follow xen/io/ring.h.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef uint16_t domid_t;
+typedef uint32_t evtchn_port_t;
+typedef uint32_t grant_ref_t;
+struct pt_regs;
+struct xenbus_event_queue { int dummy; };
+typedef void (*evtchn_handler_t)(evtchn_port_t, struct pt_regs *, void *);
+
+#define PAGE_SIZE 4096
+#define PAGE_MASK (~(PAGE_SIZE-1))
+#define virt_to_mfn(v) ((unsigned long)(v) / PAGE_SIZE)
+
+#define mb() __sync_synchronize()
+#define rmb() __sync_synchronize()
+#define wmb() __sync_synchronize()
+#define BUG_ON(x) assert(!(x))
+#define ASSERT(x) assert(x)
+
+#define local_irq_save(x) ((x) = 0)
+#define local_irq_restore(x) ((void)(x))
+
+#define DECLARE_WAIT_QUEUE_HEAD(name) struct wait_queue_head { int wq; } name
+
+#define minios_printk printf
+void minios_do_exit(void);
+
+struct semaphore { int count; };
+#define init_SEMAPHORE(s, n) ((s)->count = (n))
+#define init_MUTEX(s) init_SEMAPHORE(s, 1)
+#define trydown(s) ((s)->count > 0 ? (s)->count-- : 0)
+/* down() would block: let the other threads run */
+void mock_block(void);
+#define down(s) do {							\
+	if ((s)->count == 0)						\
+		mock_block();						\
+	assert((s)->count > 0);						\
+	(s)->count--;							\
+} while (0)
+#define up(s) ((s)->count++)
+
+grant_ref_t gnttab_grant_access(domid_t, unsigned long, int);
+int gnttab_end_access(grant_ref_t);
+
+int minios_evtchn_alloc_unbound(domid_t, evtchn_handler_t, void *,
+	evtchn_port_t *);
+int minios_notify_remote_via_evtchn(evtchn_port_t);
+void minios_mask_evtchn(uint32_t);
+void minios_unmask_evtchn(uint32_t);
+void minios_unbind_evtchn(evtchn_port_t);
+
+typedef unsigned long xenbus_transaction_t;
+#define XBT_NIL ((xenbus_transaction_t)0)
+typedef enum {
+	XenbusStateUnknown, XenbusStateInitialising, XenbusStateInitWait,
+	XenbusStateInitialised, XenbusStateConnected, XenbusStateClosing,
+	XenbusStateClosed,
+} XenbusState;
+char *xenbus_transaction_start(xenbus_transaction_t *);
+char *xenbus_transaction_end(xenbus_transaction_t, int, int *);
+char *xenbus_printf(xenbus_transaction_t, const char *, const char *,
+	const char *, ...);
+char *xenbus_switch_state(xenbus_transaction_t, const char *, XenbusState);
+char *xenbus_read(xenbus_transaction_t, const char *, char **);
+int xenbus_read_integer(const char *);
+char *xenbus_rm(xenbus_transaction_t, const char *);
+char *xenbus_watch_path_token(xenbus_transaction_t, const char *,
+	const char *, struct xenbus_event_queue *);
+char *xenbus_unwatch_path_token(xenbus_transaction_t, const char *,
+	const char *);
+char *xenbus_wait_for_state_change(const char *, XenbusState *,
+	struct xenbus_event_queue *);
+void xenbus_event_queue_init(struct xenbus_event_queue *);
+
+/* xen/io/ring.h */
+typedef uint32_t RING_IDX;
+
+#define __RD2(_x)  (((_x) & 0x00000002) ? 0x2 : ((_x) & 0x1))
+#define __RD4(_x)  (((_x) & 0x0000000c) ? __RD2((_x)>>2)<<2 : __RD2(_x))
+#define __RD8(_x)  (((_x) & 0x000000f0) ? __RD4((_x)>>4)<<4 : __RD4(_x))
+#define __RD16(_x) (((_x) & 0x0000ff00) ? __RD8((_x)>>8)<<8 : __RD8(_x))
+#define __RD32(_x) (((_x) & 0xffff0000) ? __RD16((_x)>>16)<<16 : __RD16(_x))
+
+#define __CONST_RING_SIZE(_s, _sz)					\
+	(__RD32(((_sz) - offsetof(struct _s##_sring, ring)) /		\
+	    sizeof(((struct _s##_sring *)0)->ring[0])))
+
+#define DEFINE_RING_TYPES(__name, __req_t, __rsp_t)			\
+union __name##_sring_entry {						\
+	__req_t req;							\
+	__rsp_t rsp;							\
+};									\
+struct __name##_sring {							\
+	RING_IDX req_prod, req_event;					\
+	RING_IDX rsp_prod, rsp_event;					\
+	uint8_t pad[48];						\
+	union __name##_sring_entry ring[1];				\
+};									\
+struct __name##_front_ring {						\
+	RING_IDX req_prod_pvt;						\
+	RING_IDX rsp_cons;						\
+	unsigned int nr_ents;						\
+	struct __name##_sring *sring;					\
+}
+
+#define SHARED_RING_INIT(_s) do {					\
+	(_s)->req_prod = (_s)->rsp_prod = 0;				\
+	(_s)->req_event = (_s)->rsp_event = 1;				\
+	memset((_s)->pad, 0, sizeof((_s)->pad));			\
+} while (0)
+
+#define FRONT_RING_INIT(_r, _s, _size) do {				\
+	(_r)->req_prod_pvt = 0;						\
+	(_r)->rsp_cons = 0;						\
+	(_r)->nr_ents = __RD32(((_size) - offsetof(__typeof__(*(_s)),	\
+	    ring)) / sizeof((_s)->ring[0]));				\
+	(_r)->sring = (_s);						\
+} while (0)
+
+#define RING_GET_REQUEST(_r, _idx)					\
+	(&((_r)->sring->ring[((_idx) & ((_r)->nr_ents - 1))].req))
+#define RING_GET_RESPONSE(_r, _idx)					\
+	(&((_r)->sring->ring[((_idx) & ((_r)->nr_ents - 1))].rsp))
+#define RING_HAS_UNCONSUMED_RESPONSES(_r)				\
+	((_r)->sring->rsp_prod - (_r)->rsp_cons)
+
+#define RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(_r, _notify) do {		\
+	RING_IDX __old = (_r)->sring->req_prod;				\
+	RING_IDX __new = (_r)->req_prod_pvt;				\
+	wmb();								\
+	(_r)->sring->req_prod = __new;					\
+	mb();								\
+	(_notify) = ((RING_IDX)(__new - (_r)->sring->req_event) <	\
+	    (RING_IDX)(__new - __old));					\
+} while (0)
+
+#define RING_FINAL_CHECK_FOR_RESPONSES(_r, _work_to_do) do {		\
+	(_work_to_do) = RING_HAS_UNCONSUMED_RESPONSES(_r);		\
+	if (_work_to_do)						\
+		break;							\
+	(_r)->sring->rsp_event = (_r)->rsp_cons + 1;			\
+	mb();								\
+	(_work_to_do) = RING_HAS_UNCONSUMED_RESPONSES(_r);		\
+} while (0)
+
+/* xen/io/netif.h */
+#define NETIF_RSP_ERROR -1
+#define NETIF_RSP_OKAY 0
+#define NETIF_RSP_NULL 1
+
+#define NETTXF_csum_blank (1U<<0)
+#define NETTXF_data_validated (1U<<1)
+#define NETTXF_more_data (1U<<2)
+#define NETTXF_extra_info (1U<<3)
+#define NETRXF_data_validated (1U<<0)
+#define NETRXF_csum_blank (1U<<1)
+#define NETRXF_more_data (1U<<2)
+
+/* XEN_NETIF_GSO_TYPE_TCPV6 is missing, like in older headers */
+#define XEN_NETIF_EXTRA_TYPE_GSO 1
+#define XEN_NETIF_GSO_TYPE_TCPV4 1
+
+struct netif_extra_info {
+	uint8_t type;
+	uint8_t flags;
+	union {
+		struct {
+			uint16_t size;
+			uint8_t type;
+			uint8_t pad;
+			uint16_t features;
+		} gso;
+		uint16_t pad[3];
+	} u;
+};
+
+typedef struct netif_tx_request {
+	grant_ref_t gref;
+	uint16_t offset;
+	uint16_t flags;
+	uint16_t id;
+	uint16_t size;
+} netif_tx_request_t;
+typedef struct netif_tx_response {
+	uint16_t id;
+	int16_t status;
+} netif_tx_response_t;
+typedef struct netif_rx_request {
+	uint16_t id;
+	grant_ref_t gref;
+} netif_rx_request_t;
+typedef struct netif_rx_response {
+	uint16_t id;
+	uint16_t offset;
+	uint16_t flags;
+	int16_t status;
+} netif_rx_response_t;
+
+DEFINE_RING_TYPES(netif_tx, struct netif_tx_request,
+	struct netif_tx_response);
+DEFINE_RING_TYPES(netif_rx, struct netif_rx_request,
+	struct netif_rx_response);
+
+#include <mini-os/netfront.h>
+
+/* rump/rumpuser.h */
+struct rumpuser_hyperup {
+	void (*hyp_schedule)(void);
+	void (*hyp_unschedule)(void);
+	void (*hyp_backend_unschedule)(int, int *, void *);
+	void (*hyp_backend_schedule)(int, void *);
+	int (*hyp_lwproc_newlwp)(int);
+};
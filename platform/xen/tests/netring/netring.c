@@ -0,0 +1,1760 @@
+/*-
+ * Copyright (c) 2026 The rumprun contributors.  All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Measure the copies and page allocations per packet in the netfront
+ * receive and transmit paths, with the rings, grant tables and the
+ * backend mocked up.  The backend fills the posted receive buffers,
+ * and the upper layer (the netif_rx callback here) either frees the
+ * packets right away or holds on to them, like a stack with a full
+ * socket buffer.  On transmit, the backend checks every packet
+ * against what was sent, the way netback reads the granted slots,
+ * and picks up the checksum and segmentation offload requests.
+ * A backend doing multi-queue gets a set of rings and an event
+ * channel per queue.  Packets larger than a page, i.e. jumbo frames,
+ * are received in several slots.  Grant table operations are counted
+ * too, since small packets should get by without any.
+ *
+ * Finally, the xenif receive thread is run on top of netfront, with
+ * the rump kernel side mocked up, to count how often it enters the
+ * rump kernel and the stack per packet, and packets are forwarded
+ * from the xenif raw frame RX ring to the TX ring.
+ */
+
+#include <sys/uio.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <bmk-core/memalloc.h>
+#include <bmk-core/pgalloc.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/printf.h>
+#include <bmk-core/sched.h>
+
+#include <rumprun/netring.h>
+
+#include "if_virt.h"
+#include "if_virt_user.h"
+
+#define NGRANT 8192
+#define MAXHOLD 8192
+#define PKTLEN 1514
+#define JUMBOLEN 9014
+#define BURST 32
+#define NREAP 32
+#define MAXQ 8
+#define NPORT 16
+#define NFLOW 64
+
+#define NET_RX_RING_SIZE __CONST_RING_SIZE(netif_rx, PAGE_SIZE)
+#define NET_TX_RING_SIZE __CONST_RING_SIZE(netif_tx, PAGE_SIZE)
+
+static void *grants[NGRANT];
+static unsigned long ngrant, nungrant;
+/* what the backend knows about each queue */
+static struct backq {
+	struct netif_rx_sring *rxs;
+	RING_IDX req_cons, rsp_prod;
+	struct netif_tx_sring *txs;
+	RING_IDX tx_cons;
+	evtchn_port_t port;
+	unsigned long ntxpkt;
+} bq[MAXQ];
+static int backend_sg = 1, backend_gso = 1, backend_maxq;
+static int frontcsum, frontnq, frontflat, frontsg;
+
+static unsigned char txexpect[16*PAGE_SIZE];
+static unsigned long txexpectlen, ntxpkt, ntxslot, ntxbad;
+static unsigned long ntxnotify, ntxevent;
+static int txflags, txgsotype, txgsosize;
+static int rxflags, rxgotflags;
+static unsigned long rxpktlen = PKTLEN, nrxslot, rxseq;
+static int rxbad;
+static int txbatch = BURST;
+static int txfwd;
+
+static evtchn_handler_t evhandler[NPORT];
+static void *evarg[NPORT];
+static int masked[NPORT], pending[NPORT];
+
+static struct netfront_dev *dev;
+static void *held[MAXHOLD];
+static int nheld, hold;
+
+static unsigned long ncopy, ncopybytes, npgalloc, npkt, nwake, nbad;
+static long npages, nmem;
+
+void *mock_memcpy(void *, const void *, unsigned long);
+
+void *
+mock_memcpy(void *d, const void *s, unsigned long n)
+{
+
+	ncopy++;
+	ncopybytes += n;
+	return memcpy(d, s, n);
+}
+
+void *
+bmk_pgalloc(int order)
+{
+	void *p;
+
+	npgalloc++;
+	npages += 1<<order;
+	if ((p = aligned_alloc(PAGE_SIZE, PAGE_SIZE<<order)) == NULL)
+		abort();
+	return p;
+}
+
+void
+bmk_pgfree(void *p, int order)
+{
+
+	npages -= 1<<order;
+	free(p);
+}
+
+void *
+bmk_memalloc(unsigned long size, unsigned long align, enum bmk_memwho who)
+{
+
+	nmem++;
+	return malloc(size);
+}
+
+void *
+bmk_memcalloc(unsigned long n, unsigned long size, enum bmk_memwho who)
+{
+
+	nmem++;
+	return calloc(n, size);
+}
+
+void
+bmk_memfree(void *p, enum bmk_memwho who)
+{
+
+	if (p)
+		nmem--;
+	free(p);
+}
+
+static char *
+mock_strdup(const char *s)
+{
+	char *p;
+
+	p = bmk_memalloc(strlen(s)+1, 0, BMK_MEMWHO_WIREDBMK);
+	return strcpy(p, s);
+}
+
+grant_ref_t
+gnttab_grant_access(domid_t dom, unsigned long mfn, int ro)
+{
+	static grant_ref_t next = 1;
+	grant_ref_t ref;
+	int i;
+
+	for (i = 0; i < NGRANT; i++) {
+		ref = next;
+		next = next % (NGRANT-1) + 1;
+		if (grants[ref] == NULL) {
+			ngrant++;
+			grants[ref] = (void *)(mfn * PAGE_SIZE);
+			return ref;
+		}
+	}
+	abort();
+}
+
+int
+gnttab_end_access(grant_ref_t ref)
+{
+
+	if (grants[ref] == NULL)
+		abort();
+	nungrant++;
+	grants[ref] = NULL;
+	return 1;
+}
+
+int
+minios_evtchn_alloc_unbound(domid_t dom, evtchn_handler_t handler,
+	void *arg, evtchn_port_t *port)
+{
+	evtchn_port_t p;
+
+	/* unbound ports are reused, interfaces come and go */
+	for (p = 1; p < NPORT && evhandler[p]; p++)
+		continue;
+	if (p == NPORT)
+		abort();
+	evhandler[p] = handler;
+	evarg[p] = arg;
+	masked[p] = 1;
+	pending[p] = 0;
+	*port = p;
+	return 0;
+}
+
+static void
+raise(evtchn_port_t port)
+{
+
+	if (masked[port])
+		pending[port] = 1;
+	else
+		evhandler[port](port, NULL, evarg[port]);
+}
+
+/* forwarded packets are the received ones, in order */
+static int
+fwdok(const unsigned char *pkt, unsigned long len)
+{
+	static unsigned char expect[JUMBOLEN];
+
+	if (len != rxpktlen || len > sizeof(expect))
+		return 0;
+	memset(expect, ntxpkt & 0xff, len);
+	return memcmp(pkt, expect, len) == 0;
+}
+
+/*
+ * Consume the transmit ring like netback: the first slot has the
+ * size of the packet, the rest their own size, and every slot but
+ * the last has NETTXF_more_data set.  If the first slot has
+ * NETTXF_extra_info, the slot after it describes the segmentation.
+ * The extra info slot gets a NETIF_RSP_NULL response.
+ */
+static void
+backend_tx(struct backq *q)
+{
+	static unsigned char pkt[sizeof(txexpect)];
+	struct netif_tx_request *req[NET_TX_RING_SIZE];
+	struct netif_tx_response *rsp;
+	struct netif_extra_info *extra;
+	struct netif_tx_sring *txs = q->txs;
+	RING_IDX old = txs->rsp_prod, prod = old;
+	unsigned long len, rest;
+	unsigned char *page;
+	int i, n;
+
+	while (q->tx_cons != txs->req_prod) {
+		n = 0;
+		req[n] = &txs->ring[q->tx_cons++ & (NET_TX_RING_SIZE-1)].req;
+		txflags = req[0]->flags;
+		txgsotype = txgsosize = 0;
+		if (txflags & NETTXF_extra_info) {
+			extra = (void *)&txs->ring[q->tx_cons++
+			    & (NET_TX_RING_SIZE-1)].req;
+			if (extra->type != XEN_NETIF_EXTRA_TYPE_GSO)
+				ntxbad++;
+			txgsotype = extra->u.gso.type;
+			txgsosize = extra->u.gso.size;
+			ntxslot++;
+		}
+		while (req[n++]->flags & NETTXF_more_data) {
+			req[n] = &txs->ring[q->tx_cons++
+			    & (NET_TX_RING_SIZE-1)].req;
+		}
+
+		for (i = 1, rest = 0; i < n; i++)
+			rest += req[i]->size;
+		len = req[0]->size;
+		if (len > sizeof(pkt) || rest > len) {
+			ntxbad++;
+			len = rest = 0;
+		}
+		for (i = 0, len = 0; i < n; i++) {
+			unsigned long size = i ? req[i]->size
+			    : req[0]->size - rest;
+
+			page = grants[req[i]->gref];
+			if (page == NULL
+			    || req[i]->offset + size > PAGE_SIZE) {
+				ntxbad++;
+				continue;
+			}
+			memcpy(pkt + len, page + req[i]->offset, size);
+			len += size;
+		}
+		if (n > 18 || (txfwd ? !fwdok(pkt, len) : (len != txexpectlen
+		    || memcmp(pkt, txexpect, len) != 0)))
+			ntxbad++;
+		ntxpkt++;
+		q->ntxpkt++;
+		ntxslot += n;
+
+		for (i = 0; i < n; i++) {
+			rsp = &txs->ring[prod++ & (NET_TX_RING_SIZE-1)].rsp;
+			rsp->id = req[i]->id;
+			rsp->status = NETIF_RSP_OKAY;
+			if (i == 0 && (txflags & NETTXF_extra_info)) {
+				rsp = &txs->ring[prod++
+				    & (NET_TX_RING_SIZE-1)].rsp;
+				rsp->status = NETIF_RSP_NULL;
+			}
+		}
+	}
+	/* notify us when there's more */
+	txs->req_event = q->tx_cons + 1;
+	mb();
+	txs->rsp_prod = prod;
+	mb();
+	if ((RING_IDX)(prod - txs->rsp_event) < (RING_IDX)(prod - old)) {
+		ntxevent++;
+		raise(q->port);
+	}
+}
+
+int
+minios_notify_remote_via_evtchn(evtchn_port_t port)
+{
+
+	int i;
+
+	/* the RX ring is posted before the backend knows the channel */
+	for (i = 0; i < MAXQ; i++) {
+		if (bq[i].txs && bq[i].port == port) {
+			ntxnotify++;
+			backend_tx(&bq[i]);
+		}
+	}
+	return 0;
+}
+
+void
+minios_mask_evtchn(uint32_t port)
+{
+
+	masked[port] = 1;
+}
+
+void
+minios_unmask_evtchn(uint32_t port)
+{
+
+	masked[port] = 0;
+	if (pending[port]) {
+		pending[port] = 0;
+		raise(port);
+	}
+}
+
+void
+minios_unbind_evtchn(evtchn_port_t port)
+{
+
+	int i;
+
+	evhandler[port] = NULL;
+	for (i = 0; i < MAXQ; i++)
+		if (bq[i].port == port)
+			memset(&bq[i], 0, sizeof(bq[i]));
+}
+
+void
+minios_do_exit(void)
+{
+
+	abort();
+}
+
+/*
+ * The backend side of xenbus.  It follows the frontend's state and
+ * picks up the rings and event channels of each queue when they are
+ * published, at the top level or under queue-N/.
+ */
+static XenbusState backstate = XenbusStateInitWait;
+
+char *
+xenbus_transaction_start(xenbus_transaction_t *xbt)
+{
+
+	*xbt = 1;
+	return NULL;
+}
+
+char *
+xenbus_transaction_end(xenbus_transaction_t xbt, int abort, int *retry)
+{
+
+	*retry = 0;
+	return NULL;
+}
+
+char *
+xenbus_printf(xenbus_transaction_t xbt, const char *node, const char *path,
+	const char *fmt, ...)
+{
+	struct backq *q = &bq[0];
+	va_list ap;
+	char *ep;
+
+	if (strncmp(path, "queue-", 6) == 0) {
+		q = &bq[strtoul(path+6, &ep, 10)];
+		if (q >= &bq[MAXQ] || *ep != '/')
+			abort();
+		path = ep+1;
+	} else if (strstr(path, "-ref") || strcmp(path, "event-channel") == 0) {
+		frontflat++;
+	}
+
+	va_start(ap, fmt);
+	if (strcmp(path, "feature-no-csum-offload") == 0) {
+		frontcsum = va_arg(ap, unsigned) == 0;
+	} else if (strcmp(path, "feature-sg") == 0) {
+		frontsg = va_arg(ap, unsigned);
+	} else if (strcmp(path, "multi-queue-num-queues") == 0) {
+		frontnq = va_arg(ap, unsigned);
+	} else if (strcmp(path, "rx-ring-ref") == 0) {
+		q->rxs = grants[va_arg(ap, unsigned)];
+		q->req_cons = q->rsp_prod = 0;
+	} else if (strcmp(path, "tx-ring-ref") == 0) {
+		q->txs = grants[va_arg(ap, unsigned)];
+		q->tx_cons = 0;
+	} else if (strcmp(path, "event-channel") == 0) {
+		q->port = va_arg(ap, unsigned);
+	}
+	va_end(ap);
+	return NULL;
+}
+
+char *
+xenbus_switch_state(xenbus_transaction_t xbt, const char *path,
+	XenbusState state)
+{
+
+	if (state == XenbusStateInitialising)
+		backstate = XenbusStateInitWait;
+	else
+		backstate = state;
+	return NULL;
+}
+
+char *
+xenbus_read(xenbus_transaction_t xbt, const char *path, char **value)
+{
+	size_t len = strlen(path);
+
+	*value = NULL;
+	if (len > 8 && strcmp(path + len - 8, "/backend") == 0)
+		*value = mock_strdup("backend/vif/1/0");
+	else if (len > 4 && strcmp(path + len - 4, "/mac") == 0)
+		*value = mock_strdup("00:16:3e:00:00:01");
+	else if (len > 11 && strcmp(path + len - 11, "/feature-sg") == 0
+	    && backend_sg)
+		*value = mock_strdup("1");
+	else if ((strstr(path, "/feature-gso-tcpv")
+	    || strstr(path, "/feature-ipv6-csum-offload")) && backend_gso)
+		*value = mock_strdup("1");
+	else if (strstr(path, "/multi-queue-max-queues") && backend_maxq) {
+		*value = bmk_memalloc(16, 0, BMK_MEMWHO_WIREDBMK);
+		snprintf(*value, 16, "%d", backend_maxq);
+	} else
+		return mock_strdup("ENOENT");
+	return NULL;
+}
+
+int
+xenbus_read_integer(const char *path)
+{
+
+	if (strstr(path, "/backend-id"))
+		return 0;
+	return backstate;
+}
+
+char *
+xenbus_wait_for_state_change(const char *path, XenbusState *state,
+	struct xenbus_event_queue *queue)
+{
+
+	*state = backstate;
+	return NULL;
+}
+
+char *
+xenbus_rm(xenbus_transaction_t xbt, const char *path)
+{
+
+	return NULL;
+}
+
+char *
+xenbus_watch_path_token(xenbus_transaction_t xbt, const char *path,
+	const char *token, struct xenbus_event_queue *queue)
+{
+
+	return NULL;
+}
+
+char *
+xenbus_unwatch_path_token(xenbus_transaction_t xbt, const char *path,
+	const char *token)
+{
+
+	return NULL;
+}
+
+void
+xenbus_event_queue_init(struct xenbus_event_queue *queue)
+{
+
+}
+
+unsigned long
+bmk_strtoul(const char *s, char **ep, int base)
+{
+
+	return strtoul(s, ep, base);
+}
+
+bmk_time_t
+bmk_platform_cpu_clock_monotonic(void)
+{
+	static bmk_time_t now;
+
+	/* slow enough to never trigger interrupt mitigation */
+	return now += 1000*1000*1000;
+}
+
+/*
+ * Fill the posted receive buffers of a queue with up to n packets of
+ * rxpktlen bytes.  Like netback, a packet goes into as many buffers
+ * as it takes, and all but the last one get NETRXF_more_data.  The
+ * packets are numbered, and filled with their number.  If rxbad is
+ * set, the next packet is sent with an error status instead.
+ * Returns the number of good packets sent, which is less than n if
+ * the frontend did not post enough buffers.
+ */
+static int
+backend_rx(struct backq *q, int n)
+{
+	struct netif_rx_sring *rxs = q->rxs;
+	struct netif_rx_request *req;
+	struct netif_rx_response *rsp;
+	RING_IDX old = rxs->rsp_prod;
+	unsigned long len, left;
+	unsigned char *page;
+	int i, nslot, bad;
+
+	nslot = (rxpktlen + PAGE_SIZE-1) / PAGE_SIZE;
+	for (i = 0; i < n && rxs->req_prod - q->req_cons >= nslot; i++) {
+		bad = rxbad;
+		rxbad = 0;
+		for (left = rxpktlen; left; left -= len) {
+			req = &rxs->ring[q->req_cons++
+			    & (NET_RX_RING_SIZE-1)].req;
+			page = grants[req->gref];
+			if (page == NULL)
+				abort();
+			len = left < PAGE_SIZE ? left : PAGE_SIZE;
+			memset(page, rxseq & 0xff, len);
+
+			rsp = &rxs->ring[q->rsp_prod++
+			    & (NET_RX_RING_SIZE-1)].rsp;
+			rsp->id = req->id;
+			rsp->offset = 0;
+			rsp->flags = rxflags;
+			if (left > len)
+				rsp->flags |= NETRXF_more_data;
+			rsp->status = bad ? NETIF_RSP_ERROR : len;
+			nrxslot++;
+		}
+		if (bad)
+			i--;
+		else
+			rxseq++;
+	}
+	mb();
+	rxs->rsp_prod = q->rsp_prod;
+	mb();
+	if ((RING_IDX)(q->rsp_prod - rxs->rsp_event)
+	    < (RING_IDX)(q->rsp_prod - old))
+		raise(q->port);
+
+	return i;
+}
+
+static int lastwake;
+
+static void
+myrxwake(struct netfront_dev *d, int q)
+{
+
+	nwake++;
+	lastwake = q;
+}
+
+/* like xenif: keep the pages if loaned, else copy into an mbuf chain */
+static void
+myrecv(struct netfront_dev *d, const struct netfront_seg *seg, int nseg,
+	int flags, int loaned)
+{
+	static unsigned char mbuf[JUMBOLEN];
+	unsigned char *data;
+	unsigned long len;
+	int i;
+
+	rxgotflags = flags;
+	for (i = 0, len = 0; i < nseg; i++) {
+		data = seg[i].data;
+		if (seg[i].len == 0 || data[0] != (npkt & 0xff)
+		    || data[seg[i].len-1] != data[0])
+			nbad++;
+		len += seg[i].len;
+	}
+	if (len != rxpktlen)
+		nbad++;
+	npkt++;
+
+	for (i = 0, len = 0; i < nseg; i++) {
+		if (!loaned) {
+			mock_memcpy(mbuf + len, seg[i].data, seg[i].len);
+			len += seg[i].len;
+		} else if (hold) {
+			held[nheld++] = seg[i].data;
+		} else {
+			netfront_rxpage_put(d, seg[i].data);
+		}
+	}
+}
+
+static void
+release(void)
+{
+
+	while (nheld)
+		netfront_rxpage_put(dev, held[--nheld]);
+}
+
+static void
+reset(void)
+{
+
+	ncopy = ncopybytes = npgalloc = npkt = nwake = nrxslot = rxseq = 0;
+}
+
+/* run the receive path of queue q like its xenif pusher thread does */
+static unsigned long
+runq(int q, int npkts)
+{
+	unsigned long sent = 0;
+
+	while (sent < npkts) {
+		sent += backend_rx(&bq[q], BURST);
+		netfront_rx(dev, q, NET_RX_RING_SIZE);
+	}
+	return sent;
+}
+
+static unsigned long
+run(int npkts)
+{
+
+	return runq(0, npkts);
+}
+
+static int
+report(const char *what, unsigned long sent)
+{
+
+	printf("%s: %lu packets, %lu wakeups, %.3f copies/pkt "
+	    "(%.1f bytes/pkt), %.3f page allocs/pkt\n", what, sent, nwake,
+	    (double)ncopy/sent, (double)ncopybytes/sent,
+	    (double)npgalloc/sent);
+	if (npkt != sent || nbad) {
+		printf("FAIL: %lu packets received, %lu bad\n", npkt, nbad);
+		return 1;
+	}
+	return 0;
+}
+
+static int
+test_rx(void)
+{
+	unsigned long sent;
+	int rv = 0;
+
+	/* the stack frees packets as fast as they come in */
+	reset();
+	sent = run(100000);
+	rv |= report("packets freed right away", sent);
+	if (ncopy != 0 || npgalloc > 2*BURST) {
+		printf("FAIL: receive path copies or allocates\n");
+		rv = 1;
+	}
+
+	/* the stack sits on everything it gets: copy past the loan limit */
+	reset();
+	hold = 1;
+	sent = run(MAXHOLD);
+	rv |= report("packets held by the stack", sent);
+	printf("%d pages loaned\n", nheld);
+	if (nheld + ncopy != sent || ncopy == 0) {
+		printf("FAIL: loan limit not enforced\n");
+		rv = 1;
+	}
+	release();
+
+	/* the stack still holds packets when the interface goes away */
+	reset();
+	sent = run(3*BURST);
+	netfront_shutdown(dev);
+	if (npages != nheld) {
+		printf("FAIL: %ld pages left after shutdown, %d loaned\n",
+		    npages, nheld);
+		rv = 1;
+	}
+	release();
+	hold = 0;
+
+	return rv;
+}
+
+/*
+ * Jumbo frames come in several slots and are passed up in pieces,
+ * still without copying.  When the stack holds on to them, the loan
+ * limit counts pages, not packets.
+ */
+static int
+test_rx_jumbo(void)
+{
+	unsigned long sent;
+	int rv = 0;
+
+	if (!frontsg || !(netfront_features(dev) & NETFRONT_F_SG)) {
+		printf("FAIL: no sg, frontend %d\n", frontsg);
+		return 1;
+	}
+
+	rxpktlen = JUMBOLEN;
+	reset();
+	sent = run(30000);
+	rv |= report("jumbo frames freed right away", sent);
+	printf("%.2f slots/pkt\n", (double)nrxslot/sent);
+	if (ncopy != 0 || nrxslot != 3*sent || npgalloc > 3*BURST) {
+		printf("FAIL: jumbo receive copies or allocates\n");
+		rv = 1;
+	}
+
+	reset();
+	hold = 1;
+	sent = run(MAXHOLD/3);
+	rv |= report("jumbo frames held by the stack", sent);
+	printf("%d pages loaned\n", nheld);
+	if (nheld + ncopy != 3*sent || ncopy == 0 || nheld % 3) {
+		printf("FAIL: jumbo loan limit not enforced\n");
+		rv = 1;
+	}
+	release();
+	hold = 0;
+	rxpktlen = PKTLEN;
+
+	return rv;
+}
+
+static unsigned long ndone, lastcookie[NFLOW];
+static int txflows = 1;
+
+/*
+ * Like the xenif threads.  Packet i is cookie i+1 and in flow
+ * i % txflows, and the packets of a flow must come back in order.
+ */
+static void
+reap(void)
+{
+	void *cookies[NREAP];
+	unsigned long c;
+	int i, n, q;
+
+	for (q = 0; q < netfront_nqueues(dev); q++) {
+		while ((n = netfront_xmit_reap(dev, q, cookies, NREAP)) > 0) {
+			for (i = 0; i < n; i++) {
+				c = (unsigned long)cookies[i];
+				if (c <= lastcookie[(c-1) % txflows])
+					ntxbad++;
+				lastcookie[(c-1) % txflows] = c;
+			}
+			ndone += n;
+		}
+	}
+}
+
+void
+mock_block(void)
+{
+
+	reap();
+}
+
+/*
+ * Send npkts packets made up of the given pieces, which are filled
+ * with a pattern, in bursts of txbatch like virtif_start() does, and
+ * collect them back from netfront.  Returns the number of packets
+ * netfront refused.
+ */
+static unsigned long
+xmitoff(const char *what, struct netfront_seg *seg, int nseg,
+	int flags, int mss, unsigned long npkts)
+{
+	struct timespec start, end;
+	unsigned long i, nfail;
+	double secs;
+	int j;
+
+	for (j = 0, txexpectlen = 0; j < nseg; j++) {
+		for (i = 0; i < seg[j].len; i++)
+			((unsigned char *)seg[j].data)[i] = txexpectlen + i*7;
+		memcpy(txexpect + txexpectlen, seg[j].data, seg[j].len);
+		txexpectlen += seg[j].len;
+	}
+
+	ncopy = ncopybytes = ntxpkt = ntxslot = ntxbad = 0;
+	ntxnotify = ntxevent = 0;
+	nfail = ndone = 0;
+	memset(lastcookie, 0, sizeof(lastcookie));
+	for (j = 0; j < MAXQ; j++)
+		bq[j].ntxpkt = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < npkts; i++) {
+		if (netfront_xmit_sg(dev, seg, nseg, flags, mss,
+		    i % txflows, (void *)(i+1)) != 0)
+			nfail++;
+		if ((i+1) % txbatch && i+1 != npkts)
+			continue;
+		netfront_xmit_flush(dev);
+		reap();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9;
+
+	printf("%s: %lu packets of %lu bytes, %.2f slots/pkt, "
+	    "%.3f copies/pkt (%.1f bytes/pkt), %.3f notifications/pkt, "
+	    "%.3f events/pkt, %.0f pkts/s\n", what,
+	    ntxpkt, txexpectlen, (double)ntxslot/(ntxpkt ? ntxpkt : 1),
+	    (double)ncopy/npkts, (double)ncopybytes/npkts,
+	    (double)ntxnotify/npkts, (double)ntxevent/npkts, npkts/secs);
+	if (ntxbad || ntxpkt != npkts - nfail || ndone != ntxpkt)
+		printf("FAIL: %lu sent, %lu bad, %lu returned\n",
+		    ntxpkt, ntxbad, ndone);
+	return nfail;
+}
+
+static unsigned long
+xmit(const char *what, struct netfront_seg *seg, int nseg,
+	unsigned long npkts)
+{
+
+	return xmitoff(what, seg, nseg, 0, 0, npkts);
+}
+
+static int
+test_tx(void)
+{
+	struct netfront_seg seg[20];
+	unsigned char *arena;
+	unsigned long nfail;
+	int i, rv = 0;
+
+	arena = aligned_alloc(PAGE_SIZE, 8*PAGE_SIZE);
+	if (arena == NULL)
+		abort();
+
+	/* like an mbuf chain: header, headers, cluster */
+	seg[0].data = arena + 100;
+	seg[0].len = 14;
+	seg[1].data = arena + 200;
+	seg[1].len = 40;
+	seg[2].data = arena + PAGE_SIZE + 2048;
+	seg[2].len = 1460;
+	nfail = xmit("mbuf chain", seg, 3, 100000);
+	if (backend_sg && (ncopy != 0 || ntxslot != 3*ntxpkt))
+		rv = 1;
+	if (!backend_sg && ncopy != 3*ntxpkt)
+		rv = 1;
+
+	/* cluster crossing a page boundary */
+	seg[2].data = arena + 2*PAGE_SIZE - 1000;
+	nfail += xmit("cluster across pages", seg, 3, 100000);
+	if (backend_sg && (ncopy != 0 || ntxslot != 4*ntxpkt))
+		rv = 1;
+
+	/* a jumbo frame */
+	seg[2].data = arena + 2*PAGE_SIZE;
+	seg[2].len = 9000 - 54;
+	if (backend_sg) {
+		nfail += xmit("jumbo frame", seg, 3, 10000);
+		if (ncopy != 0 || ntxslot != 5*ntxpkt)
+			rv = 1;
+	} else if (xmit("jumbo frame", seg, 3, 1) != 1) {
+		printf("FAIL: jumbo frame sent without sg\n");
+		rv = 1;
+	}
+
+	/* too many pieces for netback: copied */
+	for (i = 0; i < 20; i++) {
+		seg[i].data = arena + i*300;
+		seg[i].len = 64;
+	}
+	nfail += xmit("20 pieces", seg, 20, 10000);
+	if (ncopy != 20*ntxpkt || ntxslot != ntxpkt)
+		rv = 1;
+
+	/* bursts of small packets, also larger than the ring */
+	seg[0].data = arena;
+	seg[0].len = 60;
+	txbatch = 1;
+	xmit("small packets one at a time", seg, 1, 100000);
+	if (ntxnotify != ntxpkt)
+		rv = 1;
+	txbatch = BURST;
+	xmit("small packets in bursts", seg, 1, 100000);
+	if (ntxnotify > ntxpkt/BURST + 1)
+		rv = 1;
+	txbatch = 4*NET_TX_RING_SIZE;
+	xmit("small packets in bursts > ring", seg, 1, 100000);
+	if (ntxnotify > 2*(ntxpkt/NET_TX_RING_SIZE + 1))
+		rv = 1;
+	txbatch = BURST;
+
+	if (nfail != 0 && backend_sg) {
+		printf("FAIL: %lu packets not sent\n", nfail);
+		rv = 1;
+	}
+	if (rv || ntxbad)
+		printf("FAIL: transmit\n");
+
+	free(arena);
+	return rv || ntxbad;
+}
+
+/*
+ * Checksum and segmentation offload.  The backend does them all,
+ * so we expect to have them all.
+ */
+static int
+test_offload(void)
+{
+	struct netfront_seg seg[3];
+	unsigned char *arena;
+	int rv = 0, want;
+
+	want = NETFRONT_F_CSUM|NETFRONT_F_CSUM6
+	    |NETFRONT_F_TSO4|NETFRONT_F_TSO6|NETFRONT_F_SG;
+	if (netfront_features(dev) != want || !frontcsum) {
+		printf("FAIL: features 0x%x, want 0x%x, frontend csum %d\n",
+		    netfront_features(dev), want, frontcsum);
+		return 1;
+	}
+
+	arena = aligned_alloc(PAGE_SIZE, 8*PAGE_SIZE);
+	if (arena == NULL)
+		abort();
+	seg[0].data = arena;
+	seg[0].len = 14;
+	seg[1].data = arena + 100;
+	seg[1].len = 40;
+	seg[2].data = arena + PAGE_SIZE;
+	seg[2].len = 1460;
+
+	xmitoff("checksum offload", seg, 3, NETFRONT_TX_CSUM, 0, 100000);
+	if (txflags != (NETTXF_csum_blank|NETTXF_data_validated
+	    |NETTXF_more_data) || ntxslot != 3*ntxpkt) {
+		printf("FAIL: checksum offload, flags 0x%x\n", txflags);
+		rv = 1;
+	}
+
+	/* 6 pages of payload, and the extra info slot */
+	seg[2].len = 6*PAGE_SIZE;
+	xmitoff("TCPv4 segmentation", seg, 3, NETFRONT_TX_TSO4, 1448, 100000);
+	if (!(txflags & NETTXF_extra_info) || !(txflags & NETTXF_csum_blank)
+	    || txgsotype != XEN_NETIF_GSO_TYPE_TCPV4 || txgsosize != 1448
+	    || ntxslot != 9*ntxpkt) {
+		printf("FAIL: TSOv4, flags 0x%x type %d size %d\n",
+		    txflags, txgsotype, txgsosize);
+		rv = 1;
+	}
+	xmitoff("TCPv6 segmentation", seg, 3, NETFRONT_TX_TSO6, 1428, 10000);
+	if (txgsotype != 2 || txgsosize != 1428 || ntxslot != 9*ntxpkt) {
+		printf("FAIL: TSOv6, type %d size %d\n", txgsotype, txgsosize);
+		rv = 1;
+	}
+
+	/* receive flags get translated */
+	rxflags = NETRXF_data_validated;
+	run(1);
+	if (rxgotflags != NETFRONT_RX_CSUMOK)
+		rv = 1;
+	rxflags = NETRXF_data_validated|NETRXF_csum_blank;
+	run(1);
+	if (rxgotflags != NETFRONT_RX_CSUMBLANK)
+		rv = 1;
+	rxflags = 0;
+	run(1);
+	if (rxgotflags != 0)
+		rv = 1;
+	if (rv || ntxbad)
+		printf("FAIL: offload\n");
+
+	free(arena);
+	return rv || ntxbad;
+}
+
+/*
+ * Grant operations per packet, from the grant table and from
+ * netfront's own counters, which must agree.
+ */
+static int
+grantops(const char *what, unsigned long npkts,
+	const struct netfront_stats *ns0, double want)
+{
+	static unsigned long lastgrant, lastungrant;
+	struct netfront_stats ns;
+	unsigned long grant = ngrant - lastgrant, ungrant = nungrant - lastungrant;
+	double ops;
+
+	netfront_getstats(dev, &ns);
+	lastgrant = ngrant;
+	lastungrant = nungrant;
+	if (ns0 == NULL)
+		return 0;
+
+	ops = (double)(grant + ungrant) / npkts;
+	printf("%s: %.3f grant ops/pkt, %lu copied\n", what, ops,
+	    ns.ns_txcopy - ns0->ns_txcopy + ns.ns_rxcopy - ns0->ns_rxcopy);
+	if (ns.ns_grant - ns0->ns_grant != grant
+	    || ns.ns_ungrant - ns0->ns_ungrant != ungrant) {
+		printf("FAIL: netfront counted %lu/%lu grant ops, not %lu/%lu\n",
+		    ns.ns_grant - ns0->ns_grant, ns.ns_ungrant - ns0->ns_ungrant,
+		    grant, ungrant);
+		return 1;
+	}
+	if (ops > want + 0.01) {
+		printf("FAIL: %s: want %.0f grant ops/pkt\n", what, want);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Small packets go through persistently granted pages both ways,
+ * larger ones are granted as they go.
+ */
+static int
+test_grants(void)
+{
+	struct netfront_stats ns;
+	struct netfront_seg seg[3];
+	unsigned char *arena;
+	unsigned long sent;
+	int rv = 0;
+
+	arena = aligned_alloc(PAGE_SIZE, 2*PAGE_SIZE);
+	if (arena == NULL)
+		abort();
+
+	/* warm up: the TX pages are granted once, when first used */
+	seg[0].data = arena;
+	seg[0].len = 60;
+	xmit("small packets, warmup", seg, 1, 10000);
+
+	grantops(NULL, 0, NULL, 0);
+	netfront_getstats(dev, &ns);
+	xmit("small packets", seg, 1, 100000);
+	rv |= grantops("small packets sent", ntxpkt, &ns, 0);
+	if (ncopy != ntxpkt)
+		rv = 1;
+
+	netfront_getstats(dev, &ns);
+	seg[0].len = 14;
+	seg[1].data = arena + 100;
+	seg[1].len = 40;
+	seg[2].data = arena + PAGE_SIZE;
+	seg[2].len = 1460;
+	xmit("mbuf chain", seg, 3, 100000);
+	rv |= grantops("mbuf chains sent", ntxpkt, &ns, 6);
+
+	rxpktlen = 128;
+	reset();
+	netfront_getstats(dev, &ns);
+	sent = run(100000);
+	rv |= report("small packets received", sent);
+	rv |= grantops("small packets received", sent, &ns, 0);
+	if (ncopy != sent)
+		rv = 1;
+	rxpktlen = PKTLEN;
+
+	reset();
+	netfront_getstats(dev, &ns);
+	sent = run(100000);
+	rv |= grantops("full-sized packets received", sent, &ns, 2);
+	if (ncopy != 0)
+		rv = 1;
+
+	if (rv || ntxbad)
+		printf("FAIL: grants\n");
+
+	free(arena);
+	return rv || ntxbad;
+}
+
+/*
+ * A backend doing multi-queue.  Check that every queue is published
+ * under queue-N/ and has its own rings and event channel, that flows
+ * are spread over the queues, and that received packets wake up the
+ * thread of the queue they came in on.
+ */
+static int
+test_multiqueue(void)
+{
+	struct netfront_seg seg;
+	unsigned char *arena;
+	unsigned long sent;
+	int i, j, nq, rv = 0;
+
+	nq = netfront_nqueues(dev);
+	printf("%d queues, backend allows %d\n", nq, backend_maxq);
+	if (nq < 2 || nq > backend_maxq || frontnq != nq || frontflat) {
+		printf("FAIL: %d queues, %d published, %d top-level keys\n",
+		    nq, frontnq, frontflat);
+		return 1;
+	}
+	for (i = 0; i < nq; i++) {
+		if (bq[i].rxs == NULL || bq[i].txs == NULL || bq[i].port == 0)
+			rv = 1;
+		for (j = 0; j < i; j++)
+			if (bq[j].port == bq[i].port)
+				rv = 1;
+	}
+	if (rv) {
+		printf("FAIL: queue rings or event channels\n");
+		return 1;
+	}
+
+	arena = aligned_alloc(PAGE_SIZE, PAGE_SIZE);
+	if (arena == NULL)
+		abort();
+	seg.data = arena;
+	seg.len = 60;
+	txflows = 4*nq;
+	xmit("small packets, flows over queues", &seg, 1, 100000);
+	for (i = 0; i < nq; i++) {
+		if (bq[i].ntxpkt != ntxpkt/nq) {
+			printf("FAIL: queue %d sent %lu of %lu\n",
+			    i, bq[i].ntxpkt, ntxpkt);
+			rv = 1;
+		}
+	}
+	if (ntxnotify > nq*(ntxpkt/BURST + 1))
+		rv = 1;
+	txflows = 1;
+
+	for (i = 0; i < nq; i++) {
+		reset();
+		lastwake = -1;
+		sent = runq(i, 3*BURST);
+		if (npkt != sent || nbad || lastwake != i) {
+			printf("FAIL: queue %d received %lu of %lu, "
+			    "woke up %d\n", i, npkt, sent, lastwake);
+			rv = 1;
+		}
+	}
+	if (rv || ntxbad)
+		printf("FAIL: multiqueue\n");
+
+	free(arena);
+	return rv || ntxbad;
+}
+
+/*
+ * The rump kernel side of xenif: count the packets and the batches
+ * they reach the stack in, which is when the kernel lock is taken.
+ * Loaned pages are given back when the batch is done with.  The
+ * receive queue takes vifmaxlen packets per batch, and packets
+ * beyond that would be dropped.  Once vifstallat packets have been
+ * received, the stack stalls for vifstall rounds of the receive
+ * thread, during which the backend keeps on sending.
+ */
+static struct virtif_user *viu;
+static unsigned long nvifpkt, nvifflush, nsched, nvifbad, vifwant;
+static unsigned long nvifdrop, nviferr, nbackfull, vifstallat, nvifdone;
+static int vifmaxbatch, vifbatch, vifmaxlen = 64, vifstall;
+static void *vifloaned[MAXHOLD];
+static void *vifloanarg;
+static int nvifloaned;
+
+static void
+vifpkt(struct iovec *iov, size_t iovlen)
+{
+	unsigned long len;
+	size_t i;
+
+	for (i = 0, len = 0; i < iovlen; i++) {
+		if (((unsigned char *)iov[i].iov_base)[0] != (npkt & 0xff))
+			nvifbad++;
+		len += iov[i].iov_len;
+	}
+	if (len != rxpktlen)
+		nvifbad++;
+	if (vifbatch == vifmaxlen)
+		nvifdrop++;
+	npkt++;
+	nvifpkt++;
+	vifbatch++;
+}
+
+void
+rump_virtif_pktdeliver(struct virtif_sc *sc, struct iovec *iov,
+	size_t iovlen, int flags)
+{
+	static unsigned char mbuf[JUMBOLEN];
+	size_t i, len;
+
+	for (i = 0, len = 0; i < iovlen; len += iov[i++].iov_len)
+		mock_memcpy(mbuf + len, iov[i].iov_base, iov[i].iov_len);
+	vifpkt(iov, iovlen);
+}
+
+int
+rump_virtif_pktdeliver_ext(struct virtif_sc *sc, struct iovec *iov,
+	size_t iovlen, int flags, void *arg)
+{
+	size_t i;
+
+	vifpkt(iov, iovlen);
+	for (i = 0; i < iovlen; i++)
+		vifloaned[nvifloaned++] = iov[i].iov_base;
+	vifloanarg = arg;
+	return 0;
+}
+
+void
+rump_virtif_pktflush(struct virtif_sc *sc)
+{
+
+	if (vifbatch == 0)
+		return;
+	nvifflush++;
+	if (vifbatch > vifmaxbatch)
+		vifmaxbatch = vifbatch;
+	vifbatch = 0;
+	while (nvifloaned)
+		VIFHYPER_RXDONE(vifloanarg, vifloaned[--nvifloaned]);
+}
+
+int
+rump_virtif_pktroom(struct virtif_sc *sc)
+{
+
+	if (vifstall && nvifpkt >= vifstallat) {
+		vifstall--;
+		if (backend_rx(&bq[0], BURST) < BURST)
+			nbackfull++;
+		return 0;
+	}
+	return vifmaxlen - vifbatch;
+}
+
+void
+rump_virtif_pkterror(struct virtif_sc *sc, int n)
+{
+
+	nviferr += n;
+}
+
+void
+rump_virtif_txdone(struct virtif_sc *sc, void *cookie)
+{
+
+	/* aligned, like mbufs */
+	if ((unsigned long)cookie != 2 * ++nvifdone)
+		nvifbad++;
+}
+
+static void
+hyp_sched(void)
+{
+
+	nsched++;
+}
+
+static void
+hyp_unsched(void)
+{
+
+}
+
+static void
+hyp_backend_sched(int nlocks, void *interlock)
+{
+
+	nsched++;
+}
+
+static void
+hyp_backend_unsched(int nlocks, int *nlocksp, void *interlock)
+{
+
+	*nlocksp = 0;
+}
+
+static int
+hyp_newlwp(int pid)
+{
+
+	return 0;
+}
+
+struct rumpuser_hyperup rumpuser__hyp = {
+	.hyp_schedule = hyp_sched,
+	.hyp_unschedule = hyp_unsched,
+	.hyp_backend_schedule = hyp_backend_sched,
+	.hyp_backend_unschedule = hyp_backend_unsched,
+	.hyp_lwproc_newlwp = hyp_newlwp,
+};
+
+int bmk_trace_enabled;
+
+void
+bmk_trace_record(void *thread, uint32_t event, uint32_t arg0, uint64_t arg1)
+{
+
+}
+
+/*
+ * The threads xenif creates are run by hand, see test_xenif().
+ * When the receive thread blocks, the backend sends another burst,
+ * until it has sent vifwant packets and the interface goes away.
+ */
+__thread struct bmk_thread *bmk_current;
+static struct {
+	void (*f)(void *);
+	void *arg;
+} threads[MAXQ];
+static int nthreads;
+
+struct bmk_thread *
+bmk_sched_create(const char *name, void *cookie, int joinable,
+	void (*f)(void *), void *arg, void *stack, unsigned long stacksize)
+{
+
+	threads[nthreads].f = f;
+	threads[nthreads].arg = arg;
+	return (struct bmk_thread *)&threads[nthreads++];
+}
+
+void
+bmk_sched_join(struct bmk_thread *thread)
+{
+
+}
+
+void
+bmk_sched_yield(void)
+{
+
+}
+
+void
+bmk_sched_wake(struct bmk_thread *thread)
+{
+
+	nwake++;
+}
+
+void
+bmk_sched_blockprepare(void)
+{
+
+}
+
+int
+bmk_sched_block(void)
+{
+
+	/* everything received must have reached the stack */
+	if (vifbatch || nvifloaned)
+		nvifbad++;
+	if (nvifpkt < vifwant)
+		backend_rx(&bq[0], BURST);
+	else
+		VIFHYPER_DYING(viu);
+	return 0;
+}
+
+/*
+ * Create a xenif interface and run its receive thread until the
+ * backend has sent npkts packets of len bytes in bursts.  Count the
+ * rump kernel entries and the batches handed to the stack.  Before
+ * batching, each packet took the kernel lock on its own.
+ */
+static int
+xenif_rx(const char *what, unsigned long len, unsigned long npkts)
+{
+	struct timespec start, end;
+	uint8_t enaddr[6];
+	double secs;
+	int caps, rv = 0;
+
+	nthreads = 0;
+	if (VIFHYPER_CREATE(0, NULL, enaddr, &caps, &viu) != 0
+	    || nthreads != 1) {
+		printf("FAIL: xenif create\n");
+		return 1;
+	}
+	bmk_current = (struct bmk_thread *)&threads[0];
+
+	reset();
+	rxpktlen = len;
+	nvifpkt = nvifflush = nsched = nvifbad = 0;
+	nvifdrop = nviferr = nbackfull = 0;
+	vifmaxbatch = 0;
+	vifwant = npkts;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	threads[0].f(threads[0].arg);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9;
+
+	printf("%s: %lu packets of %lu bytes, %.3f rump kernel entries/pkt, "
+	    "%.3f stack batches/pkt (max %d), %.3f copies/pkt, %.0f pkts/s\n",
+	    what, nvifpkt, len, (double)nsched/nvifpkt,
+	    (double)nvifflush/nvifpkt, vifmaxbatch, (double)ncopy/nvifpkt,
+	    nvifpkt/secs);
+	if (nvifpkt < npkts || nvifbad || nvifdrop || vifmaxbatch > vifmaxlen
+	    || nvifflush > nvifpkt/(vifmaxlen < BURST ? vifmaxlen : BURST) + 1) {
+		printf("FAIL: %lu packets, %lu bad, %lu dropped, %lu batches\n",
+		    nvifpkt, nvifbad, nvifdrop, nvifflush);
+		rv = 1;
+	}
+	rxpktlen = PKTLEN;
+
+	bmk_current = NULL;
+	VIFHYPER_DESTROY(viu);
+
+	return rv;
+}
+
+static int
+test_xenif(void)
+{
+	int rv = 0;
+
+	rv |= xenif_rx("xenif, full-sized packets", PKTLEN, 100000);
+	rv |= xenif_rx("xenif, small packets", 128, 100000);
+	rv |= xenif_rx("xenif, jumbo frames", JUMBOLEN, 30000);
+
+	/* a small receive queue holds the backend off, and bad packets count */
+	vifmaxlen = 8;
+	rxbad = 1;
+	rv |= xenif_rx("xenif, 8 packets at a time", PKTLEN, 100000);
+	if (nviferr != 1) {
+		printf("FAIL: %lu receive errors\n", nviferr);
+		rv = 1;
+	}
+	vifmaxlen = 64;
+
+	/* the stack stalls: the ring fills up, and nothing is lost */
+	vifstallat = 1000;
+	vifstall = 100;
+	rv |= xenif_rx("xenif, stack stalls", PKTLEN, 100000);
+	printf("backend found the ring full %lu times\n", nbackfull);
+	if (nbackfull == 0 || vifstall) {
+		printf("FAIL: stall\n");
+		rv = 1;
+	}
+
+	return rv;
+}
+
+/*
+ * Send packets made of nseg pieces of seglen bytes through xenif, like
+ * virtif_start() does for an mbuf chain.  Chains longer than netback
+ * takes are copied by netfront, and every packet must arrive intact
+ * and come back to the stack.  Chains longer than VIRTIF_MAXFRAGS,
+ * which virtif_start() never passes, must come back unsent.
+ */
+static int
+xenif_tx(const char *what, int nseg, unsigned long seglen,
+	unsigned long npkts)
+{
+	struct virtif_txinfo vt;
+	struct iovec iov[nseg];
+	unsigned char *arena;
+	uint8_t enaddr[6];
+	unsigned long i, nsent;
+	int j, caps, rv = 0;
+
+	nsent = nseg <= VIRTIF_MAXFRAGS ? npkts : 0;
+	nthreads = 0;
+	if (VIFHYPER_CREATE(0, NULL, enaddr, &caps, &viu) != 0) {
+		printf("FAIL: xenif create\n");
+		return 1;
+	}
+
+	arena = malloc(nseg * seglen);
+	if (arena == NULL)
+		abort();
+	for (i = 0; i < nseg * seglen; i++)
+		arena[i] = i*7;
+	memcpy(txexpect, arena, nseg * seglen);
+	txexpectlen = nseg * seglen;
+	for (j = 0; j < nseg; j++) {
+		iov[j].iov_base = arena + j*seglen;
+		iov[j].iov_len = seglen;
+	}
+
+	reset();
+	memset(&vt, 0, sizeof(vt));
+	ntxpkt = ntxbad = nvifdone = nvifbad = 0;
+	for (i = 0; i < npkts; i++) {
+		VIFHYPER_SEND(viu, iov, nseg, &vt, (void *)(2*(i+1)));
+		if ((i+1) % BURST == 0 || i+1 == npkts)
+			VIFHYPER_FLUSH(viu);
+	}
+
+	printf("%s: %lu packets of %d pieces of %lu bytes, "
+	    "%.3f copies/pkt\n", what, ntxpkt, nseg, seglen,
+	    (double)ncopy/npkts);
+	if (ntxpkt != nsent || ntxbad || nvifdone != npkts || nvifbad) {
+		printf("FAIL: %lu sent, %lu bad, %lu returned\n",
+		    ntxpkt, ntxbad + nvifbad, nvifdone);
+		rv = 1;
+	}
+
+	free(arena);
+	VIFHYPER_DYING(viu);
+	VIFHYPER_DESTROY(viu);
+
+	return rv;
+}
+
+static int
+test_xenif_tx(void)
+{
+	int rv = 0;
+
+	rv |= xenif_tx("xenif, short chain", 3, 500, 10000);
+	rv |= xenif_tx("xenif, 32 pieces", 32, 40, 10000);
+	rv |= xenif_tx("xenif, 33 pieces", 33, 40, 10000);
+	rv |= xenif_tx("xenif, 64 pieces", 64, 140, 10000);
+	rv |= xenif_tx("xenif, 200 pieces", 200, 7, 10000);
+
+	return rv;
+}
+
+/*
+ * Forward npkts packets of len bytes from the RX ring of xenif0 to
+ * its TX ring, like a bridge would, either copying them or sending
+ * them right from the RX buffers, which are then released only once
+ * sent.  The stack must see none of them.
+ */
+static int
+netring_fwd(const char *what, unsigned long len, unsigned long npkts,
+	int zerocopy)
+{
+	struct timespec start, end;
+	struct rumprun_netif *ni;
+	struct rumprun_netring *rx, *tx;
+	struct rumprun_netring_slot *rs, *ts;
+	unsigned long sent, nfwd, stuck;
+	unsigned int rxcur;
+	uint8_t enaddr[6];
+	double secs;
+	int caps, rv = 0;
+
+	nthreads = 0;
+	if (VIFHYPER_CREATE(0, NULL, enaddr, &caps, &viu) != 0
+	    || rumprun_netring_open(0, &ni) != 0) {
+		printf("FAIL: netring open\n");
+		return 1;
+	}
+	rx = rumprun_netring_rx(ni, 0);
+	tx = rumprun_netring_tx(ni, 0);
+
+	reset();
+	rxpktlen = len;
+	ntxpkt = ntxbad = nvifpkt = 0;
+	txfwd = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (sent = nfwd = stuck = 0, rxcur = 0; nfwd < npkts; ) {
+		if (sent < npkts)
+			sent += backend_rx(&bq[0],
+			    npkts - sent < BURST ? npkts - sent : BURST);
+		rumprun_netring_rxsync(ni, 0);
+
+		if (rxcur == rx->nr_tail && ++stuck > 1000) {
+			printf("FAIL: stuck after %lu packets\n", nfwd);
+			rv = 1;
+			break;
+		}
+		for (; rxcur != rx->nr_tail && tx->nr_head != tx->nr_tail;
+		    rxcur++, tx->nr_head++) {
+			rs = &rx->nr_slot[rxcur & (rx->nr_num-1)];
+			ts = &tx->nr_slot[tx->nr_head & (tx->nr_num-1)];
+			if (zerocopy)
+				ts->ns_buf = rs->ns_buf;
+			else
+				memcpy(ts->ns_buf, rs->ns_buf, rs->ns_len);
+			ts->ns_len = rs->ns_len;
+			ts->ns_flags = rs->ns_flags & NETRING_F_MORE;
+			if ((rs->ns_flags & NETRING_F_MORE) == 0)
+				nfwd++;
+			stuck = 0;
+		}
+		rumprun_netring_txsync(ni, 0);
+
+		/* a slot for a slot, so the sent ones are the ones done */
+		rx->nr_head = zerocopy ? tx->nr_tail - tx->nr_num : rxcur;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9;
+
+	printf("%s: %lu packets of %lu bytes, %.2f slots/pkt, "
+	    "%.3f netfront copies/pkt, %.0f pkts/s\n", what, ntxpkt, len,
+	    (double)rxcur/(nfwd ? nfwd : 1), (double)ncopy/npkts, npkts/secs);
+	if (ntxpkt != npkts || ntxbad || nvifpkt) {
+		printf("FAIL: %lu forwarded, %lu bad, %lu to the stack\n",
+		    ntxpkt, ntxbad, nvifpkt);
+		rv = 1;
+	}
+	txfwd = 0;
+	rxpktlen = PKTLEN;
+
+	rumprun_netring_close(ni);
+	VIFHYPER_DYING(viu);
+	VIFHYPER_DESTROY(viu);
+
+	return rv;
+}
+
+static int
+test_netring(void)
+{
+	struct rumprun_netif *ni;
+	uint8_t enaddr[6];
+	int caps, rv = 0;
+
+	nthreads = 0;
+	if (VIFHYPER_CREATE(0, NULL, enaddr, &caps, &viu) != 0
+	    || rumprun_netring_open(1, &ni) == 0
+	    || rumprun_netring_open(0, &ni) != 0
+	    || rumprun_netring_nrings(ni) != 1
+	    || rumprun_netring_open(0, &ni) == 0) {
+		printf("FAIL: netring open\n");
+		return 1;
+	}
+	rumprun_netring_close(ni);
+	VIFHYPER_DYING(viu);
+	VIFHYPER_DESTROY(viu);
+
+	rv |= netring_fwd("netring, copy", PKTLEN, 100000, 0);
+	rv |= netring_fwd("netring, zero-copy", PKTLEN, 100000, 1);
+	rv |= netring_fwd("netring, zero-copy small packets", 64, 100000, 1);
+	rv |= netring_fwd("netring, zero-copy jumbo frames", JUMBOLEN,
+	    30000, 1);
+
+	return rv;
+}
+
+static int
+checkleak(void)
+{
+
+	if (npages != 0 || nmem != 0) {
+		printf("FAIL: leaked %ld pages, %ld allocations\n",
+		    npages, nmem);
+		return 1;
+	}
+	return 0;
+}
+
+int
+main(void)
+{
+	int rv = 0;
+
+	bmk_printf_init(NULL, NULL);
+	dev = netfront_init(NULL, myrecv, myrxwake, NULL, NULL, NULL);
+	if (dev == NULL || bq[0].rxs == NULL || bq[0].txs == NULL
+	    || netfront_nqueues(dev) != 1 || frontnq || !frontflat) {
+		printf("FAIL: netfront_init\n");
+		return 1;
+	}
+	rv |= test_tx();
+	rv |= test_offload();
+	rv |= test_rx_jumbo();
+	rv |= test_grants();
+	rv |= test_rx();
+	rv |= checkleak();
+
+	/* a backend without scatter-gather, so without segmentation */
+	backend_sg = 0;
+	dev = netfront_init(NULL, myrecv, myrxwake, NULL, NULL, NULL);
+	if (dev == NULL) {
+		printf("FAIL: netfront_init\n");
+		return 1;
+	}
+	if (netfront_features(dev) != (NETFRONT_F_CSUM|NETFRONT_F_CSUM6)) {
+		printf("FAIL: features 0x%x without sg\n",
+		    netfront_features(dev));
+		rv = 1;
+	}
+	rv |= test_tx();
+	netfront_shutdown(dev);
+	rv |= checkleak();
+
+	/* a backend with multi-queue */
+	backend_sg = 1;
+	backend_maxq = 8;
+	frontflat = 0;
+	dev = netfront_init(NULL, myrecv, myrxwake, NULL, NULL, NULL);
+	if (dev == NULL) {
+		printf("FAIL: netfront_init\n");
+		return 1;
+	}
+	rv |= test_multiqueue();
+	rv |= test_tx();
+	netfront_shutdown(dev);
+	rv |= checkleak();
+
+	/* xenif on top */
+	backend_maxq = 0;
+	rv |= test_xenif();
+	rv |= test_xenif_tx();
+	rv |= test_netring();
+	rv |= checkleak();
+
+	printf("%s\n", rv ? "FAILED" : "OK");
+	return rv;
+}
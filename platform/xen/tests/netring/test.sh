@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# Count the copies and page allocations per packet made by the Xen
+# netfront receive and transmit paths, and the rump kernel entries
+# made by the xenif receive thread on top, and forward packets
+# through the xenif raw frame rings, using mock rings and a mock
+# backend.  Runs on the build host.
+#
+
+set -e
+
+: ${CC:=cc}
+
+TOP=$(cd $(dirname $0)/../../../.. && pwd)
+XEN=${TOP}/platform/xen/xen
+XENIF=${TOP}/platform/xen/librumpnet_xenif
+OBJ=$(mktemp -d)
+trap "rm -rf ${OBJ}" 0
+
+# the Mini-OS and Xen headers are stubbed out, mock.h has what's used
+for hdr in mini-os/os.h mini-os/xenbus.h mini-os/events.h mini-os/gnttab.h \
+    mini-os/time.h mini-os/lib.h mini-os/semaphore.h mini-os/wait.h \
+    xen/io/netif.h rump/rumpuser.h; do
+	mkdir -p ${OBJ}/stub/$(dirname ${hdr})
+	: > ${OBJ}/stub/${hdr}
+done
+cp ${XEN}/include/mini-os/netfront.h ${OBJ}/stub/mini-os/
+
+CFLAGS="-g -Wall -I${OBJ}/stub -I${TOP}/include -fno-builtin"
+CFLAGS="${CFLAGS} -include $(dirname $0)/mock.h"
+
+# count the copies netfront makes
+${CC} ${CFLAGS} -Dbmk_memcpy=mock_memcpy -c -o ${OBJ}/netfront.o \
+    ${XEN}/netfront.c
+CFLAGS="${CFLAGS} -DVIRTIF_BASE=xenif -I${TOP}/platform/virtif"
+${CC} ${CFLAGS} -c -o ${OBJ}/xenif_user.o ${XENIF}/xenif_user.c
+${CC} ${CFLAGS} -o ${OBJ}/netring $(dirname $0)/netring.c \
+    ${OBJ}/netfront.o ${OBJ}/xenif_user.o ${TOP}/lib/libbmk_core/mitigate.c \
+    ${TOP}/lib/libbmk_core/bmk_string.c ${TOP}/lib/libbmk_core/subr_prf.c
+
+${OBJ}/netring
@@ -46,43 +46,29 @@
  * Time functions
  *************************************************************************/
 
-/* These are peridically updated in shared_info, and then copied here. */
+/*
+ * Local copy of the vcpu time info scaling parameters.  The hypervisor
+ * updates vcpu_time_info and bumps the version around each update
+ * (odd == update in progress), so readers can go lockless: read the
+ * version, compute, and retry if the version changed.  The copy is
+ * refreshed only when the version changes, so in the common case the
+ * only shared_info accesses are the two version reads.  The initial
+ * odd version guarantees that the copy is filled in on first use.
+ */
 struct shadow_time_info {
 	uint64_t tsc_timestamp;     /* TSC at last update of time vals.  */
 	uint64_t system_timestamp;  /* Time, in nanosecs, since boot.    */
 	uint32_t tsc_to_nsec_mul;
-	uint32_t tsc_to_usec_mul;
 	int tsc_shift;
 	uint32_t version;
 };
-static uint64_t shadow_sec;
-static uint32_t shadow_nsec;
-static uint32_t shadow_ts_version;
-
-static struct shadow_time_info shadow;
+static struct shadow_time_info shadow = { .version = 1 };
 
 
 #ifndef rmb
 #define rmb()  __asm__ __volatile__ ("lock; addl $0,0(%%esp)": : :"memory")
 #endif
 
-#define HANDLE_USEC_OVERFLOW(_tv)          \
-    do {                                   \
-        while ( (_tv)->tv_usec >= 1000000 ) \
-        {                                  \
-            (_tv)->tv_usec -= 1000000;      \
-            (_tv)->tv_sec++;                \
-        }                                  \
-    } while ( 0 )
-
-static inline int time_values_up_to_date(void)
-{
-	struct vcpu_time_info *src = &HYPERVISOR_shared_info->vcpu_info[0].time; 
-
-	return (shadow.version == src->version);
-}
-
-
 /*
  * Scale a 64-bit delta by scaling and multiplying by a 32-bit fraction,
  * yielding a 64-bit result.
@@ -120,36 +106,6 @@ static inline uint64_t scale_delta(uint64_t delta, uint32_t mul_frac, int shift)
 }
 
 
-static unsigned long get_nsec_offset(void)
-{
-	uint64_t now, delta;
-	rdtscll(now);
-	delta = now - shadow.tsc_timestamp;
-	return scale_delta(delta, shadow.tsc_to_nsec_mul, shadow.tsc_shift);
-}
-
-
-static void get_time_values_from_xen(void)
-{
-	struct vcpu_time_info    *src = &HYPERVISOR_shared_info->vcpu_info[0].time;
-
- 	do {
-		shadow.version = src->version;
-		rmb();
-		shadow.tsc_timestamp     = src->tsc_timestamp;
-		shadow.system_timestamp  = src->system_time;
-		shadow.tsc_to_nsec_mul   = src->tsc_to_system_mul;
-		shadow.tsc_shift         = src->tsc_shift;
-		rmb();
-	}
-	while ((src->version & 1) | (shadow.version ^ src->version));
-
-	shadow.tsc_to_usec_mul = shadow.tsc_to_nsec_mul / 1000;
-}
-
-
-
-
 /* bmk_platform_cpu_clock_monotonic():
  *              returns # of nanoseconds passed since time_init()
  *		Note: This function is required to return accurate
@@ -157,45 +113,53 @@ static void get_time_values_from_xen(void)
  */
 bmk_time_t bmk_platform_cpu_clock_monotonic(void)
 {
-	uint64_t time;
-	uint32_t local_time_version;
+	volatile struct vcpu_time_info *src
+	    = &HYPERVISOR_shared_info->vcpu_info[0].time;
+	uint64_t now, time;
+	uint32_t version;
 
 	do {
-		local_time_version = shadow.version;
+		version = src->version;
 		rmb();
-		time = shadow.system_timestamp + get_nsec_offset();
-                if (!time_values_up_to_date())
-			get_time_values_from_xen();
+		if (version != shadow.version) {
+			/*
+			 * Copy the parameters and only then record the
+			 * version.  If an interrupt handler reads the clock
+			 * in the middle of this, the copy might end up
+			 * mixed, but it will carry a stale version and
+			 * therefore be refreshed before being used.
+			 */
+			shadow.tsc_timestamp = src->tsc_timestamp;
+			shadow.system_timestamp = src->system_time;
+			shadow.tsc_to_nsec_mul = src->tsc_to_system_mul;
+			shadow.tsc_shift = src->tsc_shift;
+			shadow.version = version;
+		}
+		rdtscll(now);
+		time = shadow.system_timestamp
+		    + scale_delta(now - shadow.tsc_timestamp,
+		      shadow.tsc_to_nsec_mul, shadow.tsc_shift);
 		rmb();
-	} while (local_time_version != shadow.version);
+	} while ((version & 1) | (version ^ src->version)
+	    | (version ^ shadow.version));
 
 	return time;
 }
 
-static void update_wallclock(void)
-{
-	shared_info_t *s = HYPERVISOR_shared_info;
-
-	do {
-		shadow_ts_version = s->wc_version;
-		rmb();
-		shadow_sec  = s->wc_sec;
-		shadow_nsec = s->wc_nsec;
-		rmb();
-	}
-	while ((s->wc_version & 1) | (shadow_ts_version ^ s->wc_version));
-}
-
 /* return monotonic clock offset to wall epoch */
 bmk_time_t
 bmk_platform_cpu_clock_epochoffset(void)
 {
-	unsigned long flags;
+	volatile shared_info_t *s = HYPERVISOR_shared_info;
+	uint32_t version;
 	bmk_time_t rv;
 
-	local_irq_save(flags);
-	rv = SECONDS(shadow_sec) + shadow_nsec;
-	local_irq_restore(flags);
+	do {
+		version = s->wc_version;
+		rmb();
+		rv = SECONDS(s->wc_sec) + s->wc_nsec;
+		rmb();
+	} while ((version & 1) | (version ^ s->wc_version));
 
 	return rv;
 }
@@ -213,12 +177,11 @@ void block_domain(s_time_t until)
 
 
 /*
- * Just a dummy 
+ * Just a dummy, the timer event only needs to wake us up from
+ * block_domain().  Time values are read directly from shared_info.
  */
 static void timer_handler(evtchn_port_t ev, struct pt_regs *regs, void *ign)
 {
-    get_time_values_from_xen();
-    update_wallclock();
 }
 
 
@@ -227,9 +190,6 @@ static evtchn_port_t port;
 void init_time(void)
 {
     minios_printk("Initialising timer interface\n");
-    /* ensure time values are up to date after exit from this function */
-    get_time_values_from_xen();
-    update_wallclock();
     /* start timer handler */
     port = minios_bind_virq(VIRQ_TIMER, &timer_handler, NULL);
     minios_unmask_evtchn(port);
@@ -44,6 +44,8 @@
 #include <mini-os/xenbus.h>
 #include <xen/io/console.h>
 
+#include <bmk-core/platform.h>
+#include <bmk-core/sched.h>
 #include <bmk-core/string.h>
 #define _BMK_PRINTF_VA
 #include <bmk-core/printf.h>
@@ -57,6 +59,24 @@
    NOTE: you need to enable verbose in xen/Rules.mk for it to work. */
 static int console_initialised = 0;
 
+/*
+ * Output is collected into a buffer and written out a line at a
+ * time, so that character-at-a-time output (e.g. rumpuser_putchar)
+ * costs a ring notification and a console_io hypercall per line
+ * instead of per character.  Partial lines are written out by the
+ * flusher thread after CONS_FLUSHDELAY.
+ */
+#define CONS_BUFSIZE 1024
+#define CONS_FLUSHDELAY (10*1000*1000ULL)
+
+/* output with \r added is passed to the ring in chunks of this size */
+#define CONS_PRINTCHUNK 256
+
+static char cons_buf[CONS_BUFSIZE];
+static int cons_buflen;
+static struct bmk_thread *cons_flusher;
+static int cons_flusher_idle;
+
 
 void xencons_rx(char *buf, unsigned len, struct pt_regs *regs)
 {
@@ -79,47 +99,104 @@ void xencons_tx(void)
 
 void minios_console_print(struct consfront_dev *dev, char *data, int length)
 {
-    char *curr_char, saved_char;
-    char copied_str[length+1];
-    char *copied_ptr;
-    int part_len;
+    char copied_str[CONS_PRINTCHUNK];
     int (*ring_send_fn)(struct consfront_dev *dev, const char *data, unsigned length);
-    int sent;
+    int i, n;
 
     if(!console_initialised)
         ring_send_fn = xencons_ring_send_no_notify;
     else
         ring_send_fn = xencons_ring_send;
 
-    copied_ptr = copied_str;
-    bmk_memcpy(copied_ptr, data, length);
-    for(curr_char = copied_ptr; curr_char < copied_ptr+length-1; curr_char++)
+    /*
+     * translate \n to \r\n.  most lines fit into one chunk, and
+     * thus go out with one notification.
+     */
+    for (i = 0, n = 0; i < length; i++)
     {
-        if(*curr_char == '\n')
+        if (n >= sizeof(copied_str) - 1)
         {
-            *curr_char = '\r';
-            saved_char = *(curr_char+1);
-            *(curr_char+1) = '\n';
-            part_len = curr_char - copied_ptr + 2;
-            ring_send_fn(dev, copied_ptr, part_len);
-            *(curr_char+1) = saved_char;
-            copied_ptr = curr_char+1;
-            length -= part_len - 1;
+            ring_send_fn(dev, copied_str, n);
+            n = 0;
         }
+        if (data[i] == '\n')
+            copied_str[n++] = '\r';
+        copied_str[n++] = data[i];
     }
+    if (n)
+        ring_send_fn(dev, copied_str, n);
+}
+
+/* write out buffered output.  called with interrupts disabled */
+static void cons_flush_locked(void)
+{
+
+    if (cons_buflen == 0)
+        return;
 
-    if (copied_ptr[length-1] == '\n') {
-        copied_ptr[length-1] = '\r';
-        copied_ptr[length] = '\n';
-        length++;
+#ifndef USE_XEN_CONSOLE
+    if(!console_initialised)
+#endif    
+        (void)HYPERVISOR_console_io(CONSOLEIO_write, cons_buflen, cons_buf);
+
+    minios_console_print(NULL, cons_buf, cons_buflen);
+    cons_buflen = 0;
+}
+
+static void cons_write(const char *data, int length)
+{
+    unsigned long flags;
+    int i;
+
+    local_irq_save(flags);
+    for (i = 0; i < length; i++)
+    {
+        cons_buf[cons_buflen++] = data[i];
+        if (data[i] == '\n' || cons_buflen == sizeof(cons_buf))
+            cons_flush_locked();
+    }
+
+    /* partial line left over, make sure it eventually goes out */
+    if (cons_buflen && cons_flusher_idle)
+    {
+        cons_flusher_idle = 0;
+        bmk_sched_wake(cons_flusher);
+    }
+    local_irq_restore(flags);
+}
+
+void minios_console_flush(void)
+{
+    unsigned long flags;
+
+    local_irq_save(flags);
+    cons_flush_locked();
+    local_irq_restore(flags);
+}
+
+static void cons_flushthread(void *arg)
+{
+    unsigned long flags;
+
+    for (;;)
+    {
+        local_irq_save(flags);
+        if (cons_buflen == 0)
+        {
+            cons_flusher_idle = 1;
+            bmk_sched_blockprepare();
+            local_irq_restore(flags);
+            bmk_sched_block();
+            continue;
+        }
+        local_irq_restore(flags);
+
+        /* give the rest of the line a chance to arrive */
+        bmk_sched_blockprepare_timeout(
+            bmk_platform_cpu_clock_monotonic() + CONS_FLUSHDELAY);
+        bmk_sched_block();
+        minios_console_flush();
     }
-    
-    /*
-     * we assume that the lower layer loops until it manages to
-     * send everything.  XXX is this the best place to do "buffering"?
-     */
-    sent = ring_send_fn(dev, copied_ptr, length);
-    ASSERT(ring_send_fn == xencons_ring_send_no_notify || sent == length);
 }
 
 static void print(int direct, const char *fmt, va_list args)
@@ -133,20 +210,15 @@ static void print(int direct, const char *fmt, va_list args)
         (void)HYPERVISOR_console_io(CONSOLEIO_write, bmk_strlen(buf), buf);
         return;
     } else {
-#ifndef USE_XEN_CONSOLE
-    if(!console_initialised)
-#endif    
-            (void)HYPERVISOR_console_io(CONSOLEIO_write, bmk_strlen(buf), buf);
-        
-        minios_console_print(NULL, buf, bmk_strlen(buf));
+        cons_write(buf, bmk_strlen(buf));
     }
 }
 
-/* XXX: should use a putc/flush combo ... later */
 void minios_putc(int c)
 {
+    char ch = c;
 
-    minios_printk("%c", c);
+    cons_write(&ch, 1);
 }
 
 void minios_printk(const char *fmt, ...)
@@ -169,6 +241,9 @@ void init_console(void)
     minios_printk("Initialising console ... ");
     xencons_ring_init();    
     console_initialised = 1;
+    cons_flusher = bmk_sched_create("consflush", NULL, 0,
+                                    cons_flushthread, NULL, NULL, 0);
+    cons_flusher_idle = 1;
     /* This is also required to notify the daemon */
     minios_printk("done.\n");
 }
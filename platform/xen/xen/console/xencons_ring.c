@@ -66,12 +66,19 @@ int xencons_ring_send_no_notify(struct consfront_dev *dev, const char *data, uns
 int xencons_ring_send(struct consfront_dev *dev, const char *data, unsigned len)
 {
 	int sent = 0;
-	int part;
+	int part, notified = 0;
 
+	/*
+	 * If the ring is full, the backend has been notified already
+	 * and will make room, so don't hammer it with notifications.
+	 */
 	for (sent = 0; sent < len; sent += part) {
 		part = xencons_ring_send_no_notify(dev,
 		    data + sent, len - sent);
-		notify_daemon(dev);
+		if (part || !notified) {
+			notify_daemon(dev);
+			notified = 1;
+		}
 	}
 
 	ASSERT(sent == len);
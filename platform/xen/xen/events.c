@@ -23,6 +23,11 @@
 #include <mini-os/lib.h>
 #include <mini-os/wait.h>
 
+#include <bmk-core/intrstat.h>
+#include <bmk-core/platform.h>
+#include <bmk-core/printf.h>
+#include <bmk-core/trace.h>
+
 #define NR_EVS 1024
 
 /* this represents a event handler. Chaining or sharing is not allowed */
@@ -30,7 +35,7 @@ typedef struct _ev_action_t {
     spinlock_t lock;
     evtchn_handler_t handler;
     void *data;
-    uint32_t count;
+    struct bmk_intrstat stat;
 } ev_action_t;
 
 static ev_action_t ev_actions[NR_EVS];
@@ -119,7 +124,10 @@ int do_event(evtchn_port_t port, struct pt_regs *regs)
 
     spin_lock(&ev_actions[port].lock);
     action = &ev_actions[port];
-    action->count++;
+    action->stat.is_count++;
+    bmk_trace(BMK_TRACE_INTR, port, 0);
+    bmk_intrstat_latency(&action->stat,
+        bmk_platform_cpu_clock_monotonic() - _minios_hypervisor_callback_time);
 
     /* call the handler */
     action->handler(port, regs, action->data);
@@ -128,6 +136,26 @@ int do_event(evtchn_port_t port, struct pt_regs *regs)
     return 1;
 }
 
+/*
+ * Print per-port event statistics.  The latency is measured from
+ * the hypervisor upcall to the port's handler being called.
+ */
+void bmk_platform_intrstat_dump(void)
+{
+    char name[16];
+    int i;
+
+    bmk_printf("BEGIN event channel statistics\n");
+    for (i = 0; i < NR_EVS; i++)
+    {
+        if (ev_actions[i].stat.is_count == 0)
+            continue;
+        bmk_snprintf(name, sizeof(name), "port %d", i);
+        bmk_intrstat_print(name, &ev_actions[i].stat);
+    }
+    bmk_printf("END event channel statistics\n");
+}
+
 evtchn_port_t minios_bind_evtchn(evtchn_port_t port, evtchn_handler_t handler,
                                  void *data)
 {
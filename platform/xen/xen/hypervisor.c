@@ -30,12 +30,17 @@
 #include <mini-os/hypervisor.h>
 #include <mini-os/events.h>
 
+#include <bmk-core/platform.h>
+
 #define active_evtchns(cpu,sh,idx)              \
     ((sh)->evtchn_pending[idx] &                \
      ~(sh)->evtchn_mask[idx])
 
 int _minios_in_hypervisor_callback;
 
+/* entry time of the current upcall, for event latency statistics */
+uint64_t _minios_hypervisor_callback_time;
+
 void _minios_do_hypervisor_callback(struct pt_regs *regs)
 {
     unsigned long  l1, l2, l1i, l2i;
@@ -45,6 +50,7 @@ void _minios_do_hypervisor_callback(struct pt_regs *regs)
     vcpu_info_t   *vcpu_info = &s->vcpu_info[cpu];
 
     _minios_in_hypervisor_callback = 1;
+    _minios_hypervisor_callback_time = bmk_platform_cpu_clock_monotonic();
    
     vcpu_info->evtchn_upcall_pending = 0;
     /* NB x86. No need for a barrier here -- XCHG is a barrier on x86. */
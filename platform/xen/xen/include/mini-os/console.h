@@ -63,6 +63,7 @@ struct consfront_dev {
 
 void minios_printk(const char *fmt, ...);
 void minios_putc(int);
+void minios_console_flush(void);
 void xprintk(const char *fmt, ...);
 void panic(const char *fmt, ...);
 
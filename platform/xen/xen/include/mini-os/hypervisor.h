@@ -46,5 +46,6 @@ int minios_hypercall(unsigned op, unsigned long a0,
 		     unsigned long a3, unsigned long a4);
 
 extern int _minios_in_hypervisor_callback;
+extern uint64_t _minios_hypervisor_callback_time;
 
 #endif /* __MINIOS_HYPERVISOR_H__ */
@@ -3,8 +3,54 @@
 
 #include <mini-os/wait.h>
 struct netfront_dev;
-struct netfront_dev *netfront_init(char *nodename, void (*netif_rx)(struct netfront_dev *, unsigned char *data, int len), unsigned char rawmac[6], char **ip, void *priv);
+
+/* a piece of a packet for netfront_xmit_sg() and the netif_rx callback */
+struct netfront_seg {
+    void *data;
+    unsigned long len;
+};
+
+/* offloads the backend does, from netfront_features() */
+#define NETFRONT_F_CSUM  0x01	/* TCP/UDP checksum over IPv4 */
+#define NETFRONT_F_CSUM6 0x02	/* TCP/UDP checksum over IPv6 */
+#define NETFRONT_F_TSO4  0x04	/* TCP segmentation over IPv4 */
+#define NETFRONT_F_TSO6  0x08	/* TCP segmentation over IPv6 */
+#define NETFRONT_F_SG    0x10	/* packets larger than a page, e.g. jumbo */
+
+/* flags for netfront_xmit_sg() */
+#define NETFRONT_TX_CSUM 0x01	/* checksum not filled in */
+#define NETFRONT_TX_TSO4 0x02	/* segment into mss sized TCP packets */
+#define NETFRONT_TX_TSO6 0x04
+
+/* max pieces of a packet passed to the netif_rx callback */
+#define NETFRONT_RX_MAXSEG 18
+
+/* flags for the netif_rx callback */
+#define NETFRONT_RX_CSUMOK    0x01	/* checksum verified by the backend */
+#define NETFRONT_RX_CSUMBLANK 0x02	/* checksum not filled in */
+
+/* from netfront_getstats() */
+struct netfront_stats {
+    unsigned long ns_grant;	/* buffer grants set up */
+    unsigned long ns_ungrant;	/* and torn down */
+    unsigned long ns_txcopy;	/* packets sent from granted pages */
+    unsigned long ns_rxcopy;	/* packets received into granted pages */
+    unsigned long ns_rxerr;	/* received packets dropped as bad */
+};
+
+struct netfront_dev *netfront_init(char *nodename, void (*netif_rx)(struct netfront_dev *, const struct netfront_seg *seg, int nseg, int flags, int loaned), void (*netif_rxwake)(struct netfront_dev *, int queue), unsigned char rawmac[6], char **ip, void *priv);
 void netfront_xmit(struct netfront_dev *dev, unsigned char* data,int len);
+int netfront_xmit_sg(struct netfront_dev *dev, const struct netfront_seg *seg, int nseg, int flags, int mss, unsigned int flowhash, void *cookie);
+void netfront_xmit_flush(struct netfront_dev *dev);
+int netfront_xmit_reap(struct netfront_dev *dev, int queue, void **cookies, int max);
+int netfront_xmit_reapable(struct netfront_dev *dev, int queue);
+int netfront_features(struct netfront_dev *dev);
+int netfront_nqueues(struct netfront_dev *dev);
+void netfront_getstats(struct netfront_dev *dev, struct netfront_stats *ns);
+int netfront_rx(struct netfront_dev *dev, int queue, int max);
+int netfront_rx_pending(struct netfront_dev *dev, int queue);
+void netfront_rxpage_put(struct netfront_dev *dev, void *addr);
+int netfront_poll(struct netfront_dev *dev, int queue, int rxwork);
 void netfront_shutdown(struct netfront_dev *dev);
 
 void *netfront_get_private(struct netfront_dev *);
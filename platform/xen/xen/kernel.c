@@ -80,6 +80,7 @@ void
 bmk_platform_halt(const char *panicstring)
 {
 
+	minios_console_flush();
 	if (panicstring)
 		minios_printk("PANIC: %s\n", panicstring);
 	minios_stop_kernel();
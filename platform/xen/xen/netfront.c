@@ -3,6 +3,17 @@
  * Based on netfront.c from Xen Linux.
  *
  * Does not handle fragments or extras.
+ *
+ * Setting up and tearing down a grant for every buffer goes through
+ * the grant table's locked freelist, so small packets are instead
+ * copied to and from pages which stay granted for the life of the
+ * ring slot ("persistent grants").  Larger ones are worth granting
+ * the pages they are in, so that they need not be copied.
+ *
+ * If the backend does multi-queue, each queue has its own pair of
+ * rings and event channel.  Transmitted packets are spread over the
+ * queues by flow, and the upper layer is expected to run a receive
+ * thread per queue.
  */
 
 #include <mini-os/os.h>
@@ -16,6 +27,7 @@
 #include <mini-os/semaphore.h>
 
 #include <bmk-core/memalloc.h>
+#include <bmk-core/mitigate.h>
 #include <bmk-core/pgalloc.h>
 #include <bmk-core/printf.h>
 #include <bmk-core/string.h>
@@ -29,16 +41,52 @@ DECLARE_WAIT_QUEUE_HEAD(netfront_queue);
 #define NET_RX_RING_SIZE __CONST_RING_SIZE(netif_rx, PAGE_SIZE)
 #define GRANT_INVALID_REF 0
 
+/*
+ * Max number of RX pages the upper layer may hold on to.  Past that,
+ * it has to copy.  Bounds the memory a stack sitting on received
+ * packets can eat up, since each packet pins a whole page.
+ */
+#define NET_RX_MAXLOAN (4*NET_RX_RING_SIZE)
+
+/* max slots per transmitted packet netback accepts */
+#define NET_TX_MAXSLOTS 18
+
+/* max slots per received packet, larger ones are dropped */
+#define NET_RX_MAXSLOTS NETFRONT_RX_MAXSEG
+
+/*
+ * Packets up to this size are copied into a persistently granted
+ * page when sent, and passed up to be copied when received.
+ */
+#define NET_TX_COPYBREAK 512
+#define NET_RX_COPYBREAK 256
+
+/* max queues we ask netback for */
+#define NET_MAXQUEUES 4
+
+/* not in older Xen headers */
+#ifndef XEN_NETIF_GSO_TYPE_TCPV6
+#define XEN_NETIF_GSO_TYPE_TCPV6 2
+#endif
+
 struct net_buffer {
     void* page;
     grant_ref_t gref;
+    grant_ref_t pgref;	/* TX: persistent grant of page */
+    void *cookie;
 };
 
-struct netfront_dev {
-    domid_t dom;
+struct netfront_queue {
+    struct netfront_dev *dev;
+    int id;
 
     unsigned short tx_freelist[NET_TX_RING_SIZE + 1];
     struct semaphore tx_sem;
+    struct semaphore tx_busy;
+
+    /* sent packets for netfront_xmit_reap() */
+    void *tx_done[NET_TX_RING_SIZE];
+    unsigned int tx_done_prod, tx_done_cons;
 
     struct net_buffer rx_buffers[NET_RX_RING_SIZE];
     struct net_buffer tx_buffers[NET_TX_RING_SIZE];
@@ -49,6 +97,18 @@ struct netfront_dev {
     grant_ref_t rx_ring_ref;
     evtchn_port_t evtchn;
 
+    struct bmk_mitigate mit;
+};
+
+struct netfront_dev {
+    domid_t dom;
+
+    int tx_sg;
+    int features;
+
+    struct netfront_queue *queues;
+    int nqueues;
+
     char nodename[64];
 
     char *backend;
@@ -57,11 +117,20 @@ struct netfront_dev {
     struct xenbus_event_queue events;
 
 
-    void (*netif_rx)(struct netfront_dev *, unsigned char* data, int len);
+    void (*netif_rx)(struct netfront_dev *, const struct netfront_seg *seg,
+                     int nseg, int flags, int loaned);
+    void (*netif_rxwake)(struct netfront_dev *, int queue);
     void *netfront_priv;
+
+    /* RX pages given back by the upper layer, and the number out */
+    void *rx_freepages;
+    int rx_nloaned;
+    int dead;
+
+    struct netfront_stats stats;
 };
 
-void init_rx_buffers(struct netfront_dev *dev);
+void init_rx_buffers(struct netfront_queue *queue);
 
 static inline void add_id_to_freelist(unsigned int id,unsigned short* freelist)
 {
@@ -81,101 +150,252 @@ static inline int xennet_rxidx(RING_IDX idx)
     return idx & (NET_RX_RING_SIZE - 1);
 }
 
-void network_rx(struct netfront_dev *dev)
+static grant_ref_t buf_grant(struct netfront_dev *dev, void *page, int ro)
 {
-    RING_IDX rp,cons,req_prod;
-    int nr_consumed, more, i, notify;
 
-    nr_consumed = 0;
-moretodo:
-    rp = dev->rx.sring->rsp_prod;
-    rmb(); /* Ensure we see queued responses up to 'rp'. */
+    dev->stats.ns_grant++;
+    return gnttab_grant_access(dev->dom, virt_to_mfn(page), ro);
+}
 
-    for (cons = dev->rx.rsp_cons; cons != rp; nr_consumed++, cons++)
-    {
-        struct net_buffer* buf;
-        unsigned char* page;
-        int id;
+static void buf_ungrant(struct netfront_dev *dev, grant_ref_t ref)
+{
 
-        struct netif_rx_response *rx = RING_GET_RESPONSE(&dev->rx, cons);
+    dev->stats.ns_ungrant++;
+    gnttab_end_access(ref);
+}
 
-        id = rx->id;
-        BUG_ON(id >= NET_RX_RING_SIZE);
+static void *rxpage_get(struct netfront_dev *dev)
+{
+    void *page;
 
-        buf = &dev->rx_buffers[id];
-        page = (unsigned char*)buf->page;
-        gnttab_end_access(buf->gref);
+    if ((page = dev->rx_freepages) != NULL)
+        dev->rx_freepages = *(void **)page;
+    else
+        page = bmk_pgalloc_one();
+    return page;
+}
 
-        if (rx->status > NETIF_RSP_NULL)
-        {
-		dev->netif_rx(dev, page+rx->offset, rx->status);
+/*
+ * Put new pages in the n ring slots of a received packet, so that
+ * the upper layer can have the old ones.  Returns nonzero if that
+ * could be done.
+ */
+static int rx_loan(struct netfront_dev *dev, struct net_buffer **bufs, int n)
+{
+    void *pages[NET_RX_MAXSLOTS];
+    int i;
+
+    if (dev->rx_nloaned + n > NET_RX_MAXLOAN * dev->nqueues)
+        return 0;
+
+    for (i = 0; i < n; i++) {
+        if ((pages[i] = rxpage_get(dev)) == NULL) {
+            while (i--) {
+                *(void **)pages[i] = dev->rx_freepages;
+                dev->rx_freepages = pages[i];
+            }
+            return 0;
         }
     }
-    dev->rx.rsp_cons=cons;
+    for (i = 0; i < n; i++)
+        bufs[i]->page = pages[i];
+    dev->rx_nloaned += n;
 
-    RING_FINAL_CHECK_FOR_RESPONSES(&dev->rx,more);
-    if(more) goto moretodo;
+    return 1;
+}
+
+/*
+ * Return a page handed out by network_rx().  Any address within
+ * the page will do.
+ */
+void netfront_rxpage_put(struct netfront_dev *dev, void *addr)
+{
+    void *page = (void *)((unsigned long)addr & PAGE_MASK);
+
+    dev->rx_nloaned--;
+    if (dev->dead) {
+        bmk_pgfree_one(page);
+        if (dev->rx_nloaned == 0)
+            bmk_memfree(dev, BMK_MEMWHO_WIREDBMK);
+        return;
+    }
+
+    *(void **)page = dev->rx_freepages;
+    dev->rx_freepages = page;
+}
+
+/*
+ * Pass received packets to the upper layer.  Called in thread
+ * context.  A packet larger than a page comes in several slots, all
+ * but the last with NETRXF_more_data, and is passed up as a list of
+ * pieces.  If replacement pages for the ring slots can be had, the
+ * upper layer is given the pages the packet is in ("loaned"), and
+ * owns them until it calls netfront_rxpage_put() for each.
+ * Otherwise, and for packets up to NET_RX_COPYBREAK, the data must be
+ * copied before the callback returns.  The pages then stay in the
+ * ring, and stay granted.
+ *
+ * At most max packets are passed up.  The rest stay in the ring,
+ * whose slots are not reposted until the upper layer has room for
+ * them, so the backend stops sending instead of us dropping.
+ */
+int network_rx(struct netfront_queue *queue, int max)
+{
+    struct netfront_dev *dev = queue->dev;
+    struct netfront_seg seg[NET_RX_MAXSLOTS];
+    struct net_buffer *bufs[NET_RX_MAXSLOTS];
+    RING_IDX rp,cons,last,req_prod;
+    unsigned long len;
+    int nr_consumed, npkts, more, i, n, bad, notify, loaned;
+
+    nr_consumed = npkts = 0;
+moretodo:
+    rp = queue->rx.sring->rsp_prod;
+    rmb(); /* Ensure we see queued responses up to 'rp'. */
+
+    for (cons = queue->rx.rsp_cons; cons != rp && npkts < max; cons = last + 1)
+    {
+        struct netif_rx_response *rx;
+        int flags = 0;
+
+        /* netback pushes whole packets, but don't count on it */
+        for (last = cons; last != rp; last++)
+            if (!(RING_GET_RESPONSE(&queue->rx, last)->flags
+                & NETRXF_more_data))
+                break;
+        if (last == rp)
+            break;
+
+        for (n = 0, bad = 0, len = 0; n <= last - cons; n++) {
+            struct net_buffer* buf;
+            int id;
+
+            rx = RING_GET_RESPONSE(&queue->rx, cons + n);
+            id = rx->id;
+            BUG_ON(id >= NET_RX_RING_SIZE);
+
+            buf = &queue->rx_buffers[id];
+            if (n < NET_RX_MAXSLOTS) {
+                bufs[n] = buf;
+                seg[n].data = (unsigned char *)buf->page + rx->offset;
+                seg[n].len = rx->status;
+            }
+            if (rx->status <= (n ? 0 : NETIF_RSP_NULL))
+                bad = 1;
+            else
+                len += rx->status;
+        }
+        nr_consumed += n;
+        if (n > NET_RX_MAXSLOTS || bad) {
+            dev->stats.ns_rxerr++;
+            continue;
+        }
+        npkts++;
+
+        rx = RING_GET_RESPONSE(&queue->rx, cons);
+        if (rx->flags & NETRXF_csum_blank)
+            flags |= NETFRONT_RX_CSUMBLANK;
+        else if (rx->flags & NETRXF_data_validated)
+            flags |= NETFRONT_RX_CSUMOK;
+
+        /* the backend must not write into what we hand out */
+        loaned = len > NET_RX_COPYBREAK && rx_loan(dev, bufs, n);
+        if (loaned) {
+            for (i = 0; i < n; i++) {
+                buf_ungrant(dev, bufs[i]->gref);
+                bufs[i]->gref = GRANT_INVALID_REF;
+            }
+        } else {
+            dev->stats.ns_rxcopy++;
+        }
+        dev->netif_rx(dev, seg, n, flags, loaned);
+    }
+    queue->rx.rsp_cons=cons;
 
-    req_prod = dev->rx.req_prod_pvt;
+    RING_FINAL_CHECK_FOR_RESPONSES(&queue->rx,more);
+    if(more && cons == rp) goto moretodo;
+
+    req_prod = queue->rx.req_prod_pvt;
 
     for(i=0; i<nr_consumed; i++)
     {
         int id = xennet_rxidx(req_prod + i);
-        netif_rx_request_t *req = RING_GET_REQUEST(&dev->rx, req_prod + i);
-        struct net_buffer* buf = &dev->rx_buffers[id];
-        void* page = buf->page;
+        netif_rx_request_t *req = RING_GET_REQUEST(&queue->rx, req_prod + i);
+        struct net_buffer* buf = &queue->rx_buffers[id];
 
-        /* We are sure to have free gnttab entries since they got released above */
-        buf->gref = req->gref = 
-            gnttab_grant_access(dev->dom,virt_to_mfn(page),0);
+        /* a page which stayed in the ring is still granted */
+        if (buf->gref == GRANT_INVALID_REF)
+            buf->gref = buf_grant(dev, buf->page, 0);
+        req->gref = buf->gref;
 
         req->id = id;
     }
 
     wmb();
 
-    dev->rx.req_prod_pvt = req_prod + i;
+    queue->rx.req_prod_pvt = req_prod + i;
     
-    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&dev->rx, notify);
+    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&queue->rx, notify);
     if (notify)
-        minios_notify_remote_via_evtchn(dev->evtchn);
+        minios_notify_remote_via_evtchn(queue->evtchn);
 
+    return nr_consumed;
 }
 
-void network_tx_buf_gc(struct netfront_dev *dev)
+int network_tx_buf_gc(struct netfront_queue *queue)
 {
-
-
     RING_IDX cons, prod;
     unsigned short id;
+    int nr_freed = 0;
 
     do {
-        prod = dev->tx.sring->rsp_prod;
+        prod = queue->tx.sring->rsp_prod;
         rmb(); /* Ensure we see responses up to 'rp'. */
 
-        for (cons = dev->tx.rsp_cons; cons != prod; cons++) 
+        for (cons = queue->tx.rsp_cons; cons != prod; cons++) 
         {
             struct netif_tx_response *txrsp;
             struct net_buffer *buf;
 
-            txrsp = RING_GET_RESPONSE(&dev->tx, cons);
-            if (txrsp->status == NETIF_RSP_NULL)
+            txrsp = RING_GET_RESPONSE(&queue->tx, cons);
+            if (txrsp->status == NETIF_RSP_NULL) {
+                /* an extra info slot, it has no id */
+                up(&queue->tx_sem);
                 continue;
+            }
+
+            id  = txrsp->id;
+            BUG_ON(id >= NET_TX_RING_SIZE);
+            buf = &queue->tx_buffers[id];
+
+            /*
+             * No room to queue the cookie?  Leave the rest for
+             * when netfront_xmit_reap() has made some.
+             */
+            if (buf->cookie && queue->tx_done_prod - queue->tx_done_cons
+                == NET_TX_RING_SIZE) {
+                queue->tx.rsp_cons = cons;
+                return nr_freed;
+            }
 
             if (txrsp->status == NETIF_RSP_ERROR)
                 minios_printk("packet error\n");
 
-            id  = txrsp->id;
-            BUG_ON(id >= NET_TX_RING_SIZE);
-            buf = &dev->tx_buffers[id];
-            gnttab_end_access(buf->gref);
+            if (buf->gref != buf->pgref)
+                buf_ungrant(queue->dev, buf->gref);
             buf->gref=GRANT_INVALID_REF;
-
-	    add_id_to_freelist(id,dev->tx_freelist);
-	    up(&dev->tx_sem);
+            if (buf->cookie) {
+                queue->tx_done[queue->tx_done_prod++ % NET_TX_RING_SIZE]
+                    = buf->cookie;
+                buf->cookie = NULL;
+            }
+
+	    add_id_to_freelist(id,queue->tx_freelist);
+	    up(&queue->tx_sem);
+	    nr_freed++;
         }
 
-        dev->tx.rsp_cons = prod;
+        queue->tx.rsp_cons = prod;
 
         /*
          * Set a new event, then check for race with update of tx_cons.
@@ -185,67 +405,247 @@ void network_tx_buf_gc(struct netfront_dev *dev)
          * data is outstanding: in such cases notification from Xen is
          * likely to be the only kick that we'll get.
          */
-        dev->tx.sring->rsp_event =
-            prod + ((dev->tx.sring->req_prod - prod) >> 1) + 1;
+        queue->tx.sring->rsp_event =
+            prod + ((queue->tx.sring->req_prod - prod) >> 1) + 1;
         mb();
-    } while ((cons == prod) && (prod != dev->tx.sring->rsp_prod));
-
+    } while ((cons == prod) && (prod != queue->tx.sring->rsp_prod));
 
+    return nr_freed;
 }
 
+/*
+ * Received packets are processed in thread context, since the upper
+ * layer keeps the pages and needs to be able to allocate.  So just
+ * tell it there is work.
+ */
 void netfront_handler(evtchn_port_t port, struct pt_regs *regs, void *data)
 {
     int flags;
-    struct netfront_dev *dev = data;
+    struct netfront_queue *queue = data;
+    struct netfront_dev *dev = queue->dev;
 
     local_irq_save(flags);
 
-    network_tx_buf_gc(dev);
-    network_rx(dev);
+    network_tx_buf_gc(queue);
+    if (dev->netif_rxwake)
+        dev->netif_rxwake(dev, queue->id);
+
+    /* flooded?  mask the event channel and let the driver poll */
+    if (bmk_mitigate_intr(&queue->mit))
+        minios_mask_evtchn(queue->evtchn);
 
     local_irq_restore(flags);
 }
 
+/*
+ * Process up to max packets received on queue q, see network_rx().
+ */
+int netfront_rx(struct netfront_dev *dev, int q, int max)
+{
 
-static void free_netfront(struct netfront_dev *dev)
+    return network_rx(&dev->queues[q], max);
+}
+
+/* are there received packets netfront_rx() would process? */
+int netfront_rx_pending(struct netfront_dev *dev, int q)
+{
+
+    return RING_HAS_UNCONSUMED_RESPONSES(&dev->queues[q].rx);
+}
+
+/*
+ * If queue q is in polling mode (see netfront_handler()), reap sent
+ * packets and decide whether to keep polling, given the number of
+ * packets the caller just got out of netfront_rx().  Returns nonzero
+ * if the caller should keep polling, and zero when we are (back) in
+ * interrupt mode.
+ */
+int netfront_poll(struct netfront_dev *dev, int q, int rxwork)
+{
+    struct netfront_queue *queue = &dev->queues[q];
+    int flags, work, polling;
+
+    local_irq_save(flags);
+    if (!queue->mit.mit_polling) {
+        local_irq_restore(flags);
+        return 0;
+    }
+
+    work = rxwork + network_tx_buf_gc(queue);
+    if (!bmk_mitigate_poll(&queue->mit, work)) {
+        /* back to interrupts.  anything which arrived meanwhile
+         * left the event pending, and unmasking delivers it */
+        minios_unmask_evtchn(queue->evtchn);
+        network_tx_buf_gc(queue);
+    }
+    polling = queue->mit.mit_polling;
+    local_irq_restore(flags);
+
+    return polling;
+}
+
+
+static void free_queue(struct netfront_queue *queue)
 {
     int i;
 
     for(i=0;i<NET_TX_RING_SIZE;i++)
-	down(&dev->tx_sem);
+	down(&queue->tx_sem);
+
+    minios_mask_evtchn(queue->evtchn);
+
+    gnttab_end_access(queue->rx_ring_ref);
+    gnttab_end_access(queue->tx_ring_ref);
+
+    bmk_pgfree_one(queue->rx.sring);
+    bmk_pgfree_one(queue->tx.sring);
+
+    minios_unbind_evtchn(queue->evtchn);
+
+    for(i=0;i<NET_RX_RING_SIZE;i++) {
+	buf_ungrant(queue->dev, queue->rx_buffers[i].gref);
+	bmk_pgfree_one(queue->rx_buffers[i].page);
+    }
+
+    for(i=0;i<NET_TX_RING_SIZE;i++) {
+	if (queue->tx_buffers[i].page) {
+	    buf_ungrant(queue->dev, queue->tx_buffers[i].pgref);
+	    bmk_pgfree_one(queue->tx_buffers[i].page);
+	}
+    }
+}
+
+static void free_netfront(struct netfront_dev *dev)
+{
+    void *page;
+    int i;
 
-    minios_mask_evtchn(dev->evtchn);
+    for (i = 0; i < dev->nqueues; i++)
+	free_queue(&dev->queues[i]);
+    bmk_memfree(dev->queues, BMK_MEMWHO_WIREDBMK);
 
     bmk_memfree(dev->mac, BMK_MEMWHO_WIREDBMK);
     bmk_memfree(dev->backend, BMK_MEMWHO_WIREDBMK);
 
-    gnttab_end_access(dev->rx_ring_ref);
-    gnttab_end_access(dev->tx_ring_ref);
-
-    bmk_pgfree_one(dev->rx.sring);
-    bmk_pgfree_one(dev->tx.sring);
+    while ((page = dev->rx_freepages) != NULL) {
+	dev->rx_freepages = *(void **)page;
+	bmk_pgfree_one(page);
+    }
 
-    minios_unbind_evtchn(dev->evtchn);
+    /* pages still out, the last one returned frees dev */
+    if (dev->rx_nloaned) {
+	dev->dead = 1;
+	return;
+    }
+    bmk_memfree(dev, BMK_MEMWHO_WIREDBMK);
+}
 
-    for(i=0;i<NET_RX_RING_SIZE;i++) {
-	gnttab_end_access(dev->rx_buffers[i].gref);
-	bmk_pgfree_one(dev->rx_buffers[i].page);
+/* the value of a numeric key of the backend, 0 if it is not there */
+static int backend_feature(struct netfront_dev *dev, const char *name)
+{
+    char path[bmk_strlen(dev->backend) + 1 + bmk_strlen(name) + 1];
+    char *err, *value;
+    int rv = 0;
+
+    bmk_snprintf(path, sizeof(path), "%s/%s", dev->backend, name);
+    if ((err = xenbus_read(XBT_NIL, path, &value)) == NULL) {
+        rv = bmk_strtoul(value, NULL, 10);
+        bmk_memfree(value, BMK_MEMWHO_WIREDBMK);
     }
+    bmk_memfree(err, BMK_MEMWHO_WIREDBMK);
+
+    return rv;
+}
+
+static void setup_queue(struct netfront_dev *dev, struct netfront_queue *queue,
+    int id)
+{
+    struct netif_tx_sring *txs;
+    struct netif_rx_sring *rxs;
+    int i;
+
+    queue->dev = dev;
+    queue->id = id;
 
+    init_SEMAPHORE(&queue->tx_sem, NET_TX_RING_SIZE);
+    init_MUTEX(&queue->tx_busy);
+    bmk_mitigate_init(&queue->mit);
     for(i=0;i<NET_TX_RING_SIZE;i++)
-	if (dev->tx_buffers[i].page)
-	    bmk_pgfree_one(dev->tx_buffers[i].page);
+    {
+	add_id_to_freelist(i,queue->tx_freelist);
+        queue->tx_buffers[i].page = NULL;
+        queue->tx_buffers[i].gref = GRANT_INVALID_REF;
+        queue->tx_buffers[i].pgref = GRANT_INVALID_REF;
+    }
 
-    bmk_memfree(dev, BMK_MEMWHO_WIREDBMK);
+    for(i=0;i<NET_RX_RING_SIZE;i++)
+    {
+	/* TODO: that's a lot of memory */
+        queue->rx_buffers[i].page = bmk_pgalloc_one();
+    }
+
+    minios_evtchn_alloc_unbound(dev->dom, netfront_handler, queue,
+        &queue->evtchn);
+
+    txs = bmk_pgalloc_one();
+    rxs = bmk_pgalloc_one();
+    bmk_memset(txs,0,PAGE_SIZE);
+    bmk_memset(rxs,0,PAGE_SIZE);
+
+
+    SHARED_RING_INIT(txs);
+    SHARED_RING_INIT(rxs);
+    FRONT_RING_INIT(&queue->tx, txs, PAGE_SIZE);
+    FRONT_RING_INIT(&queue->rx, rxs, PAGE_SIZE);
+
+    queue->tx_ring_ref = gnttab_grant_access(dev->dom,virt_to_mfn(txs),0);
+    queue->rx_ring_ref = gnttab_grant_access(dev->dom,virt_to_mfn(rxs),0);
+
+    init_rx_buffers(queue);
+}
+
+/*
+ * Publish the rings and event channel of a queue.  With a single
+ * queue, they go where a backend without multi-queue looks for them.
+ */
+static char *write_queue(xenbus_transaction_t xbt, struct netfront_dev *dev,
+    struct netfront_queue *queue, char **message)
+{
+    char prefix[16], path[64];
+    char *err;
+
+    if (dev->nqueues == 1)
+        prefix[0] = '\0';
+    else
+        bmk_snprintf(prefix, sizeof(prefix), "queue-%d/", queue->id);
+
+    bmk_snprintf(path, sizeof(path), "%stx-ring-ref", prefix);
+    err = xenbus_printf(xbt, dev->nodename, path, "%u", queue->tx_ring_ref);
+    if (err) {
+        *message = "writing tx ring-ref";
+        return err;
+    }
+    bmk_snprintf(path, sizeof(path), "%srx-ring-ref", prefix);
+    err = xenbus_printf(xbt, dev->nodename, path, "%u", queue->rx_ring_ref);
+    if (err) {
+        *message = "writing rx ring-ref";
+        return err;
+    }
+    bmk_snprintf(path, sizeof(path), "%sevent-channel", prefix);
+    err = xenbus_printf(xbt, dev->nodename, path, "%u", queue->evtchn);
+    if (err) {
+        *message = "writing event-channel";
+        return err;
+    }
+
+    return NULL;
 }
 
-struct netfront_dev *netfront_init(char *_nodename, void (*thenetif_rx)(struct netfront_dev *, unsigned char* data, int len), unsigned char rawmac[6], char **ip, void *priv)
+struct netfront_dev *netfront_init(char *_nodename, void (*thenetif_rx)(struct netfront_dev *, const struct netfront_seg *seg, int nseg, int flags, int loaned), void (*thenetif_rxwake)(struct netfront_dev *, int queue), unsigned char rawmac[6], char **ip, void *priv)
 {
     xenbus_transaction_t xbt;
     char* err;
     char* message=NULL;
-    struct netif_tx_sring *txs;
-    struct netif_rx_sring *rxs;
     int retry=0;
     int i;
     char* msg = NULL;
@@ -263,42 +663,41 @@ struct netfront_dev *netfront_init(char *_nodename, void (*thenetif_rx)(struct n
         bmk_strncpy(dev->nodename, _nodename, sizeof(dev->nodename)-1);
     netfrontends++;
 
-    minios_printk("net TX ring size %d\n", NET_TX_RING_SIZE);
-    minios_printk("net RX ring size %d\n", NET_RX_RING_SIZE);
-    init_SEMAPHORE(&dev->tx_sem, NET_TX_RING_SIZE);
-    for(i=0;i<NET_TX_RING_SIZE;i++)
-    {
-	add_id_to_freelist(i,dev->tx_freelist);
-        dev->tx_buffers[i].page = NULL;
-    }
+    bmk_snprintf(path, sizeof(path), "%s/backend", dev->nodename);
+    msg = xenbus_read(XBT_NIL, path, &dev->backend);
+    bmk_memfree(msg, BMK_MEMWHO_WIREDBMK);
+    bmk_snprintf(path, sizeof(path), "%s/mac", dev->nodename);
+    msg = xenbus_read(XBT_NIL, path, &dev->mac);
 
-    for(i=0;i<NET_RX_RING_SIZE;i++)
-    {
-	/* TODO: that's a lot of memory */
-        dev->rx_buffers[i].page = bmk_pgalloc_one();
+    if ((dev->backend == NULL) || (dev->mac == NULL)) {
+        minios_printk("%s: backend/mac failed\n", __func__);
+        goto error;
     }
 
-    bmk_snprintf(path, sizeof(path), "%s/backend-id", dev->nodename);
-    dev->dom = xenbus_read_integer(path);
-        minios_evtchn_alloc_unbound(dev->dom, netfront_handler, dev, &dev->evtchn);
-
-    txs = bmk_pgalloc_one();
-    rxs = bmk_pgalloc_one();
-    bmk_memset(txs,0,PAGE_SIZE);
-    bmk_memset(rxs,0,PAGE_SIZE);
+    minios_printk("netfront: node=%s backend=%s\n", dev->nodename, dev->backend);
+    minios_printk("netfront: MAC %s\n", dev->mac);
 
+    /* as many queues as the backend lets us have, up to our limit */
+    dev->nqueues = backend_feature(dev, "multi-queue-max-queues");
+    if (dev->nqueues > NET_MAXQUEUES)
+        dev->nqueues = NET_MAXQUEUES;
+    if (dev->nqueues < 1)
+        dev->nqueues = 1;
 
-    SHARED_RING_INIT(txs);
-    SHARED_RING_INIT(rxs);
-    FRONT_RING_INIT(&dev->tx, txs, PAGE_SIZE);
-    FRONT_RING_INIT(&dev->rx, rxs, PAGE_SIZE);
+    minios_printk("net TX ring size %d\n", NET_TX_RING_SIZE);
+    minios_printk("net RX ring size %d\n", NET_RX_RING_SIZE);
+    minios_printk("net queues %d\n", dev->nqueues);
 
-    dev->tx_ring_ref = gnttab_grant_access(dev->dom,virt_to_mfn(txs),0);
-    dev->rx_ring_ref = gnttab_grant_access(dev->dom,virt_to_mfn(rxs),0);
+    bmk_snprintf(path, sizeof(path), "%s/backend-id", dev->nodename);
+    dev->dom = xenbus_read_integer(path);
 
-    init_rx_buffers(dev);
+    dev->queues = bmk_memcalloc(dev->nqueues, sizeof(*dev->queues),
+        BMK_MEMWHO_WIREDBMK);
+    for (i = 0; i < dev->nqueues; i++)
+        setup_queue(dev, &dev->queues[i], i);
 
     dev->netif_rx = thenetif_rx;
+    dev->netif_rxwake = thenetif_rxwake;
 
     xenbus_event_queue_init(&dev->events);
 
@@ -309,27 +708,35 @@ again:
         bmk_memfree(err, BMK_MEMWHO_WIREDBMK);
     }
 
-    err = xenbus_printf(xbt, dev->nodename, "tx-ring-ref","%u",
-                dev->tx_ring_ref);
-    if (err) {
-        message = "writing tx ring-ref";
-        goto abort_transaction;
+    if (dev->nqueues > 1) {
+        err = xenbus_printf(xbt, dev->nodename, "multi-queue-num-queues",
+                    "%u", dev->nqueues);
+        if (err) {
+            message = "writing multi-queue-num-queues";
+            goto abort_transaction;
+        }
+    }
+    for (i = 0; i < dev->nqueues; i++) {
+        err = write_queue(xbt, dev, &dev->queues[i], &message);
+        if (err)
+            goto abort_transaction;
     }
-    err = xenbus_printf(xbt, dev->nodename, "rx-ring-ref","%u",
-                dev->rx_ring_ref);
+    /* we can take packets with the checksum not filled in */
+    err = xenbus_printf(xbt, dev->nodename, "feature-no-csum-offload", "%u", 0);
     if (err) {
-        message = "writing rx ring-ref";
+        message = "writing feature-no-csum-offload";
         goto abort_transaction;
     }
-    err = xenbus_printf(xbt, dev->nodename,
-                "event-channel", "%u", dev->evtchn);
+    err = xenbus_printf(xbt, dev->nodename, "feature-ipv6-csum-offload", "%u", 1);
     if (err) {
-        message = "writing event-channel";
+        message = "writing feature-ipv6-csum-offload";
         goto abort_transaction;
     }
-    err = xenbus_printf(xbt, dev->nodename, "feature-no-csum-offload", "%u", 1);
+
+    /* we take packets in several slots, see network_rx() */
+    err = xenbus_printf(xbt, dev->nodename, "feature-sg", "%u", 1);
     if (err) {
-        message = "writing feature-no-csum-offload";
+        message = "writing feature-sg";
         goto abort_transaction;
     }
 
@@ -364,18 +771,22 @@ abort_transaction:
 
 done:
 
-    bmk_snprintf(path, sizeof(path), "%s/backend", dev->nodename);
-    msg = xenbus_read(XBT_NIL, path, &dev->backend);
-    bmk_snprintf(path, sizeof(path), "%s/mac", dev->nodename);
-    msg = xenbus_read(XBT_NIL, path, &dev->mac);
-
-    if ((dev->backend == NULL) || (dev->mac == NULL)) {
-        minios_printk("%s: backend/mac failed\n", __func__);
-        goto error;
-    }
-
-    minios_printk("netfront: node=%s backend=%s\n", dev->nodename, dev->backend);
-    minios_printk("netfront: MAC %s\n", dev->mac);
+    /*
+     * netback always does IPv4 checksums.  Segmentation offload
+     * and jumbo frames produce packets larger than a page, so need
+     * scatter-gather.
+     */
+    dev->tx_sg = backend_feature(dev, "feature-sg");
+    dev->features = NETFRONT_F_CSUM;
+    if (dev->tx_sg)
+        dev->features |= NETFRONT_F_SG;
+    if (backend_feature(dev, "feature-ipv6-csum-offload"))
+        dev->features |= NETFRONT_F_CSUM6;
+    if (dev->tx_sg && backend_feature(dev, "feature-gso-tcpv4"))
+        dev->features |= NETFRONT_F_TSO4;
+    if (dev->tx_sg && (dev->features & NETFRONT_F_CSUM6)
+      && backend_feature(dev, "feature-gso-tcpv6"))
+        dev->features |= NETFRONT_F_TSO6;
 
     {
         XenbusState state;
@@ -400,7 +811,8 @@ done:
         }
     }
 
-    minios_unmask_evtchn(dev->evtchn);
+    for (i = 0; i < dev->nqueues; i++)
+        minios_unmask_evtchn(dev->queues[i].evtchn);
 
     if (rawmac) {
 	char *p;
@@ -428,15 +840,28 @@ error:
 }
 
 
+static void netfront_rm(struct netfront_dev *dev, const char *name)
+{
+    char path[bmk_strlen(dev->nodename) + 1 + bmk_strlen(name) + 1];
+
+    bmk_snprintf(path, sizeof(path), "%s/%s", dev->nodename, name);
+    xenbus_rm(XBT_NIL, path);
+}
+
 void netfront_shutdown(struct netfront_dev *dev)
 {
     char* err = NULL;
     XenbusState state;
+    int i;
 
     char path[bmk_strlen(dev->backend) + 1 + 5 + 1];
     char nodename[bmk_strlen(dev->nodename) + 1 + 5 + 1];
 
     minios_printk("close network: backend at %s\n",dev->backend);
+    minios_printk("netfront: %lu grants, %lu ended, "
+        "%lu packets sent and %lu received via persistent grants\n",
+        dev->stats.ns_grant, dev->stats.ns_ungrant,
+        dev->stats.ns_txcopy, dev->stats.ns_rxcopy);
 
     bmk_snprintf(path, sizeof(path), "%s/state", dev->backend);
     bmk_snprintf(nodename, sizeof(nodename), "%s/state", dev->nodename);
@@ -476,21 +901,27 @@ close:
     if (err) bmk_memfree(err, BMK_MEMWHO_WIREDBMK);
     xenbus_unwatch_path_token(XBT_NIL, path, path);
 
-    bmk_snprintf(path, sizeof(path), "%s/tx-ring-ref", nodename);
-    xenbus_rm(XBT_NIL, path);
-    bmk_snprintf(path, sizeof(path), "%s/rx-ring-ref", nodename);
-    xenbus_rm(XBT_NIL, path);
-    bmk_snprintf(path, sizeof(path), "%s/event-channel", nodename);
-    xenbus_rm(XBT_NIL, path);
-    bmk_snprintf(path, sizeof(path), "%s/request-rx-copy", nodename);
-    xenbus_rm(XBT_NIL, path);
+    if (dev->nqueues == 1) {
+        netfront_rm(dev, "tx-ring-ref");
+        netfront_rm(dev, "rx-ring-ref");
+        netfront_rm(dev, "event-channel");
+    } else {
+        char queue[16];
+
+        for (i = 0; i < dev->nqueues; i++) {
+            bmk_snprintf(queue, sizeof(queue), "queue-%d", i);
+            netfront_rm(dev, queue);
+        }
+        netfront_rm(dev, "multi-queue-num-queues");
+    }
+    netfront_rm(dev, "request-rx-copy");
 
     if (!err)
         free_netfront(dev);
 }
 
 
-void init_rx_buffers(struct netfront_dev *dev)
+void init_rx_buffers(struct netfront_queue *queue)
 {
     int i, requeue_idx;
     netif_rx_request_t *req;
@@ -499,30 +930,44 @@ void init_rx_buffers(struct netfront_dev *dev)
     /* Rebuild the RX buffer freelist and the RX ring itself. */
     for (requeue_idx = 0, i = 0; i < NET_RX_RING_SIZE; i++) 
     {
-        struct net_buffer* buf = &dev->rx_buffers[requeue_idx];
-        req = RING_GET_REQUEST(&dev->rx, requeue_idx);
+        struct net_buffer* buf = &queue->rx_buffers[requeue_idx];
+        req = RING_GET_REQUEST(&queue->rx, requeue_idx);
 
-        buf->gref = req->gref = 
-            gnttab_grant_access(dev->dom,virt_to_mfn(buf->page),0);
+        buf->gref = req->gref = buf_grant(queue->dev, buf->page, 0);
 
         req->id = requeue_idx;
 
         requeue_idx++;
     }
 
-    dev->rx.req_prod_pvt = requeue_idx;
+    queue->rx.req_prod_pvt = requeue_idx;
 
-    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&dev->rx, notify);
+    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&queue->rx, notify);
 
     if (notify) 
-        minios_notify_remote_via_evtchn(dev->evtchn);
+        minios_notify_remote_via_evtchn(queue->evtchn);
 
-    dev->rx.sring->rsp_event = dev->rx.rsp_cons + 1;
+    queue->rx.sring->rsp_event = queue->rx.rsp_cons + 1;
 }
 
 
+/*
+ * The page of a TX slot for copying packets into.  It is granted to
+ * the backend for as long as the slot exists.
+ */
+static void *tx_page(struct netfront_queue *queue, struct net_buffer *buf)
+{
+
+    if (buf->page == NULL) {
+        buf->page = bmk_pgalloc_one();
+        buf->pgref = buf_grant(queue->dev, buf->page, 1);
+    }
+    return buf->page;
+}
+
 void netfront_xmit(struct netfront_dev *dev, unsigned char* data,int len)
 {
+    struct netfront_queue *queue = &dev->queues[0];
     int flags;
     struct netif_tx_request *tx;
     RING_IDX i;
@@ -533,40 +978,280 @@ void netfront_xmit(struct netfront_dev *dev, unsigned char* data,int len)
 
     BUG_ON(len > PAGE_SIZE);
 
-    down(&dev->tx_sem);
+    down(&queue->tx_sem);
 
     local_irq_save(flags);
-    id = get_id_from_freelist(dev->tx_freelist);
+    id = get_id_from_freelist(queue->tx_freelist);
     local_irq_restore(flags);
 
-    buf = &dev->tx_buffers[id];
-    page = buf->page;
-    if (!page)
-	page = buf->page = bmk_pgalloc_one();
+    buf = &queue->tx_buffers[id];
+    page = tx_page(queue, buf);
 
-    i = dev->tx.req_prod_pvt;
-    tx = RING_GET_REQUEST(&dev->tx, i);
+    i = queue->tx.req_prod_pvt;
+    tx = RING_GET_REQUEST(&queue->tx, i);
 
     bmk_memcpy(page,data,len);
 
-    buf->gref = 
-        tx->gref = gnttab_grant_access(dev->dom,virt_to_mfn(page),1);
+    buf->gref = tx->gref = buf->pgref;
 
     tx->offset=0;
     tx->size = len;
     tx->flags=0;
     tx->id = id;
-    dev->tx.req_prod_pvt = i + 1;
+    queue->tx.req_prod_pvt = i + 1;
+
+    wmb();
+
+    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&queue->tx, notify);
+
+    if(notify) minios_notify_remote_via_evtchn(queue->evtchn);
+
+    local_irq_save(flags);
+    network_tx_buf_gc(queue);
+    local_irq_restore(flags);
+}
+
+static unsigned short tx_getid(struct netfront_queue *queue)
+{
+    unsigned short id;
+    int flags;
+
+    local_irq_save(flags);
+    id = get_id_from_freelist(queue->tx_freelist);
+    local_irq_restore(flags);
+
+    return id;
+}
+
+/* data is in the slot's own page if copied, see tx_page() */
+static void tx_queue(struct netfront_queue *queue, RING_IDX i, unsigned short id,
+    void *data, int size, int copied)
+{
+    struct netif_tx_request *tx;
+    struct net_buffer *buf = &queue->tx_buffers[id];
+
+    tx = RING_GET_REQUEST(&queue->tx, i);
+    if (copied)
+        buf->gref = tx->gref = buf->pgref;
+    else
+        buf->gref = tx->gref = buf_grant(queue->dev, data, 1);
+    tx->offset = (unsigned long)data & ~PAGE_MASK;
+    tx->size = size;
+    tx->flags = NETTXF_more_data;
+    tx->id = id;
+}
+
+/* let the backend at the queued requests */
+static void tx_push(struct netfront_queue *queue)
+{
+    int notify;
+
+    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&queue->tx, notify);
+    if (notify)
+        minios_notify_remote_via_evtchn(queue->evtchn);
+}
+
+/*
+ * Queue a packet made up of nseg pieces.  If the backend takes
+ * multi-slot packets, the pages the data is in are granted to the
+ * backend read-only, a slot per page, like NetBSD's xennet does with
+ * mbufs.  Otherwise, if the packet would need too many slots, or if
+ * it is small enough for copying to be cheaper than granting
+ * (NET_TX_COPYBREAK), the data is copied into the netfront's own
+ * persistently granted pages.  Either way, the
+ * caller gets "cookie" back from netfront_xmit_reap() once the
+ * backend is done with the packet, and must leave the data alone
+ * until then.
+ *
+ * flags asks for checksum or segmentation offload, see
+ * netfront_features(), and mss is the TCP segment size for the
+ * latter.  Packets with the same flowhash go out on the same queue,
+ * and so stay in order.
+ *
+ * The backend sees queued packets only after netfront_xmit_flush(),
+ * so that a burst costs one notification, or when we run out of
+ * slots.
+ *
+ * Returns nonzero if the packet could not be sent.
+ */
+int netfront_xmit_sg(struct netfront_dev *dev,
+    const struct netfront_seg *seg, int nseg, int flags, int mss,
+    unsigned int flowhash, void *cookie)
+{
+    struct netfront_queue *queue = &dev->queues[flowhash % dev->nqueues];
+    struct netif_tx_request *tx, *first;
+    struct netif_extra_info *gso;
+    unsigned long len, off, n, copied, soff;
+    unsigned char *data, *page;
+    int i, si, nslots, copy, extra;
+    unsigned short id;
+    RING_IDX start, prod;
+
+    for (i = 0, len = 0, nslots = 0; i < nseg; i++) {
+        off = (unsigned long)seg[i].data & ~PAGE_MASK;
+        if (seg[i].len)
+            nslots += (off + seg[i].len + PAGE_SIZE-1) / PAGE_SIZE;
+        len += seg[i].len;
+    }
+    if (len == 0)
+        return 1;
+
+    copy = !dev->tx_sg || nslots > NET_TX_MAXSLOTS || len <= NET_TX_COPYBREAK;
+    if (copy) {
+        nslots = (len + PAGE_SIZE-1) / PAGE_SIZE;
+        if (nslots > (dev->tx_sg ? NET_TX_MAXSLOTS : 1))
+            return 1;
+        dev->stats.ns_txcopy++;
+    }
+
+    /* segmentation takes an extra info slot */
+    extra = (flags & (NETFRONT_TX_TSO4|NETFRONT_TX_TSO6)) != 0;
+
+    /* one packet at a time grabs slots, or we could deadlock */
+    down(&queue->tx_busy);
+    for (i = 0; i < nslots + extra; i++) {
+        if (!trydown(&queue->tx_sem)) {
+            /* the ring is full of what we queued? */
+            tx_push(queue);
+            down(&queue->tx_sem);
+        }
+    }
+    up(&queue->tx_busy);
+
+    /* the extra info, if any, goes right after the first slot */
+    start = prod = queue->tx.req_prod_pvt;
+    if (copy) {
+        for (copied = 0, si = 0, soff = 0; copied < len; copied += n) {
+            struct net_buffer *buf;
+            unsigned long left;
+
+            id = tx_getid(queue);
+            buf = &queue->tx_buffers[id];
+            page = tx_page(queue, buf);
+
+            n = len - copied;
+            if (n > PAGE_SIZE)
+                n = PAGE_SIZE;
+            for (off = 0; off < n; off += left) {
+                while (soff == seg[si].len) {
+                    si++;
+                    soff = 0;
+                }
+                left = seg[si].len - soff;
+                if (left > n - off)
+                    left = n - off;
+                bmk_memcpy(page + off, (char *)seg[si].data + soff, left);
+                soff += left;
+            }
+            tx_queue(queue, prod++, id, page, n, 1);
+            if (prod == start + 1)
+                prod += extra;
+        }
+    } else {
+        for (si = 0; si < nseg; si++) {
+            data = seg[si].data;
+            for (soff = 0; soff < seg[si].len; soff += n) {
+                n = PAGE_SIZE - ((unsigned long)(data + soff) & ~PAGE_MASK);
+                if (n > seg[si].len - soff)
+                    n = seg[si].len - soff;
+                tx_queue(queue, prod++, tx_getid(queue), data + soff, n, 0);
+                if (prod == start + 1)
+                    prod += extra;
+            }
+        }
+    }
+
+    /* the first slot has the size of the packet, the last no more_data */
+    first = RING_GET_REQUEST(&queue->tx, start);
+    first->size = len;
+    tx = RING_GET_REQUEST(&queue->tx, prod-1);
+    tx->flags &= ~NETTXF_more_data;
+    queue->tx_buffers[tx->id].cookie = cookie;
+
+    if (flags & (NETFRONT_TX_CSUM|NETFRONT_TX_TSO4|NETFRONT_TX_TSO6))
+        first->flags |= NETTXF_csum_blank | NETTXF_data_validated;
+    if (extra) {
+        first->flags |= NETTXF_extra_info;
+        gso = (struct netif_extra_info *)RING_GET_REQUEST(&queue->tx, start+1);
+        bmk_memset(gso, 0, sizeof(*gso));
+        gso->type = XEN_NETIF_EXTRA_TYPE_GSO;
+        gso->u.gso.size = mss;
+        gso->u.gso.type = flags & NETFRONT_TX_TSO6
+            ? XEN_NETIF_GSO_TYPE_TCPV6 : XEN_NETIF_GSO_TYPE_TCPV4;
+    }
+    queue->tx.req_prod_pvt = prod;
+
+    return 0;
+}
+
+/*
+ * Pass the packets queued by netfront_xmit_sg() to the backend, and
+ * reclaim the slots of the ones it has finished with.  Queues with
+ * nothing new cost no notification.
+ */
+void netfront_xmit_flush(struct netfront_dev *dev)
+{
+    struct netfront_queue *queue;
+    int flags, i;
 
     wmb();
+    for (i = 0; i < dev->nqueues; i++) {
+        queue = &dev->queues[i];
+        tx_push(queue);
 
-    RING_PUSH_REQUESTS_AND_CHECK_NOTIFY(&dev->tx, notify);
+        local_irq_save(flags);
+        network_tx_buf_gc(queue);
+        local_irq_restore(flags);
+    }
+}
 
-    if(notify) minios_notify_remote_via_evtchn(dev->evtchn);
+/*
+ * Collect up to max cookies of packets sent on queue q with
+ * netfront_xmit_sg().  Returns the number collected.
+ */
+int netfront_xmit_reap(struct netfront_dev *dev, int q, void **cookies,
+    int max)
+{
+    struct netfront_queue *queue = &dev->queues[q];
+    int flags, n;
 
     local_irq_save(flags);
-    network_tx_buf_gc(dev);
+    for (n = 0; n < max && queue->tx_done_cons != queue->tx_done_prod; n++)
+        cookies[n] = queue->tx_done[queue->tx_done_cons++ % NET_TX_RING_SIZE];
+    if (n)
+        network_tx_buf_gc(queue);
     local_irq_restore(flags);
+
+    return n;
+}
+
+/* the NETFRONT_F_* offloads the backend does */
+int netfront_features(struct netfront_dev *dev)
+{
+
+    return dev->features;
+}
+
+/* grant and copy counts, see struct netfront_stats */
+void netfront_getstats(struct netfront_dev *dev, struct netfront_stats *ns)
+{
+
+    *ns = dev->stats;
+}
+
+/* the number of queues, numbered from 0 */
+int netfront_nqueues(struct netfront_dev *dev)
+{
+
+    return dev->nqueues;
+}
+
+/* are there sent packets on queue q for netfront_xmit_reap()? */
+int netfront_xmit_reapable(struct netfront_dev *dev, int q)
+{
+    struct netfront_queue *queue = &dev->queues[q];
+
+    return queue->tx_done_cons != queue->tx_done_prod;
 }
 
 void *
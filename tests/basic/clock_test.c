@@ -0,0 +1,110 @@
+/*
+ * Test the clock_gettime()/gettimeofday() fast paths against the
+ * rump kernel syscall path and report the cost per call of each.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <rumprun/tester.h>
+
+#define NCALLS 1000000
+
+/* the syscall path, bypassing the libc-level fast path */
+int _sys___clock_gettime50(clockid_t, struct timespec *);
+
+static int64_t
+ts2ns(const struct timespec *ts)
+{
+
+	return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static int
+test_monotonic(void)
+{
+	struct timespec ts;
+	int64_t prev, now;
+	int i;
+
+	printf("checking that CLOCK_MONOTONIC does not go backwards ... ");
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	prev = ts2ns(&ts);
+	for (i = 0; i < NCALLS; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = ts2ns(&ts);
+		if (now < prev) {
+			printf("NOK: %" PRId64 " < %" PRId64 "\n", now, prev);
+			return 1;
+		}
+		prev = now;
+	}
+	printf("OK!\n");
+
+	return 0;
+}
+
+static int
+test_realtime(void)
+{
+	struct timespec fast, slow;
+	struct timeval tv;
+	int64_t diff;
+
+	printf("checking that fast and syscall CLOCK_REALTIME agree ... ");
+	clock_gettime(CLOCK_REALTIME, &fast);
+	_sys___clock_gettime50(CLOCK_REALTIME, &slow);
+	gettimeofday(&tv, NULL);
+
+	/* allow for the rump kernel's timecounter window */
+	diff = ts2ns(&slow) - ts2ns(&fast);
+	if (diff < -1000000000LL || diff > 1000000000LL) {
+		printf("NOK: differ by %" PRId64 "ns\n", diff);
+		return 1;
+	}
+	if (tv.tv_sec < fast.tv_sec || tv.tv_sec > fast.tv_sec + 1) {
+		printf("NOK: gettimeofday %lld vs. %lld\n",
+		    (long long)tv.tv_sec, (long long)fast.tv_sec);
+		return 1;
+	}
+	printf("OK!\n");
+
+	return 0;
+}
+
+static void
+bench(const char *name, clockid_t clk,
+	int (*gettime)(clockid_t, struct timespec *))
+{
+	struct timespec start, end, ts;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < NCALLS; i++)
+		gettime(clk, &ts);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("%s: %" PRId64 " ns/call, %" PRId64 " calls/s\n", name,
+	    (ts2ns(&end) - ts2ns(&start)) / NCALLS,
+	    NCALLS * 1000000000LL / (ts2ns(&end) - ts2ns(&start) + 1));
+}
+
+int
+rumprun_test(int argc, char *argv[])
+{
+	int rv = 0;
+
+	rv += test_monotonic();
+	rv += test_realtime();
+
+	bench("CLOCK_MONOTONIC fast path", CLOCK_MONOTONIC, clock_gettime);
+	bench("CLOCK_REALTIME fast path", CLOCK_REALTIME, clock_gettime);
+	bench("CLOCK_MONOTONIC syscall", CLOCK_MONOTONIC,
+	    _sys___clock_gettime50);
+
+	return rv;
+}
@@ -0,0 +1,77 @@
+/*
+ * Measure console logging throughput, i.e. how much an application
+ * which logs to stdout is slowed down by the console.  The lines are
+ * written in bursts small enough to fit into the console buffer, as
+ * a logging service would, and then as one large burst.
+ *
+ * The log lines go to the console, not to stdout: under the test
+ * framework stdout is the (small) result disk.
+ */
+
+#include <sys/types.h>
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rumprun/tester.h>
+
+#define LINELEN 64
+#define BURST 64
+#define NBURSTS 16
+
+static FILE *cons;
+
+static int64_t
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t
+logburst(int nlines)
+{
+	int64_t start;
+	int i;
+
+	start = now();
+	for (i = 0; i < nlines; i++)
+		fprintf(cons, "conslog line %6d: %*s\n", i, LINELEN-22, "...");
+	fflush(cons);
+	return now() - start;
+}
+
+static void
+report(const char *what, int nlines, int64_t ns)
+{
+	int64_t bytes = (int64_t)nlines * LINELEN;
+
+	printf("%s: %" PRId64 " ns/line, %" PRId64 " bytes/s\n", what,
+	    ns / nlines, bytes * 1000000000 / (ns + 1));
+}
+
+int
+rumprun_test(int argc, char *argv[])
+{
+	int64_t tot = 0;
+	int i;
+
+	if ((cons = fdopen(rumprun_test_consfd(), "w")) == NULL)
+		err(1, "fdopen console");
+	setvbuf(cons, NULL, _IOLBF, 0);
+
+	for (i = 0; i < NBURSTS; i++) {
+		tot += logburst(BURST);
+		/* let the console catch up */
+		usleep(100*1000);
+	}
+	report("short bursts", BURST*NBURSTS, tot);
+	report("single burst", BURST*NBURSTS, logburst(BURST*NBURSTS));
+
+	return 0;
+}
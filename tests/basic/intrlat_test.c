@@ -0,0 +1,161 @@
+/*
+ * Measure disk interrupt latency, first on an idle system and then
+ * while another thread keeps the network interface busy.  With a
+ * single interrupt thread, disk completions queue up behind network
+ * interrupts; with per-interrupt threads they shouldn't.
+ *
+ * The disk read from is the second one, the first one belongs to
+ * the test framework.  The network load is generated by broadcasting
+ * UDP packets through a configured network interface.  The test fails
+ * if either is missing, see runtests.sh for how it is run.
+ * The platform's interrupt statistics are dumped after each run.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rumprun/tester.h>
+
+#define NREADS 2000
+#define SECSIZE 512
+
+/* from the platform, prints per-interrupt counts and latencies */
+void bmk_platform_intrstat_dump(void);
+
+static const char *trydisk[] = {
+	"/dev/rld1d",
+	"/dev/rxbd1d",
+};
+
+static volatile int netstop;
+static uint64_t netpkts;
+
+static int64_t
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int
+cmp64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int
+disklat(int fd, const char *what)
+{
+	static int64_t lat[NREADS];
+	char buf[SECSIZE];
+	int64_t start, tot = 0;
+	int i;
+
+	for (i = 0; i < NREADS; i++) {
+		start = now();
+		if (pread(fd, buf, sizeof(buf), SECSIZE) != sizeof(buf)) {
+			printf("NOK: read: %s\n", strerror(errno));
+			return 1;
+		}
+		lat[i] = now() - start;
+		tot += lat[i];
+	}
+	qsort(lat, NREADS, sizeof(lat[0]), cmp64);
+
+	printf("disk read latency (%s): min %" PRId64 " avg %" PRId64
+	    " p99 %" PRId64 " max %" PRId64 " ns\n", what,
+	    lat[0], tot / NREADS, lat[NREADS*99/100], lat[NREADS-1]);
+
+	return 0;
+}
+
+static void *
+netload(void *arg)
+{
+	struct sockaddr_in sin;
+	char pkt[1024];
+	int s = *(int *)arg;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_len = sizeof(sin);
+	sin.sin_port = htons(9); /* discard */
+	sin.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+	memset(pkt, 0, sizeof(pkt));
+
+	while (!netstop) {
+		if (sendto(s, pkt, sizeof(pkt), 0,
+		    (struct sockaddr *)&sin, sizeof(sin)) == sizeof(pkt))
+			netpkts++;
+		else if (errno != ENOBUFS)
+			break;
+	}
+
+	return NULL;
+}
+
+int
+rumprun_test(int argc, char *argv[])
+{
+	struct sockaddr_in sin;
+	pthread_t pt;
+	unsigned int i;
+	int fd = -1, s, one = 1;
+	int rv;
+
+	for (i = 0; i < sizeof(trydisk)/sizeof(trydisk[0]); i++) {
+		if ((fd = open(trydisk[i], O_RDONLY)) != -1)
+			break;
+	}
+	if (fd == -1) {
+		printf("NOK: no second disk device\n");
+		return 1;
+	}
+
+	if ((rv = disklat(fd, "idle")) != 0)
+		return rv;
+	bmk_platform_intrstat_dump();
+
+	/* see if we can generate network load */
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_len = sizeof(sin);
+	sin.sin_port = htons(9);
+	sin.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+	if ((s = socket(PF_INET, SOCK_DGRAM, 0)) == -1
+	    || setsockopt(s, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one)) == -1
+	    || sendto(s, "", 1, 0, (struct sockaddr *)&sin, sizeof(sin)) == -1) {
+		printf("NOK: cannot broadcast, no network interface?\n");
+		return 1;
+	}
+
+	if (pthread_create(&pt, NULL, netload, &s) != 0) {
+		printf("NOK: pthread_create\n");
+		return 1;
+	}
+	rv = disklat(fd, "network load");
+	netstop = 1;
+	pthread_join(pt, NULL);
+	printf("sent %" PRIu64 " packets during measurement\n", netpkts);
+	bmk_platform_intrstat_dump();
+
+	close(s);
+	close(fd);
+	return rv;
+}
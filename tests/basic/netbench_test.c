@@ -0,0 +1,383 @@
+/*
+ * Measure TCP bulk throughput and request/response latency through
+ * the network stack.  By default, the server and the client run in
+ * the same guest over the loopback interface.  To measure over a
+ * network interface, run one guest with -s (server, never returns)
+ * and another with -c addr.  -p names the path in the results, e.g.
+ * after the driver, so that runs over different drivers can be told
+ * apart (default "nic").
+ *
+ * The results are printed as one line of JSON per run so that they
+ * can be picked out of the test output and compared between builds.
+ *
+ * usage: netbench_test [-s | -c addr [-p path]] [-t secs]
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <arpa/inet.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rumprun/tester.h>
+
+#define PORT 5001
+#define STREAMBUF (64*1024)
+#define RPCSIZE 64
+#define MAXRPC 200000
+#define CONNTRIES 20
+
+#define OP_STREAM 'S'
+#define OP_RPC 'R'
+
+static int conntries = 1;
+
+static int64_t
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int
+cmp64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int
+readn(int s, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(s, p, len)) <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int
+writen(int s, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(s, p, len)) <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Server side of one connection.  The first byte selects what to
+ * do: sink a stream and reply with the byte count, or echo requests.
+ */
+static void *
+serve(void *arg)
+{
+	static char buf[STREAMBUF];
+	uint64_t count;
+	ssize_t n;
+	int s = (int)(intptr_t)arg, one = 1;
+	char op;
+
+	if (readn(s, &op, 1) == -1)
+		goto out;
+
+	switch (op) {
+	case OP_STREAM:
+		/* all stream connections may share the sink buffer */
+		count = 0;
+		while ((n = read(s, buf, sizeof(buf))) > 0)
+			count += n;
+		writen(s, &count, sizeof(count));
+		break;
+	case OP_RPC:
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		for (;;) {
+			char req[RPCSIZE];
+
+			if (readn(s, req, sizeof(req)) == -1
+			    || writen(s, req, sizeof(req)) == -1)
+				break;
+		}
+		break;
+	}
+
+ out:
+	close(s);
+	return NULL;
+}
+
+static void *
+server(void *arg)
+{
+	pthread_t pt;
+	int ls = (int)(intptr_t)arg, s;
+
+	for (;;) {
+		if ((s = accept(ls, NULL, NULL)) == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			printf("accept: %s\n", strerror(errno));
+			break;
+		}
+		if (pthread_create(&pt, NULL, serve,
+		    (void *)(intptr_t)s) != 0) {
+			close(s);
+			continue;
+		}
+		pthread_detach(pt);
+	}
+
+	return NULL;
+}
+
+static int
+listensock(void)
+{
+	struct sockaddr_in sin;
+	int s, one = 1;
+
+	if ((s = socket(PF_INET, SOCK_STREAM, 0)) == -1)
+		return -1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_len = sizeof(sin);
+	sin.sin_port = htons(PORT);
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(s, (struct sockaddr *)&sin, sizeof(sin)) == -1
+	    || listen(s, 16) == -1) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+/*
+ * Connect to the server and select the operation.  A server in
+ * another guest may still be booting, so retry for a while.
+ */
+static int
+connectsock(struct in_addr addr, char op)
+{
+	struct sockaddr_in sin;
+	int s, i, error;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_len = sizeof(sin);
+	sin.sin_port = htons(PORT);
+	sin.sin_addr = addr;
+
+	for (i = 0;; i++) {
+		if ((s = socket(PF_INET, SOCK_STREAM, 0)) == -1)
+			return -1;
+		if (connect(s, (struct sockaddr *)&sin, sizeof(sin)) == 0)
+			break;
+		error = errno;
+		close(s);
+		errno = error;
+		if (i+1 == conntries || (error != ECONNREFUSED
+		    && error != ETIMEDOUT && error != EHOSTUNREACH
+		    && error != ENETUNREACH))
+			return -1;
+		sleep(1);
+	}
+
+	if (writen(s, &op, 1) == -1) {
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+/*
+ * Write as much as we can for the given time.  The measurement ends
+ * when the server reports how much it got, so that data still in the
+ * socket buffers is not counted as sent.
+ */
+static int
+stream(struct in_addr addr, int secs, uint64_t *bytes, int64_t *ns)
+{
+	static char buf[STREAMBUF];
+	uint64_t sent = 0, got;
+	int64_t start, end;
+	int s;
+
+	if ((s = connectsock(addr, OP_STREAM)) == -1)
+		return -1;
+
+	memset(buf, 0xa5, sizeof(buf));
+	start = now();
+	end = start + secs * 1000000000LL;
+	while (now() < end) {
+		if (writen(s, buf, sizeof(buf)) == -1)
+			goto fail;
+		sent += sizeof(buf);
+	}
+	shutdown(s, SHUT_WR);
+	if (readn(s, &got, sizeof(got)) == -1)
+		goto fail;
+	*ns = now() - start;
+	close(s);
+
+	if (got != sent) {
+		printf("stream: sent %" PRIu64 " bytes, server got %" PRIu64
+		    "\n", sent, got);
+		return -1;
+	}
+	*bytes = got;
+	return 0;
+
+ fail:
+	close(s);
+	return -1;
+}
+
+/*
+ * One request in flight at a time, so the latency is the full round
+ * trip through both stacks.
+ */
+static int
+rpc(struct in_addr addr, int secs, int64_t *lat, int *nreqs, int64_t *ns)
+{
+	char req[RPCSIZE], resp[RPCSIZE];
+	int64_t start, end, t;
+	int s, n, one = 1;
+
+	if ((s = connectsock(addr, OP_RPC)) == -1)
+		return -1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	memset(req, 0x5a, sizeof(req));
+	start = now();
+	end = start + secs * 1000000000LL;
+	for (n = 0, t = start; n < MAXRPC && t < end; n++) {
+		if (writen(s, req, sizeof(req)) == -1
+		    || readn(s, resp, sizeof(resp)) == -1) {
+			close(s);
+			return -1;
+		}
+		lat[n] = now() - t;
+		t += lat[n];
+	}
+	*ns = t - start;
+	*nreqs = n;
+	close(s);
+
+	return 0;
+}
+
+static int
+bench(const char *path, struct in_addr addr, int secs)
+{
+	static int64_t lat[MAXRPC];
+	uint64_t bytes;
+	int64_t streamns, rpcns;
+	int nreqs;
+
+	if (stream(addr, secs, &bytes, &streamns) == -1) {
+		printf("NOK: stream (%s): %s\n", path, strerror(errno));
+		return 1;
+	}
+	if (rpc(addr, secs, lat, &nreqs, &rpcns) == -1 || nreqs == 0) {
+		printf("NOK: rpc (%s): %s\n", path, strerror(errno));
+		return 1;
+	}
+	qsort(lat, nreqs, sizeof(lat[0]), cmp64);
+
+	printf("{\"netbench\":\"%s\",\"secs\":%d,"
+	    "\"stream\":{\"bytes\":%" PRIu64 ",\"gbps\":%.3f},"
+	    "\"rpc\":{\"size\":%d,\"reqs\":%d,\"rps\":%.0f,"
+	    "\"lat_us\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+	    "\"max\":%.1f}}}\n",
+	    path, secs, bytes, bytes * 8.0 / streamns,
+	    RPCSIZE, nreqs, nreqs * 1e9 / rpcns,
+	    lat[nreqs*50/100] / 1e3, lat[nreqs*90/100] / 1e3,
+	    lat[nreqs*99/100] / 1e3, lat[nreqs-1] / 1e3);
+
+	return 0;
+}
+
+int
+rumprun_test(int argc, char *argv[])
+{
+	struct in_addr addr;
+	pthread_t pt;
+	const char *peer = NULL, *path = "nic";
+	int ch, ls, secs = 2, srvonly = 0;
+
+	while ((ch = getopt(argc, argv, "c:p:st:")) != -1) {
+		switch (ch) {
+		case 'c':
+			peer = optarg;
+			break;
+		case 'p':
+			path = optarg;
+			break;
+		case 's':
+			srvonly = 1;
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		default:
+			printf("usage: netbench_test [-s | -c addr [-p path]] "
+			    "[-t secs]\n");
+			return 1;
+		}
+	}
+	if (secs <= 0)
+		secs = 1;
+
+	if (peer) {
+		if (inet_pton(AF_INET, peer, &addr) != 1) {
+			printf("NOK: invalid address %s\n", peer);
+			return 1;
+		}
+		conntries = CONNTRIES;
+		return bench(path, addr, secs);
+	}
+
+	if ((ls = listensock()) == -1) {
+		printf("NOK: listen on TCP port %d: %s\n", PORT,
+		    strerror(errno));
+		return 1;
+	}
+	if (srvonly) {
+		server((void *)(intptr_t)ls);
+		return 1;
+	}
+
+	if (pthread_create(&pt, NULL, server, (void *)(intptr_t)ls) != 0) {
+		printf("NOK: pthread_create\n");
+		return 1;
+	}
+	addr.s_addr = htonl(INADDR_LOOPBACK);
+	return bench("loopback", addr, secs);
+}
@@ -34,9 +34,14 @@ export RUMPRUN_WARNING_STFU=please
 
 # TODO: use a more scalable way of specifying tests
 TESTS='hello/hello.bin basic/ctor_test.bin basic/pthread_test.bin
-	basic/tls_test.bin basic/misc_test.bin'
+	basic/tls_test.bin basic/misc_test.bin basic/clock_test.bin
+	basic/conslog_test.bin basic/netbench_test.bin'
 [ -x hello/hellopp.bin ] && TESTS="${TESTS} hello/hellopp.bin"
 
+INTRLAT=basic/intrlat_test.bin
+NETBENCH=basic/netbench_test.bin
+NETBENCH_VIONET=basic/netbench_test_vionet.bin
+
 STARTMAGIC='=== FOE RUMPRUN 12345 TES-TER 54321 ==='
 ENDMAGIC='=== RUMPRUN 12345 TES-TER 54321 EOF ==='
 
@@ -65,16 +70,19 @@ ddimage ()
 	dd if=${imgsource} of=${imgname} bs=512 count=${blocks} > /dev/null 2>&1
 }
 
+# any further arguments are passed to rumprun, arguments for the test
+# program itself go in ${TESTARGS}.  The guest gets ${TESTSECS} seconds.
+# If ${TESTIMG2} is set, it is given to the guest as the second disk.
 runguest ()
 {
 
 	testprog=$1
 	img1=$2
-	# notyet
-	# img2=$3
+	shift 2
 
 	[ -n "${img1}" ] || die runtest without a disk image
-	cookie=$(${RUMPRUN} ${OPT_SUDO} ${STACK} -b ${img1} ${testprog} __test)
+	cookie=$(${RUMPRUN} ${OPT_SUDO} ${STACK} "$@" -b ${img1} \
+	    ${TESTIMG2:+-b ${TESTIMG2}} ${testprog} __test ${TESTARGS})
 	if [ $? -ne 0 -o -z "${cookie}" ]; then
 		TEST_RESULT=ERROR
 		TEST_ECODE=-2
@@ -82,7 +90,7 @@ runguest ()
 		TEST_RESULT=TIMEOUT
 		TEST_ECODE=-1
 
-		for x in $(seq 10) ; do
+		for x in $(seq ${TESTSECS:-10}) ; do
 			echo ">> polling, round ${x} ..."
 			set -- $(sed 1q < ${img1})
 
@@ -125,6 +133,41 @@ getoutput ()
 	fi
 }
 
+# Run the network benchmark between two guests whose NICs are
+# connected with a QEMU socket backend.  One guest serves, the other
+# runs the client as a normal test.  The NIC is virtio-net either way,
+# the driver used by the guests is given by "ifbase".
+runnetbench ()
+{
+
+	bin=$1
+	ifbase=$2
+	img=$3
+
+	port=$((20000 + $$ % 10000))
+	server=$(${RUMPRUN} ${OPT_SUDO} ${STACK} \
+	    -I "nb0,${ifbase},-net socket,listen=127.0.0.1:${port}" \
+	    -W nb0,inet,static,10.0.120.1/24 ${bin} -s)
+	if [ $? -ne 0 -o -z "${server}" ]; then
+		TEST_RESULT=ERROR
+		TEST_ECODE=-2
+		echo ">> Result: ${TEST_RESULT} (${TEST_ECODE})"
+		return
+	fi
+	# give qemu time to start listening
+	sleep 1
+
+	# the client retries connecting while the server boots
+	TESTARGS="-c 10.0.120.1 -p nic-${ifbase}"
+	TESTSECS=30
+	runguest ${bin} ${img} \
+	    -I "nb0,${ifbase},-net socket,connect=127.0.0.1:${port}" \
+	    -W nb0,inet,static,10.0.120.2/24
+	unset TESTARGS TESTSECS
+
+	${RUMPSTOP} ${OPT_SUDO} ${server}
+}
+
 runtest ()
 {
 
@@ -163,12 +206,92 @@ for test in ${TESTS}; do
 	echo ">> Test output for ${test}"
 	getoutput ${outputimg}
 	echo ">> End test outout"
+	getoutput ${outputimg} | grep '^{"netbench"' >> netbench.json
 
 	echo ${test} ${TEST_RESULT} ${TEST_ECODE} >> test.log
 	[ "${TEST_RESULT}" != 'SUCCESS' ] && rv=1
 	echo
 done
 
+# Boot on the q35 machine type too, whose chipset routes PCI
+# interrupts differently from the default i440fx.  The test framework
+# disk and a NIC configured via DHCP both need working interrupts.
+if [ ${STACK} = qemu -o ${STACK} = kvm ]; then
+	test=hello/hello.bin-q35
+	echo ">> Running test: ${test}"
+
+	outputimg=hello_q35.disk1
+	ddimage ${outputimg} $((2*512))
+	TESTSECS=30
+	runguest ${TOPDIR}/hello/hello.bin ${outputimg} -g '-M q35' \
+	    -I "q0,vioif,-net user" -W q0,inet,dhcp
+	unset TESTSECS
+
+	echo ">> Test output for ${test}"
+	getoutput ${outputimg}
+	echo ">> End test outout"
+
+	echo ${test} ${TEST_RESULT} ${TEST_ECODE} >> test.log
+	[ "${TEST_RESULT}" != 'SUCCESS' ] && rv=1
+	echo
+fi
+
+# The interrupt latency test needs a disk of its own to read from and
+# a NIC to generate load on.  The NIC uses QEMU user networking, whose
+# gateway gives the broadcasts a route.
+if [ ${STACK} = qemu -o ${STACK} = kvm ]; then
+	test=${INTRLAT}
+	echo ">> Running test: ${test}"
+
+	outputimg=intrlat.disk1
+	ddimage ${outputimg} $((2*512))
+	ddimage intrlat.disk2 $((1024*1024))
+	TESTIMG2=intrlat.disk2
+	TESTSECS=30
+	runguest ${TOPDIR}/${test} ${outputimg} \
+	    -I "il0,vioif,-net user" -W il0,inet,static,10.0.2.15/24,10.0.2.2
+	unset TESTIMG2 TESTSECS
+
+	echo ">> Test output for ${test}"
+	getoutput ${outputimg}
+	echo ">> End test outout"
+
+	echo ${test} ${TEST_RESULT} ${TEST_ECODE} >> test.log
+	[ "${TEST_RESULT}" != 'SUCCESS' ] && rv=1
+	echo
+fi
+
+# the socket backend is QEMU-only.  Run the benchmark with both
+# virtio-net drivers, vioif and vionet, so that they can be compared.
+if [ ${STACK} = qemu -o ${STACK} = kvm ]; then
+	for nb in ${NETBENCH},vioif ${NETBENCH_VIONET},vionet; do
+		bin=${nb%,*}
+		ifbase=${nb#*,}
+		[ -x ${TOPDIR}/${bin} ] || continue
+
+		test=${bin}-nic
+		echo ">> Running test: ${test}"
+
+		outputimg=netbench_nic_${ifbase}.disk1
+		ddimage ${outputimg} $((2*512))
+		runnetbench ${TOPDIR}/${bin} ${ifbase} ${outputimg}
+
+		echo ">> Test output for ${test}"
+		getoutput ${outputimg}
+		echo ">> End test outout"
+		getoutput ${outputimg} | grep '^{"netbench"' >> netbench.json
+
+		echo ${test} ${TEST_RESULT} ${TEST_ECODE} >> test.log
+		[ "${TEST_RESULT}" != 'SUCCESS' ] && rv=1
+		echo
+	done
+fi
+
+if [ -s netbench.json ]; then
+	echo '>> NETWORK BENCHMARK'
+	cat netbench.json
+fi
+
 echo '>> TEST LOG'
 cat test.log
 